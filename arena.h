@@ -0,0 +1,237 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "stringfragment.h"
+
+// Bump allocator for state that lives exactly as long as one translation.
+//
+// Memory comes from a short chain of blocks, each at least as large as all
+// the ones before it, and is only given back all at once by clear(). A
+// clear() that finds more than one block replaces them with a single block of
+// their combined size, so an instance reused for inputs of similar size
+// settles on one block and stops touching the heap.
+class Arena
+{
+  struct Block
+  {
+    Block* m_Prev;
+    size_t m_Size;
+  };
+
+  // Keeps what follows a block header aligned for anything we store.
+  static constexpr size_t kHeaderSize = (sizeof(Block) + 15) & ~size_t(15);
+  static constexpr size_t kMinBlockSize = 64 * 1024;
+
+  Block* m_Head = nullptr;
+  char*  m_Cursor = nullptr;
+  char*  m_Limit = nullptr;
+  size_t m_Reserved = 0;
+  size_t m_BlockCount = 0;
+
+public:
+  Arena() {}
+  ~Arena() { freeBlocks(); }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t align)
+  {
+    char* p = alignUp(m_Cursor, align);
+    if (!m_Cursor || size_t(m_Limit - p) < size)
+    {
+      addBlock(size + align);
+      p = alignUp(m_Cursor, align);
+    }
+
+    m_Cursor = p + size;
+    return p;
+  }
+
+  // Grows the most recent allocation in place, if there is room after it.
+  bool extend(void* p, size_t size, size_t newSize)
+  {
+    if (static_cast<char*>(p) + size != m_Cursor || size_t(m_Limit - m_Cursor) < newSize - size)
+      return false;
+
+    m_Cursor += newSize - size;
+    return true;
+  }
+
+  StringFragment copy(StringFragment f)
+  {
+    size_t len = f.size();
+    if (0 == len)
+      return StringFragment();
+
+    char* dst = static_cast<char*>(allocate(len, 1));
+    memcpy(dst, f.ptr(), len);
+    return StringFragment(dst, len);
+  }
+
+  // Makes sure the next 'size' bytes come from a single block.
+  void reserve(size_t size)
+  {
+    if (!m_Cursor || size_t(m_Limit - m_Cursor) < size)
+      addBlock(size);
+  }
+
+  // Invalidates everything handed out so far.
+  void clear()
+  {
+    if (m_BlockCount > 1)
+    {
+      size_t total = m_Reserved;
+      freeBlocks();
+      addBlock(total - kHeaderSize);
+    }
+
+    if (m_Head)
+      m_Cursor = reinterpret_cast<char*>(m_Head) + kHeaderSize;
+  }
+
+  size_t blockCount() const { return m_BlockCount; }
+  size_t bytesReserved() const { return m_Reserved; }
+
+private:
+  static char* alignUp(char* p, size_t align)
+  {
+    return reinterpret_cast<char*>((uintptr_t(p) + align - 1) & ~uintptr_t(align - 1));
+  }
+
+  void addBlock(size_t size)
+  {
+    size_t blockSize = kHeaderSize + size;
+    if (blockSize < m_Reserved)
+      blockSize = m_Reserved;
+    if (blockSize < kMinBlockSize)
+      blockSize = kMinBlockSize;
+
+    Block* block = static_cast<Block*>(::operator new(blockSize));
+    block->m_Prev = m_Head;
+    block->m_Size = blockSize;
+
+    m_Head = block;
+    m_Cursor = reinterpret_cast<char*>(block) + kHeaderSize;
+    m_Limit = reinterpret_cast<char*>(block) + blockSize;
+    m_Reserved += blockSize;
+    ++m_BlockCount;
+  }
+
+  void freeBlocks()
+  {
+    while (m_Head)
+    {
+      Block* prev = m_Head->m_Prev;
+      ::operator delete(m_Head);
+      m_Head = prev;
+    }
+
+    m_Cursor = m_Limit = nullptr;
+    m_Reserved = 0;
+    m_BlockCount = 0;
+  }
+};
+
+// A growable array of plain values kept in an Arena. Growing leaves the old
+// storage behind in the arena, unless it was the arena's last allocation and
+// can be extended where it is.
+//
+// Storage is only valid until the arena is cleared, so owners call release()
+// on every array before clearing it.
+template <typename T>
+class ArenaArray
+{
+  static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+      "ArenaArray moves elements with memcpy and never destroys them");
+
+  Arena* m_Arena = nullptr;
+  T*     m_Data = nullptr;
+  size_t m_Size = 0;
+  size_t m_Capacity = 0;
+
+public:
+  ArenaArray() {}
+  explicit ArenaArray(Arena* arena) : m_Arena(arena) {}
+
+  ArenaArray(const ArenaArray&) = delete;
+  ArenaArray& operator=(const ArenaArray&) = delete;
+
+  void attach(Arena* arena) { m_Arena = arena; }
+
+  size_t size() const { return m_Size; }
+  size_t capacity() const { return m_Capacity; }
+  bool empty() const { return 0 == m_Size; }
+
+  T* data() { return m_Data; }
+  T* begin() { return m_Data; }
+  T* end() { return m_Data + m_Size; }
+  const T* begin() const { return m_Data; }
+  const T* end() const { return m_Data + m_Size; }
+
+  T& operator[](size_t i) { return m_Data[i]; }
+  const T& operator[](size_t i) const { return m_Data[i]; }
+  T& back() { return m_Data[m_Size - 1]; }
+
+  void push_back(const T& value)
+  {
+    if (m_Size == m_Capacity)
+      reserve(m_Capacity ? m_Capacity * 2 : 16);
+    m_Data[m_Size++] = value;
+  }
+
+  void pop_back() { --m_Size; }
+
+  // New elements are value initialized.
+  void resize(size_t size)
+  {
+    if (size > m_Capacity)
+      reserve(size > m_Capacity * 2 ? size : m_Capacity * 2);
+    for (size_t i = m_Size; i < size; ++i)
+      new (m_Data + i) T();
+    m_Size = size;
+  }
+
+  void reserve(size_t capacity)
+  {
+    if (capacity <= m_Capacity)
+      return;
+
+    if (m_Data && m_Arena->extend(m_Data, m_Capacity * sizeof(T), capacity * sizeof(T)))
+    {
+      m_Capacity = capacity;
+      return;
+    }
+
+    T* data = static_cast<T*>(m_Arena->allocate(capacity * sizeof(T), alignof(T)));
+    if (m_Size)
+      memcpy(static_cast<void*>(data), m_Data, m_Size * sizeof(T));
+    m_Data = data;
+    m_Capacity = capacity;
+  }
+
+  void clear() { m_Size = 0; }
+
+  void swap(ArenaArray& other)
+  {
+    std::swap(m_Arena, other.m_Arena);
+    std::swap(m_Data, other.m_Data);
+    std::swap(m_Size, other.m_Size);
+    std::swap(m_Capacity, other.m_Capacity);
+  }
+
+  // Forgets the storage without touching it.
+  void release()
+  {
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Capacity = 0;
+  }
+};
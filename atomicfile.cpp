@@ -0,0 +1,124 @@
+#include "atomicfile.h"
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+AtomicFile::~AtomicFile()
+{
+  abort();
+}
+
+bool AtomicFile::open(const char* path, bool binary)
+{
+  abort();
+
+  m_Path = path;
+  m_TempPath = makeTempPath(m_Path);
+  m_File = fopen(m_TempPath.c_str(), binary ? "wb" : "w");
+  return nullptr != m_File;
+}
+
+bool AtomicFile::commit(bool onlyIfChanged)
+{
+  if (!m_File)
+    return false;
+
+  bool ok = !ferror(m_File);
+  ok = 0 == fclose(m_File) && ok;
+  m_File = nullptr;
+
+  if (ok && onlyIfChanged && sameFileContents(m_TempPath.c_str(), m_Path.c_str()))
+  {
+    remove(m_TempPath.c_str());
+    m_TempPath.clear();
+    return true;
+  }
+
+  if (ok && replaceFile(m_TempPath.c_str(), m_Path.c_str()))
+  {
+    m_TempPath.clear();
+    return true;
+  }
+
+  remove(m_TempPath.c_str());
+  m_TempPath.clear();
+  return false;
+}
+
+void AtomicFile::abort()
+{
+  if (m_File)
+  {
+    fclose(m_File);
+    m_File = nullptr;
+  }
+
+  if (!m_TempPath.empty())
+  {
+    remove(m_TempPath.c_str());
+    m_TempPath.clear();
+  }
+}
+
+std::string makeTempPath(const std::string& path)
+{
+  static std::atomic<unsigned> s_Counter(0);
+
+  return path + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(s_Counter++);
+}
+
+bool sameFileContents(const char* a, const char* b)
+{
+  FILE* fa = fopen(a, "rb");
+  if (!fa)
+    return false;
+
+  FILE* fb = fopen(b, "rb");
+  if (!fb)
+  {
+    fclose(fa);
+    return false;
+  }
+
+  // Most changed files differ in size, which is found out without reading.
+  bool same = 0 == fseek(fa, 0, SEEK_END) && 0 == fseek(fb, 0, SEEK_END) && ftell(fa) == ftell(fb);
+  rewind(fa);
+  rewind(fb);
+
+  char bufA[32 * 1024];
+  char bufB[32 * 1024];
+  while (same)
+  {
+    size_t na = fread(bufA, 1, sizeof bufA, fa);
+    size_t nb = fread(bufB, 1, sizeof bufB, fb);
+    same = na == nb && 0 == memcmp(bufA, bufB, na);
+    if (na < sizeof bufA)
+    {
+      same = same && !ferror(fa) && !ferror(fb);
+      break;
+    }
+  }
+
+  fclose(fa);
+  fclose(fb);
+  return same;
+}
+
+bool replaceFile(const char* from, const char* to)
+{
+#if defined(_WIN32)
+  return 0 != MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+#else
+  return 0 == rename(from, to);
+#endif
+}
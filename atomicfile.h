@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+// Writes a file under a temporary name next to its destination and renames
+// it into place on commit(), so other processes never observe a partially
+// written file and an existing file is replaced rather than truncated.
+// Anything not committed is removed when the object goes away.
+class AtomicFile
+{
+  std::string m_Path;
+  std::string m_TempPath;
+  FILE*       m_File = nullptr;
+
+public:
+  AtomicFile() = default;
+  ~AtomicFile();
+
+  AtomicFile(const AtomicFile&) = delete;
+  AtomicFile& operator=(const AtomicFile&) = delete;
+
+  bool open(const char* path, bool binary = false);
+
+  FILE* file() const { return m_File; }
+  const std::string& tempPath() const { return m_TempPath; }
+
+  // With 'onlyIfChanged', an existing destination with the same contents is
+  // left untouched (keeping its timestamp) and the new copy is dropped.
+  bool commit(bool onlyIfChanged = false);
+  void abort();
+};
+
+// A path next to 'path' that no other thread or process will pick.
+std::string makeTempPath(const std::string& path);
+
+// True if both files exist and hold the same bytes.
+bool sameFileContents(const char* a, const char* b);
+
+// rename() that replaces an existing destination on all platforms.
+bool replaceFile(const char* from, const char* to);
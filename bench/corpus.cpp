@@ -0,0 +1,154 @@
+#include "corpus.h"
+
+#include <stdio.h>
+
+namespace
+{
+  // xorshift32; plenty for picking lines, and the same everywhere.
+  class Random
+  {
+    uint32_t m_State;
+
+  public:
+    explicit Random(uint32_t seed) : m_State(seed ? seed : 1) {}
+
+    uint32_t next()
+    {
+      m_State ^= m_State << 13;
+      m_State ^= m_State >> 17;
+      m_State ^= m_State << 5;
+      return m_State;
+    }
+
+    int below(int n) { return int(next() % uint32_t(n)); }
+  };
+
+  // Names allocated at the top of every procedure, in the order they end up
+  // in a0, a1, d7, d6, d5, d4, a6 and a5.
+  const char* const kBaseNames[] = { "src", "dst", "x", "y", "count", "tmp", "p", "q" };
+  const int kNameCount = int(sizeof kBaseNames / sizeof kBaseNames[0]);
+
+  // x heads the spill chain and is never renamed.
+  const int kFirstRenamable = 3;
+
+  const char* const kPlainLines[] =
+  {
+    "\t\tmove.l\td0,d1\n",
+    "\t\tlea\tsome_table_label(pc),a1\n",
+    "\t\tadd.w\t#$40,d2\t\t; skip the header\n",
+    "; ----------------------------------------------------------------\n",
+    "\t\tbtst\t#6,$bfe001\n",
+    "\n",
+    "\t\tdbf\td1,*-4\n",
+    "\t\tmove.w\t#$7fff,$dff09a\t; disable interrupts\n",
+  };
+
+  const char* const kVerbatimLines[] =
+  {
+    "\t\tdc.w\t$0180,$0000,$0182,$0fff,$0184,$0f00,$0186,$00f0\n",
+    "; Copper list and tables, no register allocation in here\n",
+    "\t\tcnop\t0,4\n",
+    "\t\tdc.l\t0,0,0,0\n",
+    "\t\tmove.l\t4.w,a6\n",
+    "\t\tjsr\t-132(a6)\n",
+    "\n",
+    "\t\tds.b\t256\n",
+  };
+
+  template <size_t N>
+  const char* pick(Random& random, const char* const (&lines)[N])
+  {
+    return lines[random.below(int(N))];
+  }
+}
+
+std::string makeCorpus(const CorpusOptions& options)
+{
+  std::string text;
+  text.reserve(options.m_Bytes + 64 * 1024);
+
+  Random random(options.m_Seed);
+  std::string names[kNameCount];
+  char buf[256];
+
+  text += "\t\tsection\tcode,code\n";
+
+  for (int proc = 0; text.size() < options.m_Bytes; ++proc)
+  {
+    for (int i = 0; i < kNameCount; ++i)
+      names[i] = kBaseNames[i];
+
+    if (proc % 3 == 2)
+      snprintf(buf, sizeof buf, "\t\t@cproc fn%d(a0:src, a1:dst) modifies d0\n", proc);
+    else
+      snprintf(buf, sizeof buf, "\t\t@proc fn%d(a0:src, a1:dst)\n", proc);
+    text += buf;
+    text += "\t\t@dreg x, y, count, tmp\n";
+    text += "\t\t@areg p, q\n";
+
+    const int lines = options.m_ProcLines;
+    const int openAt = lines / 4;
+    const int closeAt = lines - lines / 4;
+    int renames = 0;
+
+    for (int line = 0; line < lines; ++line)
+    {
+      // Every level spills the register holding the previous level's
+      // value, so they all share d7 and can nest arbitrarily deep.
+      if (line == openAt)
+      {
+        for (int level = 1; level <= options.m_SpillDepth; ++level)
+        {
+          const std::string prev = level > 1 ? "s" + std::to_string(level - 1) : names[2];
+          snprintf(buf, sizeof buf, "\t\t@spill %s\n\t\t@dreg s%d\n\t\tmove.l @%s,@s%d\n", prev.c_str(), level, prev.c_str(), level);
+          text += buf;
+        }
+      }
+
+      if (line == closeAt)
+      {
+        for (int level = options.m_SpillDepth; level >= 1; --level)
+        {
+          const std::string prev = level > 1 ? "s" + std::to_string(level - 1) : names[2];
+          snprintf(buf, sizeof buf, "\t\tmove.l @s%d,@%s\n\t\t@kill s%d\n\t\t@restore %s\n", level, names[3].c_str(), level, prev.c_str());
+          text += buf;
+        }
+      }
+
+      if (options.m_RenameEvery > 0 && line % options.m_RenameEvery == options.m_RenameEvery - 1)
+      {
+        const int index = kFirstRenamable + random.below(kNameCount - kFirstRenamable);
+        const std::string renamed = std::string(kBaseNames[index]) + "_" + std::to_string(++renames);
+        snprintf(buf, sizeof buf, "\t\t@rename %s %s\n", names[index].c_str(), renamed.c_str());
+        text += buf;
+        names[index] = renamed;
+      }
+
+      if (random.below(100) < options.m_ReferencePercent)
+      {
+        const char* a = names[random.below(kNameCount)].c_str();
+        const char* b = names[random.below(kNameCount)].c_str();
+
+        switch (random.below(4))
+        {
+          case 0: snprintf(buf, sizeof buf, "\t\tmove.l\t(@%s)+,@%s\n", a, b); break;
+          case 1: snprintf(buf, sizeof buf, "\t\tadd.l\t@%s,@%s\t\t; accumulate\n", a, b); break;
+          case 2: snprintf(buf, sizeof buf, "\t\tmove.w\t%d(@%s),@%s\n", 2 * random.below(64), a, b); break;
+          case 3: snprintf(buf, sizeof buf, ".l%d_%d:\tsubq.l\t#1,@%s\n", proc, line, a); break;
+        }
+        text += buf;
+      }
+      else
+      {
+        text += pick(random, kPlainLines);
+      }
+    }
+
+    text += "\t\t@endproc\n\n";
+
+    for (int line = 0; line < options.m_VerbatimLines; ++line)
+      text += pick(random, kVerbatimLines);
+  }
+
+  return text;
+}
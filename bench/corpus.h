@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Synthetic deluxe68 sources for benchmarks. Every corpus translates without
+// errors, and the same options and seed always give the same text.
+struct CorpusOptions
+{
+  size_t   m_Bytes = 16 * 1024 * 1024;
+  // Code lines in each procedure, besides its directives.
+  int      m_ProcLines = 60;
+  // How deep @spill/@restore blocks nest inside each procedure.
+  int      m_SpillDepth = 4;
+  // A @rename every this many code lines; 0 for none.
+  int      m_RenameEvery = 8;
+  // Percentage of code lines that refer to allocated registers by name.
+  int      m_ReferencePercent = 60;
+  // Plain assembly lines (no directives) between procedures.
+  int      m_VerbatimLines = 40;
+  uint32_t m_Seed = 1;
+};
+
+std::string makeCorpus(const CorpusOptions& options);
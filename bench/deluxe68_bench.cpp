@@ -0,0 +1,265 @@
+// Translation throughput on a synthetic corpus, phase by phase: splitting the
+// input into lines, tokenizing the directive lines, run() and
+// generateOutput(). Each phase is repeated and the best and median times are
+// reported, so regressions show up before a release does, along with how many
+// heap allocations one repetition makes.
+//
+// usage: deluxe68bench [options]
+//   -m <mb>          corpus size (default 16)
+//   -r <n>           repetitions per phase (default 7)
+//   --lines <n>      code lines per procedure (default 60)
+//   --spill <n>      @spill/@restore nesting depth (default 4)
+//   --rename <n>     a @rename every n code lines, 0 for none (default 8)
+//   --refs <pct>     percentage of code lines referring to names (default 60)
+//   --verbatim <n>   directive-free lines between procedures (default 40)
+//   --seed <n>       corpus seed (default 1)
+//   --emit <file>    write the corpus to <file> and exit
+
+#include "deluxe.h"
+#include "outputsink.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+#include "corpus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every operator new in the process is counted. The bench is single threaded.
+static size_t s_Allocations = 0;
+
+void* operator new(size_t size)
+{
+  ++s_Allocations;
+  if (void* p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  free(p);
+}
+
+namespace
+{
+  // Accepts everything, so only the translator is measured.
+  class NullSink : public OutputSink
+  {
+  public:
+    size_t m_Bytes = 0;
+
+    ~NullSink() { flush(); }
+
+  protected:
+    bool writeChunks(const Chunk* chunks, size_t count) override
+    {
+      for (size_t i = 0; i < count; ++i)
+        m_Bytes += chunks[i].m_Len;
+      return true;
+    }
+  };
+
+  struct Timing
+  {
+    double m_Best;
+    double m_Median;
+    size_t m_Allocations;   // Per repetition, after the warm-up run
+  };
+
+  template <typename Fn>
+  Timing measure(int repetitions, Fn fn)
+  {
+    // One run to warm caches and the allocator.
+    fn();
+
+    std::vector<double> times;
+    times.reserve(size_t(repetitions));
+    const size_t allocations = s_Allocations;
+
+    for (int i = 0; i < repetitions; ++i)
+    {
+      auto t0 = std::chrono::steady_clock::now();
+      fn();
+      std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+      times.push_back(dt.count());
+    }
+
+    const size_t count = (s_Allocations - allocations) / size_t(repetitions);
+    std::sort(times.begin(), times.end());
+    return Timing { times.front(), times[times.size() / 2], count };
+  }
+
+  void report(const char* phase, const Timing& t, size_t bytes, size_t lines)
+  {
+    printf("%-18s %10.2f %10.2f %10.1f %10.2f %6.1f%% %8zu\n", phase, t.m_Best * 1e3, t.m_Median * 1e3,
+        bytes / t.m_Best / (1024.0 * 1024.0), lines / t.m_Best / 1e6,
+        100.0 * (t.m_Median - t.m_Best) / t.m_Best, t.m_Allocations);
+  }
+
+  void usage()
+  {
+    fprintf(stderr, "usage: deluxe68bench [-m <mb>] [-r <n>] [--lines <n>] [--spill <n>] [--rename <n>]\n");
+    fprintf(stderr, "                     [--refs <pct>] [--verbatim <n>] [--seed <n>] [--emit <file>]\n");
+    exit(1);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  CorpusOptions options;
+  int repetitions = 7;
+  const char* emitPath = nullptr;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    if (i + 1 >= argc)
+      usage();
+
+    const char* value = argv[++i];
+
+    if (0 == strcmp("-m", arg))
+      options.m_Bytes = size_t(atof(value) * 1024 * 1024);
+    else if (0 == strcmp("-r", arg))
+      repetitions = std::max(1, atoi(value));
+    else if (0 == strcmp("--lines", arg))
+      options.m_ProcLines = atoi(value);
+    else if (0 == strcmp("--spill", arg))
+      options.m_SpillDepth = atoi(value);
+    else if (0 == strcmp("--rename", arg))
+      options.m_RenameEvery = atoi(value);
+    else if (0 == strcmp("--refs", arg))
+      options.m_ReferencePercent = atoi(value);
+    else if (0 == strcmp("--verbatim", arg))
+      options.m_VerbatimLines = atoi(value);
+    else if (0 == strcmp("--seed", arg))
+      options.m_Seed = uint32_t(strtoul(value, nullptr, 10));
+    else if (0 == strcmp("--emit", arg))
+      emitPath = value;
+    else
+      usage();
+  }
+
+  const std::string corpus = makeCorpus(options);
+  const char* begin = corpus.data();
+  const char* end = begin + corpus.size();
+
+  if (emitPath)
+  {
+    FILE* f = fopen(emitPath, "wb");
+    if (!f || corpus.size() != fwrite(corpus.data(), 1, corpus.size(), f) || 0 != fclose(f))
+    {
+      fprintf(stderr, "can't write %s\n", emitPath);
+      return 1;
+    }
+    return 0;
+  }
+
+  // The directive lines, for tokenizing on their own.
+  std::vector<StringFragment> directives;
+  size_t directiveBytes = 0;
+  size_t lineCount = 0;
+  for (const char* p = begin; p < end; )
+  {
+    const char* eol = findNewline(p, end);
+    StringFragment payload = skipWhitespace(StringFragment(p, size_t(eol - p)));
+    if (payload && '@' == payload[0])
+    {
+      directives.push_back(payload.skip(1));
+      directiveBytes += size_t(eol - p) + 1;
+    }
+    ++lineCount;
+    p = eol + 1;
+  }
+
+  {
+    Deluxe68 check("bench.s", begin, corpus.size(), false, false);
+    check.run();
+    if (check.errorCount())
+    {
+      fprintf(stderr, "the corpus doesn't translate cleanly\n");
+      return 1;
+    }
+  }
+
+  printf("corpus: %.1f MB, %zu lines, %zu directives, scan level %s, %d repetitions\n",
+      corpus.size() / (1024.0 * 1024.0), lineCount, directives.size(), scanLevelName(scanLevel()), repetitions);
+  printf("%-18s %10s %10s %10s %10s %7s %8s\n", "phase", "best ms", "median ms", "MB/s", "Mlines/s", "spread", "allocs");
+
+  volatile size_t sink = 0;
+
+  Timing split = measure(repetitions, [&]
+  {
+    size_t lines = 0;
+    for (const char* p = begin; p < end; ++lines)
+      p = findNewline(p, end) + 1;
+    sink = sink + lines;
+  });
+  report("split lines", split, corpus.size(), lineCount);
+
+  Timing tokenize = measure(repetitions, [&]
+  {
+    size_t tokens = 0;
+    for (StringFragment line : directives)
+    {
+      Tokenizer t(line);
+      while (t.next().m_Type != TokenType::kEndOfLine)
+        ++tokens;
+    }
+    sink = sink + tokens;
+  });
+  report("tokenize", tokenize, directiveBytes, directives.size());
+
+  Deluxe68 translator;
+  Timing run = measure(repetitions, [&]
+  {
+    translator.reset("bench.s", begin, corpus.size(), false, false);
+    translator.run();
+  });
+  report("run()", run, corpus.size(), lineCount);
+
+  NullSink output;
+  Timing generate = measure(repetitions, [&]
+  {
+    translator.generateOutput(output);
+  });
+  report("generateOutput()", generate, corpus.size(), lineCount);
+
+  Timing total = measure(repetitions, [&]
+  {
+    Deluxe68 d("bench.s", begin, corpus.size(), false, false);
+    d.run();
+    d.generateOutput(output);
+  });
+  report("fresh translation", total, corpus.size(), lineCount);
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Compares the scan implementations on a synthetic corpus, both for the raw
+// line splitting and '@' scanning loops and for a complete translation.
+//
+// usage: deluxe68scanbench [megabytes]
+
+#include "deluxe.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+static std::string makeCorpus(size_t targetBytes)
+{
+  std::string text;
+  text.reserve(targetBytes + 4096);
+
+  char buf[256];
+  for (int proc = 0; text.size() < targetBytes; ++proc)
+  {
+    snprintf(buf, sizeof buf,
+        "\t\t@proc fn%d(a0:src)\n"
+        "\t\t@dreg x,y\n"
+        "\t\tmove.l (@src)+,@x\t\t; first word\n", proc);
+    text += buf;
+
+    // Mostly plain 68k code, as in real sources.
+    for (int i = 0; i < 40; ++i)
+    {
+      switch (i % 8)
+      {
+        case 0: snprintf(buf, sizeof buf, ".loop%d_%d:\n", proc, i); break;
+        case 1: snprintf(buf, sizeof buf, "\t\tmove.l d0,d1\n"); break;
+        case 2: snprintf(buf, sizeof buf, "\t\tadd.w #%d,d2\t\t; adjust for the header offset\n", i * 7); break;
+        case 3: snprintf(buf, sizeof buf, "\t\tmove.l @x,@y\n"); break;
+        case 4: snprintf(buf, sizeof buf, "\t\tlea\tsome_table_label(pc),a1\n"); break;
+        case 5: snprintf(buf, sizeof buf, "; ----------------------------------------------------------------\n"); break;
+        case 6: snprintf(buf, sizeof buf, "\t\tdbf\td7,.loop%d_%d\n", proc, i - 6); break;
+        case 7: snprintf(buf, sizeof buf, "\n"); break;
+      }
+      text += buf;
+    }
+
+    text += "\t\t@endproc\n\n";
+  }
+
+  return text;
+}
+
+static void discard(const char*, size_t, void*)
+{
+}
+
+template <typename Fn>
+static double bestSeconds(Fn fn)
+{
+  double best = 1e9;
+  for (int i = 0; i < 5; ++i)
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    if (dt.count() < best)
+      best = dt.count();
+  }
+  return best;
+}
+
+int main(int argc, char* argv[])
+{
+  const size_t megabytes = argc > 1 ? size_t(atoi(argv[1])) : 16;
+  const std::string corpus = makeCorpus(megabytes * 1024 * 1024);
+  const char* begin = corpus.data();
+  const char* end = begin + corpus.size();
+
+  size_t lineCount = 0;
+  for (const char* p = begin; p != end; ++p)
+    lineCount += '\n' == *p;
+
+  printf("corpus: %.1f MB, %zu lines\n", corpus.size() / (1024.0 * 1024.0), lineCount);
+  printf("%-8s %14s %14s\n", "", "scan lines/s", "xlat lines/s");
+
+  const ScanLevel best = detectScanLevel();
+  volatile size_t sink = 0;
+
+  for (int level = 0; level <= int(best); ++level)
+  {
+    setScanLevel(ScanLevel(level));
+
+    double scan = bestSeconds([&]
+    {
+      size_t hits = 0;
+      for (const char* p = begin; p < end; )
+      {
+        const char* eol = findNewline(p, end);
+        for (const char* q = p; (q = findAtOrSemicolon(q, eol)) != eol && '@' == *q; ++q)
+          ++hits;
+        p = eol + 1;
+      }
+      sink = sink + hits;
+    });
+
+    double xlat = bestSeconds([&]
+    {
+      Deluxe68 d("bench.s", begin, corpus.size(), false, false);
+      d.run();
+      d.generateOutput(discard, nullptr);
+    });
+
+    printf("%-8s %14.0f %14.0f\n", scanLevelName(ScanLevel(level)), lineCount / scan, lineCount / xlat);
+  }
+
+  setScanLevel(best);
+  return 0;
+}
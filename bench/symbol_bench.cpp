@@ -0,0 +1,136 @@
+// Measures name lookup cost on reference-heavy code: the old string keyed
+// hash map against the interned symbol table, and a complete translation of
+// a corpus where most lines refer to allocated registers.
+//
+// usage: deluxe68symbolbench [megabytes]
+
+#include "deluxe.h"
+#include "symboltable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char* const kNames[] =
+{
+  "src", "dst", "count", "tmp", "x", "y", "colour_mask", "scanline_offset",
+  "width", "height", "blitter_base", "p",
+};
+
+static const int kNameCount = int(sizeof(kNames) / sizeof(kNames[0]));
+
+static std::string makeCorpus(size_t targetBytes)
+{
+  std::string text;
+  text.reserve(targetBytes + 4096);
+
+  char buf[256];
+  for (int proc = 0; text.size() < targetBytes; ++proc)
+  {
+    snprintf(buf, sizeof buf, "\t\t@proc fn%d(a0:%s, a1:%s)\n", proc, kNames[0], kNames[1]);
+    text += buf;
+    text += "\t\t@dreg count, tmp, x, y, colour_mask, scanline_offset\n";
+    text += "\t\t@areg width, height, blitter_base, p\n";
+
+    for (int i = 0; i < 40; ++i)
+    {
+      const char* a = kNames[i % kNameCount];
+      const char* b = kNames[(i * 5 + 3) % kNameCount];
+      snprintf(buf, sizeof buf, "\t\tmove.l (@%s)+,@%s\n", a, b);
+      text += buf;
+    }
+
+    text += "\t\t@endproc\n";
+  }
+
+  return text;
+}
+
+static void discard(const char*, size_t, void*)
+{
+}
+
+template <typename Fn>
+static double bestSeconds(Fn fn)
+{
+  double best = 1e9;
+  for (int i = 0; i < 5; ++i)
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    if (dt.count() < best)
+      best = dt.count();
+  }
+  return best;
+}
+
+int main(int argc, char* argv[])
+{
+  const size_t megabytes = argc > 1 ? size_t(atoi(argv[1])) : 16;
+
+  // Lookups as handleRegularLine() does them: the names point into the
+  // source text, not at the strings the table was filled from.
+  std::string refText;
+  std::vector<StringFragment> refs;
+  for (int i = 0; i < 4096; ++i)
+    refText += kNames[(i * 7) % kNameCount];
+  for (int i = 0, pos = 0; i < 4096; ++i)
+  {
+    size_t len = strlen(kNames[(i * 7) % kNameCount]);
+    refs.push_back(StringFragment(refText.data() + pos, len));
+    pos += int(len);
+  }
+
+  std::unordered_map<StringFragment, int> map;
+  SymbolTable table;
+  for (int i = 0; i < kNameCount; ++i)
+  {
+    map.insert(std::make_pair(StringFragment(kNames[i]), i));
+    table.intern(kNames[i]);
+  }
+
+  const int kRounds = 2000;
+  volatile size_t sink = 0;
+
+  double mapTime = bestSeconds([&]
+  {
+    size_t sum = 0;
+    for (int r = 0; r < kRounds; ++r)
+      for (StringFragment name : refs)
+        sum += map.find(name)->second;
+    sink = sink + sum;
+  });
+
+  double tableTime = bestSeconds([&]
+  {
+    size_t sum = 0;
+    for (int r = 0; r < kRounds; ++r)
+      for (StringFragment name : refs)
+        sum += table.find(name);
+    sink = sink + sum;
+  });
+
+  const double lookups = double(kRounds) * refs.size();
+  printf("unordered_map<StringFragment>: %6.2f ns/lookup\n", mapTime * 1e9 / lookups);
+  printf("SymbolTable:                   %6.2f ns/lookup\n", tableTime * 1e9 / lookups);
+
+  const std::string corpus = makeCorpus(megabytes * 1024 * 1024);
+  size_t lineCount = 0;
+  for (char ch : corpus)
+    lineCount += '\n' == ch;
+
+  double xlat = bestSeconds([&]
+  {
+    Deluxe68 d("bench.s", corpus.data(), corpus.size(), false, false);
+    d.run();
+    d.generateOutput(discard, nullptr);
+  });
+
+  printf("translation: %.1f MB, %zu lines, %.0f lines/s\n", corpus.size() / (1024.0 * 1024.0), lineCount, lineCount / xlat);
+  return 0;
+}
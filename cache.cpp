@@ -0,0 +1,270 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "atomicfile.h"
+#include "deluxe.h"
+#include "driver.h"
+#include "hash.h"
+#include "signatures.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define D68_HAVE_CACHE 1
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#else
+#define D68_HAVE_CACHE 0
+#endif
+
+// Temp files from writers that died are cleaned up after this many seconds.
+static constexpr time_t kStaleTempAge = 60 * 60;
+
+TranslationCache::TranslationCache()
+  : m_Hits(0)
+  , m_Misses(0)
+{
+}
+
+std::string TranslationCache::makeKey(const char* data, size_t len, const char* inputName, const DriverOptions& options) const
+{
+  // Everything besides the input bytes that can change the output.
+  std::string salt = kDeluxe68Version;
+  salt += '\0';
+  salt += options.m_EmitLineDirectives ? 'l' : '-';
+  salt += options.m_ProcSections ? 'p' : '-';
+  if (CompactMode::kNone != options.m_Compact)
+    salt += char('0' + int(options.m_Compact));
+
+  // What @call spills depends on the imported signatures.
+  if (options.m_Signatures)
+  {
+    char fingerprint[17];
+    snprintf(fingerprint, sizeof fingerprint, "%016llx", (unsigned long long)options.m_Signatures->fingerprint());
+    salt += '\0';
+    salt += fingerprint;
+  }
+
+  // tbl_line directives name the input file.
+  if (options.m_EmitLineDirectives)
+  {
+    salt += '\0';
+    salt += inputName;
+  }
+
+  uint64_t h0 = hash64(data, len, hash64(salt.data(), salt.size(), 0x9e3779b97f4a7c15ull));
+  uint64_t h1 = hash64(data, len, hash64(salt.data(), salt.size(), 0xc2b2ae3d27d4eb4full));
+
+  char key[33];
+  snprintf(key, sizeof key, "%016llx%016llx", (unsigned long long)h0, (unsigned long long)h1);
+  return key;
+}
+
+std::string TranslationCache::entryPath(const std::string& key) const
+{
+  return m_Dir + "/" + key;
+}
+
+void TranslationCache::store(const std::string& key, const std::string& contents)
+{
+  AtomicFile f;
+  if (!f.open(entryPath(key).c_str()))
+    return;
+
+  fwrite(contents.data(), 1, contents.size(), f.file());
+  f.commit();
+}
+
+#if D68_HAVE_CACHE
+
+static bool copyFile(const char* from, const char* to)
+{
+  FILE* src = fopen(from, "rb");
+  if (!src)
+    return false;
+
+  FILE* dst = fopen(to, "wb");
+  if (!dst)
+  {
+    fclose(src);
+    return false;
+  }
+
+  char buf[64 * 1024];
+  size_t n;
+  bool ok = true;
+  while (ok && (n = fread(buf, 1, sizeof buf, src)) > 0)
+  {
+    ok = n == fwrite(buf, 1, n, dst);
+  }
+
+  ok = !ferror(src) && ok;
+  fclose(src);
+  ok = 0 == fclose(dst) && ok;
+  return ok;
+}
+
+static bool sameInode(const char* a, const char* b)
+{
+  struct stat sa, sb;
+  return 0 == stat(a, &sa) && 0 == stat(b, &sb) && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+bool TranslationCache::open(const char* dir, uint64_t maxBytes)
+{
+  m_Dir = dir;
+  m_MaxBytes = maxBytes;
+
+  // Don't end up with "dir//key" paths.
+  while (m_Dir.size() > 1 && '/' == m_Dir.back())
+    m_Dir.pop_back();
+
+  if (0 != mkdir(m_Dir.c_str(), 0777) && EEXIST != errno)
+  {
+    fprintf(stderr, "can't create cache directory %s: %s\n", dir, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (0 != stat(m_Dir.c_str(), &st) || !S_ISDIR(st.st_mode))
+  {
+    fprintf(stderr, "%s is not a directory\n", dir);
+    return false;
+  }
+
+  return true;
+}
+
+bool TranslationCache::fetch(const std::string& key, const char* outputPath, bool onlyIfChanged)
+{
+  std::string entry = entryPath(key);
+
+  if (onlyIfChanged && sameFileContents(entry.c_str(), outputPath))
+  {
+    // An output linked to the entry by an earlier run shares its timestamp,
+    // so touching the entry would touch the output too.
+    if (!sameInode(entry.c_str(), outputPath))
+      utime(entry.c_str(), nullptr);
+    ++m_Hits;
+    return true;
+  }
+
+  std::string temp = makeTempPath(outputPath);
+
+  // Hard link where possible, and fall back to copying across file systems.
+  // Either way the output appears atomically. Outputs that must keep their
+  // timestamp get their own copy, so later hits can touch the entry freely.
+  if (onlyIfChanged || 0 != link(entry.c_str(), temp.c_str()))
+  {
+    if ((!onlyIfChanged && ENOENT == errno) || !copyFile(entry.c_str(), temp.c_str()))
+    {
+      remove(temp.c_str());
+      ++m_Misses;
+      return false;
+    }
+  }
+
+  if (!replaceFile(temp.c_str(), outputPath))
+  {
+    remove(temp.c_str());
+    ++m_Misses;
+    return false;
+  }
+
+  // Recently used entries survive trim().
+  utime(entry.c_str(), nullptr);
+
+  ++m_Hits;
+  return true;
+}
+
+void TranslationCache::trim()
+{
+  std::lock_guard<std::mutex> lock(m_TrimLock);
+
+  DIR* dir = opendir(m_Dir.c_str());
+  if (!dir)
+    return;
+
+  struct Entry
+  {
+    std::string m_Path;
+    time_t      m_Time;
+    uint64_t    m_Size;
+  };
+
+  std::vector<Entry> entries;
+  uint64_t totalSize = 0;
+  time_t now = time(nullptr);
+
+  while (dirent* de = readdir(dir))
+  {
+    if ('.' == de->d_name[0])
+      continue;
+
+    std::string path = m_Dir + "/" + de->d_name;
+
+    struct stat st;
+    if (0 != stat(path.c_str(), &st) || !S_ISREG(st.st_mode))
+      continue;
+
+    // In-flight writes from other processes; only touch them once they're
+    // clearly abandoned.
+    if (strstr(de->d_name, ".tmp"))
+    {
+      if (now - st.st_mtime > kStaleTempAge)
+        remove(path.c_str());
+      continue;
+    }
+
+    entries.push_back(Entry { path, st.st_mtime, uint64_t(st.st_size) });
+    totalSize += uint64_t(st.st_size);
+  }
+
+  closedir(dir);
+
+  if (totalSize <= m_MaxBytes)
+    return;
+
+  // Oldest first, and leave some headroom so the next few stores don't
+  // immediately trigger another round.
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.m_Time < b.m_Time; });
+
+  uint64_t target = m_MaxBytes - m_MaxBytes / 10;
+
+  for (const Entry& e : entries)
+  {
+    if (totalSize <= target)
+      break;
+
+    if (0 == remove(e.m_Path.c_str()))
+      totalSize -= e.m_Size;
+  }
+}
+
+#else
+
+bool TranslationCache::open(const char* dir, uint64_t maxBytes)
+{
+  fprintf(stderr, "the translation cache isn't supported on this platform\n");
+  return false;
+}
+
+bool TranslationCache::fetch(const std::string& key, const char* outputPath, bool onlyIfChanged)
+{
+  ++m_Misses;
+  return false;
+}
+
+void TranslationCache::trim()
+{
+}
+
+#endif
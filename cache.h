@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+struct DriverOptions;
+
+// Content addressed store of translated files.
+//
+// Entries are keyed by a hash of the input bytes, the options that affect the
+// output and the translator version, so a hit can stand in for a full
+// translation. Entries are written atomically and only ever replaced whole,
+// which lets concurrent build jobs share one directory. trim() bounds the
+// total size by evicting the least recently used entries.
+class TranslationCache
+{
+  std::string           m_Dir;
+  uint64_t              m_MaxBytes = 0;
+  std::atomic<unsigned> m_Hits;
+  std::atomic<unsigned> m_Misses;
+  std::mutex            m_TrimLock;
+
+public:
+  static constexpr uint64_t kDefaultMaxBytes = 512ull * 1024 * 1024;
+
+  TranslationCache();
+
+  TranslationCache(const TranslationCache&) = delete;
+  TranslationCache& operator=(const TranslationCache&) = delete;
+
+  // Use (and create if needed) the directory 'dir'.
+  bool open(const char* dir, uint64_t maxBytes = kDefaultMaxBytes);
+
+  std::string makeKey(const char* data, size_t len, const char* inputName, const DriverOptions& options) const;
+
+  // Put a copy of the entry for 'key' at 'outputPath'. Returns false on a miss.
+  // With 'onlyIfChanged', an identical existing output is left alone.
+  bool fetch(const std::string& key, const char* outputPath, bool onlyIfChanged = false);
+
+  // Add an entry. Failures are silent - the cache is only an optimization.
+  void store(const std::string& key, const std::string& contents);
+
+  // Evict least recently used entries until the cache fits its size limit.
+  void trim();
+
+  unsigned hits() const { return m_Hits; }
+  unsigned misses() const { return m_Misses; }
+
+private:
+  std::string entryPath(const std::string& key) const;
+};
@@ -1,9 +1,56 @@
 #include "deluxe.h"
+#include "linereader.h"
+#include "proccache.h"
+#include "scan.h"
+#include "signatures.h"
+#include "stats.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
-#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// C++14 still wants definitions for static members that get bound to a
+// reference, as gtest's EXPECT_EQ does.
+constexpr uint32_t OutputElement::kKindBits;
+constexpr uint32_t OutputElement::kSourceBits;
+constexpr uint32_t OutputElement::kSizeShift;
+constexpr uint32_t OutputElement::kMaxSize;
+
+// Procedures translated ahead of time by translateProceduresInParallel(),
+// in source order.
+struct Deluxe68::PrecomputedProcs
+{
+  struct Proc
+  {
+    ProcSpan       m_Span;
+    int            m_StartLine = 0;
+    // Everything but the schedule, which is only kept for a procedure cache.
+    ProcCacheEntry m_Entry;
+    // The finished output, starting with a line directive for the first
+    // line if directives are on. It is left out if the output hasn't
+    // drifted from the input at that point.
+    std::string    m_Output;
+    size_t         m_DirectiveSize = 0;
+    bool           m_Ok = false;
+    // What the worker counted for --stats; the schedule only gets a single
+    // kPrecomputed element in its place.
+    TranslationStats m_Stats;
+  };
+
+  std::vector<Proc> m_Procs;
+  size_t            m_Next = 0;
+};
+
+Deluxe68::Deluxe68()
+{
+  attachArena();
+  killAll();
+}
 
 Deluxe68::Deluxe68(const char* ifn, const char* data, size_t len, bool emitLineDirectives, bool procSections)
   : m_InputData(data)
@@ -13,62 +60,1034 @@ Deluxe68::Deluxe68(const char* ifn, const char* data, size_t len, bool emitLineD
   , m_EmitLineDirectives(emitLineDirectives)
   , m_ProcSections(procSections)
 {
+  attachArena();
   killAll();
 }
 
+Deluxe68::Deluxe68(const char* ifn, LineReader& reader, bool emitLineDirectives, bool procSections)
+  : Deluxe68(ifn, nullptr, 0, emitLineDirectives, procSections)
+{
+  m_Reader = &reader;
+}
+
+void Deluxe68::reset(const char* ifn, const char* data, size_t len, bool emitLineDirectives, bool procSections)
+{
+  // Clears the live flags while the arrays still match the old symbols.
+  killAll();
+
+  m_InputData = data;
+  m_InputLen = len;
+  m_Reader = nullptr;
+  m_LineText.clear();
+  m_ExtraText.clear();
+  m_Symbols.clear();
+  m_HoldStreamingOutput = false;
+  m_Precomputed.reset();
+  m_OutputSchedule.clear();
+
+  m_Filename = ifn;
+  m_LineNumber = 0;
+  m_ErrorCount = 0;
+  m_Diagnostics.clear();
+  m_DiagnosticIndex.clear();
+  m_Stopped = false;
+  m_ParsePoint = data;
+
+  m_EmitLineDirectives = emitLineDirectives;
+  m_ProcSections = procSections;
+  m_CurrentOutputLine = 0;
+  m_LineDelta = kNoLineDelta;
+
+  m_CurrentProcId = kNoSymbol;
+  m_CurrentProc = ProcedureDef();
+  m_SpillStackDepth = 0;
+  clearArena();
+  m_ProcOutputs.clear();
+  m_PeakLiveCount = 0;
+}
+
+void Deluxe68::reset(const char* ifn, LineReader& reader, bool emitLineDirectives, bool procSections)
+{
+  reset(ifn, nullptr, 0, emitLineDirectives, procSections);
+  m_Reader = &reader;
+}
+
 Deluxe68::~Deluxe68()
 {
 }
 
-void Deluxe68::error(const char *fmt, ...)
+const char* diagnosticCodeName(DiagnosticCode code)
 {
-  if (m_LineNumber)
-    fprintf(stderr, "%s(%d): ", m_Filename, m_LineNumber);
-  else
-    fprintf(stderr, "%s: ", m_Filename);
+  static const char* const names[] =
+  {
+    "input-too-large",
+    "unsupported-syntax",
+    "unexpected-token",
+    "name-in-use",
+    "out-of-registers",
+    "register-owner",
+    "register-not-free",
+    "name-not-in-use",
+    "nested-proc",
+    "proc-redefined",
+    "unknown-keyword",
+    "register-not-reserved",
+    "unknown-register",
+    "unknown-reference",
+    "already-spilled",
+    "not-spilled",
+    "home-slot-taken",
+    "rename-target-in-use",
+    "rename-source-not-live",
+  };
+  static_assert(sizeof names / sizeof names[0] == size_t(DiagnosticCode::kCount), "missing diagnostic code names");
+
+  return code < DiagnosticCode::kCount ? names[size_t(code)] : "unknown";
+}
 
+void Deluxe68::error(DiagnosticCode code, const char *fmt, ...)
+{
   va_list a;
   va_start(a, fmt);
-  vfprintf(stderr, fmt, a);
+  report(m_LineNumber, code, fmt, a);
   va_end(a);
-  ++m_ErrorCount;
 }
 
-void Deluxe68::errorForLine(int lineNumber, const char *fmt, ...)
+void Deluxe68::errorForLine(int lineNumber, DiagnosticCode code, const char *fmt, ...)
 {
-  if (lineNumber)
-    fprintf(stderr, "%s(%d): ", m_Filename, lineNumber);
-  else
-    fprintf(stderr, "%s: ", m_Filename);
-
   va_list a;
   va_start(a, fmt);
-  vfprintf(stderr, fmt, a);
+  report(lineNumber, code, fmt, a);
   va_end(a);
+}
+
+void Deluxe68::report(int lineNumber, DiagnosticCode code, const char* fmt, va_list args)
+{
   ++m_ErrorCount;
+  if (m_MaxErrors && m_ErrorCount >= m_MaxErrors)
+    m_Stopped = true;
+
+  char msg[1024];
+  int len = vsnprintf(msg, sizeof msg, fmt, args);
+  if (len < 0)
+    len = 0;
+  else if (size_t(len) >= sizeof msg)
+    len = int(sizeof msg) - 1;
+  if (len > 0 && '\n' == msg[len - 1])
+    --len;
+
+  // The register owners listed after running out of registers are context
+  // for that error, so they are never folded into an earlier list.
+  std::string key(1, char(code));
+  key.append(msg, size_t(len));
+
+  if (code != DiagnosticCode::kRegisterOwner)
+  {
+    auto it = m_DiagnosticIndex.find(key);
+    if (it != m_DiagnosticIndex.end())
+    {
+      Diagnostic& first = m_Diagnostics[it->second];
+      ++first.m_Repeats;
+      first.m_LastLine = lineNumber;
+      return;
+    }
+    m_DiagnosticIndex.emplace(std::move(key), m_Diagnostics.size());
+  }
+
+  Diagnostic d;
+  d.m_File = m_Filename;
+  d.m_Line = lineNumber;
+  d.m_Code = code;
+  d.m_Message.assign(msg, size_t(len));
+  m_Diagnostics.push_back(std::move(d));
+}
+
+static void appendLocation(std::string* out, const char* file, int line)
+{
+  char loc[64];
+  out->append(file);
+  if (line)
+  {
+    snprintf(loc, sizeof loc, "(%d): ", line);
+    out->append(loc);
+  }
+  else
+  {
+    out->append(": ");
+  }
+}
+
+void Deluxe68::flushDiagnostics()
+{
+  // Everything goes out in one write (or one callback per message), so
+  // messages from translators running on other threads don't interleave.
+  std::string text, one;
+  char buf[128];
+
+  for (const Diagnostic& d : m_Diagnostics)
+  {
+    one.clear();
+    appendLocation(&one, d.m_File, d.m_Line);
+    one += d.m_Message;
+    one += '\n';
+
+    if (d.m_Repeats)
+    {
+      appendLocation(&one, d.m_File, d.m_Line);
+      snprintf(buf, sizeof buf, "note: repeated %d more time%s, last on line %d\n",
+          d.m_Repeats, d.m_Repeats == 1 ? "" : "s", d.m_LastLine);
+      one += buf;
+    }
+
+    if (m_DiagnosticCallback)
+      m_DiagnosticCallback(one.data(), one.size(), m_DiagnosticData);
+    else
+      text += one;
+  }
+
+  if (m_Stopped)
+  {
+    one.clear();
+    appendLocation(&one, m_Filename, m_LineNumber);
+    snprintf(buf, sizeof buf, "error limit of %d reached, stopping\n", m_MaxErrors);
+    one += buf;
+
+    if (m_DiagnosticCallback)
+      m_DiagnosticCallback(one.data(), one.size(), m_DiagnosticData);
+    else
+      text += one;
+  }
+
+  if (!text.empty())
+  {
+    fwrite(text.data(), 1, text.size(), stderr);
+    fflush(stderr);
+  }
+}
+
+void Deluxe68::setStreamingOutput(FILE* f)
+{
+  m_OwnedStreamSink.reset(new FileSink(f));
+  m_StreamSink = m_OwnedStreamSink.get();
+}
+
+void Deluxe68::setStreamingOutput(PrintCallback* cb, void* user_data)
+{
+  m_OwnedStreamSink.reset(new CallbackSink(cb, user_data));
+  m_StreamSink = m_OwnedStreamSink.get();
+}
+
+void Deluxe68::setStreamingOutput(OutputSink* sink)
+{
+  m_OwnedStreamSink.reset();
+  m_StreamSink = sink;
+}
+
+void Deluxe68::setDiagnosticCallback(DiagnosticCallback* cb, void* user_data)
+{
+  m_DiagnosticCallback = cb;
+  m_DiagnosticData = user_data;
+}
+
+void Deluxe68::setMaxErrors(int count)
+{
+  m_MaxErrors = count > 0 ? count : 0;
+}
+
+void Deluxe68::setProcedureCache(ProcCache* cache)
+{
+  m_ProcCache = cache;
+}
+
+void Deluxe68::setProcedureThreads(int threadCount)
+{
+  m_ProcedureThreads = threadCount;
+}
+
+void Deluxe68::setCompactMode(CompactMode mode)
+{
+  m_Compact = mode;
+}
+
+void Deluxe68::setSignatures(const SignatureDb* signatures)
+{
+  m_Signatures = signatures;
+}
+
+void Deluxe68::setSplitOutput(bool split)
+{
+  m_SplitOutput = split;
+}
+
+void Deluxe68::setStats(TranslationStats* stats)
+{
+  m_Stats = stats;
+}
+
+void Deluxe68::run()
+{
+  // Schedule entries refer to input text by 32-bit offset.
+  if (m_InputLen > UINT32_MAX)
+  {
+    error(DiagnosticCode::kInputTooLarge, "input is too large (the limit is 4 GB)\n");
+    flushDiagnostics();
+    return;
+  }
+
+  // Typical sources produce about one schedule entry per 12 bytes of input.
+  // Streaming output only ever holds one procedure.
+  if (!m_StreamSink && !m_Reader)
+    m_OutputSchedule.reserve(m_InputLen / 12 + 16);
+
+  if (m_ProcedureThreads > 1 && !m_Reader)
+    translateProceduresInParallel();
+
+  while (dataLeft() && !m_Stopped)
+  {
+    if (m_Precomputed && translatePrecomputedProc())
+      continue;
+
+    if (m_ProcCache && !m_Reader && translateCachedProc())
+      continue;
+
+    if (!m_Reader && translateVerbatimLines(m_InputData + m_InputLen))
+      continue;
+
+    translateLine(nextLine());
+  }
+
+  flushStreamingOutput();
+
+  if (m_Stats)
+    collectFinalStats();
+
+  flushDiagnostics();
+}
+
+// A line holding nothing but a comment: ';' after optional whitespace, or
+// '*' in the first column.
+static bool isCommentLine(const char* p, const char* end)
+{
+  if (p < end && '*' == *p)
+    return true;
+
+  while (p < end && (' ' == *p || '\t' == *p))
+    ++p;
+
+  return p < end && ';' == *p;
+}
+
+void Deluxe68::dropCommentLine()
+{
+  // An empty line keeps the numbering for much less than the line directive
+  // a gap would need.
+  if (m_EmitLineDirectives)
+  {
+    syncLineDirective();
+    newline();
+  }
+
+  ++m_LineNumber;
+}
+
+void Deluxe68::translateLine(StringFragment line)
+{
+  if (CompactMode::kNoComments == m_Compact && isCommentLine(line.ptr(), line.end()))
+  {
+    dropCommentLine();
+    return;
+  }
+
+  parseLine(line);
+}
+
+void Deluxe68::syncLineDirective()
+{
+  if (m_EmitLineDirectives)
+  {
+    int currentLineDelta = m_CurrentOutputLine - m_LineNumber;
+
+    if (currentLineDelta != m_LineDelta)
+    {
+      // In compact output a directive's line may produce nothing at all, as
+      // with @spill of a register that isn't in use. The next directive
+      // then takes its place instead of following it. Nothing from before
+      // the current procedure is touched; it may be cached or written out
+      // on its own.
+      const OutputElement directive(OutputKind::kLineDirective, m_LineNumber + 1);
+      if (m_OutputSchedule.size() > m_OpenProcOutput.m_Begin && OutputKind::kLineDirective == m_OutputSchedule.back().kind())
+        m_OutputSchedule.back() = directive;
+      else
+        output(directive);
+      m_LineDelta = currentLineDelta;
+    }
+  }
+}
+
+void Deluxe68::forgetLineDelta()
+{
+  // Headers and footers are counted as two lines, but leave out the movem
+  // when nothing is saved, which isn't known until @endproc. Full output
+  // echoes the next line and resyncs anyway; compact output may not, so the
+  // next line that produces output has to get a directive.
+  if (CompactMode::kNone != m_Compact)
+    m_LineDelta = kNoLineDelta;
+}
+
+bool Deluxe68::translateVerbatimLines(const char* end)
+{
+  // Lines without an '@' (outside of comments) are copied as they are, so a
+  // run of them becomes a single span of the input.
+  const char* const start = m_ParsePoint;
+  const char* begin = start;
+  const char* p = begin;
+  int lineCount = 0;
+  const bool dropComments = CompactMode::kNoComments == m_Compact;
+
+  while (p < end)
+  {
+    const char* nl = findNewline(p, end);
+    const char* hit = findAtOrSemicolon(p, nl);
+    if (hit != nl && '@' == *hit)
+      break;
+
+    if (dropComments && isCommentLine(p, nl))
+    {
+      // Comment lines end a span; ones in front of it are skipped over.
+      if (lineCount)
+        break;
+
+      dropCommentLine();
+      p = nl == end ? end : nl + 1;
+      begin = m_ParsePoint = p;
+      continue;
+    }
+
+    ++lineCount;
+    p = nl == end ? end : nl + 1;
+  }
+
+  if (0 == lineCount)
+    return m_ParsePoint != start;
+
+  // Every line comes out as exactly one line, so the output can only drift
+  // from the input before the first one.
+  syncLineDirective();
+
+  outputText(OutputKind::kStringLiteral, StringFragment(begin, size_t(p - begin)));
+
+  if ('\n' == p[-1])
+  {
+    m_CurrentOutputLine += lineCount;
+  }
+  else
+  {
+    m_CurrentOutputLine += lineCount - 1;
+    newline();
+  }
+
+  m_LineNumber += lineCount;
+  m_ParsePoint = p;
+  return true;
+}
+
+// Returns the line starting at 'p' without its newline, and where the next
+// one starts.
+static StringFragment lineAt(const char* p, const char* end, const char** next)
+{
+  const char* nl = findNewline(p, end);
+  if (nl == end)
+  {
+    *next = end;
+    return StringFragment(p, size_t(end - p));
+  }
+
+  *next = nl + 1;
+  return StringFragment(p, size_t(nl - p));
+}
+
+// The directive keyword on a line, or kEndOfLine for anything else.
+static TokenType directiveOf(StringFragment line, Token* arg = nullptr)
+{
+  StringFragment payload = skipWhitespace(line);
+  if (!payload || payload[0] != '@')
+    return TokenType::kEndOfLine;
+
+  Tokenizer tokenizer(payload.skip(1));
+  TokenType type = tokenizer.next().m_Type;
+  if (arg)
+    *arg = tokenizer.next();
+  return type;
+}
+
+bool Deluxe68::translateCachedProc()
+{
+  ProcSpan span;
+  if (!findProcSpan(m_ParsePoint, m_InputData + m_InputLen, &span) || !isCleanProcEntry())
+    return false;
+
+  // Leave redefinitions to the regular path so they're reported.
+  const SymbolId procId = intern(span.m_Name);
+  if (findProcedure(procId))
+    return false;
+
+  ProcCacheKey key = ProcCache::makeKey(span.m_Text, m_EmitLineDirectives, m_Compact);
+  const ProcCacheEntry* entry = m_ProcCache->find(key);
+
+  if (!entry || !replayProc(*entry, span))
+    recordProc(key, span);
+
+  flushStreamingOutput();
+  return true;
+}
+
+bool Deluxe68::findProcSpan(const char* begin, const char* end, ProcSpan* span)
+{
+  const char* next;
+
+  Token name;
+  TokenType type = directiveOf(lineAt(begin, end, &next), &name);
+  if ((type != TokenType::kProc && type != TokenType::kCProc) || name.m_Type != TokenType::kIdentifier)
+    return false;
+
+  uint32_t lineCount = 1;
+
+  while (next < end)
+  {
+    type = directiveOf(lineAt(next, end, &next));
+    ++lineCount;
+
+    if (type == TokenType::kEndProc)
+    {
+      // Offsets into the span are stored as 32 bits.
+      if (size_t(next - begin) > UINT32_MAX)
+        return false;
+
+      span->m_Text = StringFragment(begin, size_t(next - begin));
+      span->m_Name = name.m_String;
+      span->m_LineCount = lineCount;
+      return true;
+    }
+
+    // A nested procedure is an error; let the regular path report it.
+    if (type == TokenType::kProc || type == TokenType::kCProc)
+      return false;
+
+    // What a @call spills depends on procedures defined before this one, so
+    // the translation can't be done in isolation or reused elsewhere.
+    if (type == TokenType::kCall)
+      return false;
+  }
+
+  return false;
+}
+
+void Deluxe68::translateProceduresInParallel()
+{
+  std::unique_ptr<PrecomputedProcs> pre(new PrecomputedProcs());
+  const char* p = m_ParsePoint;
+  const char* end = m_InputData + m_InputLen;
+  int lineNumber = m_LineNumber;
+
+  while (p < end)
+  {
+    PrecomputedProcs::Proc proc;
+    if (findProcSpan(p, end, &proc.m_Span))
+    {
+      proc.m_StartLine = lineNumber;
+      p = proc.m_Span.m_Text.end();
+      lineNumber += int(proc.m_Span.m_LineCount);
+
+      // Anything the procedure cache has is replayed from there.
+      if (!m_ProcCache || !m_ProcCache->contains(ProcCache::makeKey(proc.m_Span.m_Text, m_EmitLineDirectives, m_Compact)))
+        pre->m_Procs.push_back(std::move(proc));
+    }
+    else
+    {
+      lineAt(p, end, &p);
+      ++lineNumber;
+    }
+  }
+
+  const size_t threadCount = std::min(size_t(m_ProcedureThreads), pre->m_Procs.size());
+  if (threadCount < 2)
+    return;
+
+  std::atomic<size_t> nextProc(0);
+
+  auto worker = [&]()
+  {
+    // Procedures leave the state as killAll() does, so one translator can
+    // take them in turn. It starts over if one leaves anything behind.
+    std::unique_ptr<Deluxe68> d(new Deluxe68(m_Filename, m_InputData, m_InputLen, m_EmitLineDirectives, m_ProcSections));
+    d->setCompactMode(m_Compact);
+
+    for (;;)
+    {
+      size_t index = nextProc.fetch_add(1);
+      if (index >= pre->m_Procs.size())
+        break;
+
+      if (!d->isCleanProcEntry())
+        d->reset(m_Filename, m_InputData, m_InputLen, m_EmitLineDirectives, m_ProcSections);
+
+      // Errors are reported when run() translates the procedure again; the
+      // worker never runs, so it never writes out its own.
+      // Lines are numbered as in the whole file, and the first one always
+      // gets a directive.
+      PrecomputedProcs::Proc& proc = pre->m_Procs[index];
+      d->m_ParsePoint = proc.m_Span.m_Text.ptr();
+      d->m_LineNumber = proc.m_StartLine;
+      d->m_CurrentOutputLine = proc.m_StartLine;
+      d->m_LineDelta = kNoLineDelta;
+      d->m_OutputSchedule.clear();
+      d->m_Stats = m_Stats ? &proc.m_Stats : nullptr;
+
+      if (!d->captureProc(proc.m_Span, &proc.m_Entry, nullptr != m_ProcCache))
+        continue;
+
+      if (m_Stats)
+        d->collectStats(0, d->m_OutputSchedule.size());
+
+      StringSink sink(&proc.m_Output);
+      size_t first = 0;
+
+      if (m_EmitLineDirectives)
+      {
+        if (d->m_OutputSchedule.empty() || d->m_OutputSchedule[0].kind() != OutputKind::kLineDirective)
+          continue;
+
+        d->writeElements(sink, 0, 1);
+        sink.flush();
+        proc.m_DirectiveSize = proc.m_Output.size();
+        first = 1;
+      }
+
+      d->writeElements(sink, first, d->m_OutputSchedule.size());
+      sink.flush();
+      proc.m_Ok = true;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < threadCount; ++i)
+  {
+    threads.emplace_back(worker);
+  }
+
+  // The calling thread works too.
+  worker();
+
+  for (std::thread& t : threads)
+  {
+    t.join();
+  }
+
+  m_Precomputed = std::move(pre);
+}
+
+bool Deluxe68::translatePrecomputedProc()
+{
+  PrecomputedProcs& pre = *m_Precomputed;
+
+  // Skip procedures that were translated in place.
+  while (pre.m_Next < pre.m_Procs.size() && pre.m_Procs[pre.m_Next].m_Span.m_Text.ptr() < m_ParsePoint)
+    ++pre.m_Next;
+
+  if (pre.m_Next == pre.m_Procs.size() || pre.m_Procs[pre.m_Next].m_Span.m_Text.ptr() != m_ParsePoint)
+    return false;
+
+  PrecomputedProcs::Proc& proc = pre.m_Procs[pre.m_Next++];
+  if (!proc.m_Ok || proc.m_StartLine != m_LineNumber || !isCleanProcEntry())
+    return false;
+
+  const SymbolId procId = intern(proc.m_Span.m_Name);
+  if (findProcedure(procId))
+    return false;
+
+  const ProcCacheEntry& entry = proc.m_Entry;
+  const int entryDelta = m_CurrentOutputLine - m_LineNumber;
+  const bool skipDirective = m_EmitLineDirectives && entryDelta == m_LineDelta;
+
+  beginProcOutput(m_LineNumber + 1);
+  output(OutputElement(OutputKind::kPrecomputed, int(pre.m_Next - 1), skipDirective ? 1 : 0));
+
+  m_CurrentOutputLine += entry.m_OutputLines;
+  m_LineNumber += entry.m_InputLines;
+  endProcOutput(procId);
+  m_ParsePoint = proc.m_Span.m_Text.end();
+  m_LineDelta = kNoLineDelta == entry.m_LineDeltaAfter ? kNoLineDelta : entryDelta + entry.m_LineDeltaAfter;
+  m_SpillStackDepth += entry.m_SpillDepthDelta;
+
+  defineProcedure(procId, entry.m_Proc);
+
+  m_PeakLiveCount = std::max(m_PeakLiveCount, int(entry.m_Stats.m_PeakLiveNames));
+
+  if (m_Stats)
+  {
+    const TranslationStats& counts = proc.m_Stats;
+    m_Stats->m_OutputElements += counts.m_OutputElements - (skipDirective ? 1 : 0);
+    m_Stats->m_NameReferences += counts.m_NameReferences;
+    m_Stats->m_Spills += counts.m_Spills;
+    m_Stats->m_Restores += counts.m_Restores;
+    for (size_t i = 0; i < size_t(TokenType::kCount); ++i)
+      m_Stats->m_Directives[i] += counts.m_Directives[i];
+  }
+
+  if (m_ProcCache)
+    m_ProcCache->insert(ProcCache::makeKey(proc.m_Span.m_Text, m_EmitLineDirectives, m_Compact), std::move(proc.m_Entry));
+
+  flushStreamingOutput();
+  return true;
+}
+
+bool Deluxe68::isCleanProcEntry() const
+{
+  // The state killAll() leaves behind. Anything else (e.g. a register
+  // reserved or allocated outside of a procedure) would make the
+  // translation depend on what came before.
+  if (kNoSymbol != m_CurrentProcId || 0 != m_LiveCount)
+    return false;
+
+  for (int i = 0; i < kRegisterCount; ++i)
+  {
+    const uint32_t expected = i == kA7 ? RegState::kFlagReserved : 0;
+    if (m_Registers[i].m_Flags != expected || !m_Registers[i].m_SpilledVars.empty())
+      return false;
+  }
+
+  return true;
+}
+
+bool Deluxe68::replayProc(const ProcCacheEntry& entry, const ProcSpan& span)
+{
+  // Entries come from a file on disk; anything that doesn't fit the span
+  // (or a hash collision) is translated afresh instead. Checked up front so
+  // nothing is output before giving up.
+  if (entry.m_InputLines != span.m_LineCount)
+    return false;
+
+  if (m_EmitLineDirectives && (entry.m_Elements.empty() || entry.m_Elements[0].m_Kind != OutputKind::kLineDirective))
+    return false;
+
+  for (const ProcCacheElement& elem : entry.m_Elements)
+  {
+    if (elem.m_Length > OutputElement::kMaxSize)
+      return false;
+    if (ProcCacheElement::Source::kSpan == elem.m_Source && uint64_t(elem.m_Offset) + elem.m_Length > span.m_Text.size())
+      return false;
+    if (ProcCacheElement::Source::kLiteral == elem.m_Source && uint64_t(elem.m_Offset) + elem.m_Length > entry.m_Literals.size())
+      return false;
+  }
+
+  const SymbolId procId = intern(span.m_Name);
+  const int startLine = m_LineNumber;
+  const int entryDelta = m_CurrentOutputLine - m_LineNumber;
+
+  beginProcOutput(startLine + 1);
+
+  size_t i = 0;
+
+  if (m_EmitLineDirectives)
+  {
+    // The directive for the first line is only there if the output had
+    // drifted from the input before the procedure.
+    if (entryDelta != m_LineDelta)
+      m_OutputSchedule.push_back(OutputElement(OutputKind::kLineDirective, startLine + entry.m_Elements[0].m_IntValue));
+
+    i = 1;
+  }
+
+  const uint32_t spanOffset = uint32_t(span.m_Text.ptr() - m_InputData);
+
+  for (; i < entry.m_Elements.size(); ++i)
+  {
+    const ProcCacheElement& src = entry.m_Elements[i];
+
+    switch (src.m_Source)
+    {
+      case ProcCacheElement::Source::kNone:
+      {
+        // Line numbers and symbol IDs are specific to this run.
+        int value = src.m_IntValue;
+        if (OutputKind::kLineDirective == src.m_Kind)
+          value += startLine;
+        else if (OutputKind::kProcHeader == src.m_Kind || OutputKind::kProcFooter == src.m_Kind)
+          value = int(procId);
+
+        m_OutputSchedule.push_back(OutputElement(src.m_Kind, value));
+        break;
+      }
+
+      case ProcCacheElement::Source::kSpan:
+        m_OutputSchedule.push_back(OutputElement(src.m_Kind, TextSource::kInput, spanOffset + src.m_Offset, src.m_Length));
+        break;
+
+      case ProcCacheElement::Source::kLiteral:
+        m_OutputSchedule.push_back(OutputElement(src.m_Kind, TextSource::kExtra, uint32_t(m_ExtraText.size()), src.m_Length));
+        m_ExtraText.append(entry.m_Literals, src.m_Offset, src.m_Length);
+        break;
+    }
+  }
+
+  m_CurrentOutputLine += entry.m_OutputLines;
+  m_LineNumber += entry.m_InputLines;
+  m_ParsePoint = span.m_Text.end();
+  m_LineDelta = kNoLineDelta == entry.m_LineDeltaAfter ? kNoLineDelta : entryDelta + entry.m_LineDeltaAfter;
+  m_SpillStackDepth += entry.m_SpillDepthDelta;
+
+  endProcOutput(procId);
+  defineProcedure(procId, entry.m_Proc);
+
+  // The replayed schedule is counted like any other.
+  addProcStats(entry.m_Stats);
+  return true;
+}
+
+void Deluxe68::addProcStats(const ProcStats& counts)
+{
+  m_PeakLiveCount = std::max(m_PeakLiveCount, int(counts.m_PeakLiveNames));
+
+  if (m_Stats)
+  {
+    for (size_t i = 0; i < size_t(TokenType::kCount); ++i)
+      m_Stats->m_Directives[i] += counts.m_Directives[i];
+  }
+}
+
+void Deluxe68::recordProc(const ProcCacheKey& key, const ProcSpan& span)
+{
+  ProcCacheEntry entry;
+  if (captureProc(span, &entry, true))
+    m_ProcCache->insert(key, std::move(entry));
+}
+
+bool Deluxe68::captureProc(const ProcSpan& span, ProcCacheEntry* out, bool withElements)
+{
+  const size_t mark = m_OutputSchedule.size();
+  const int startLine = m_LineNumber;
+  const int startOutputLine = m_CurrentOutputLine;
+  const int entryDelta = m_CurrentOutputLine - m_LineNumber;
+  const bool directiveOnEntry = m_EmitLineDirectives && entryDelta != m_LineDelta;
+  const int startErrors = m_ErrorCount;
+  const int startSpillDepth = m_SpillStackDepth;
+
+  // Counts that don't show in the schedule are kept with the entry, so they
+  // are gathered whether or not anyone asked for --stats.
+  TranslationStats* const outerStats = m_Stats;
+  TranslationStats procStats;
+  const int outerPeakLiveCount = m_PeakLiveCount;
+  m_Stats = &procStats;
+  m_PeakLiveCount = m_LiveCount;
+
+  m_HoldStreamingOutput = true;
+  while (m_ParsePoint < span.m_Text.end())
+  {
+    if (!translateVerbatimLines(span.m_Text.end()))
+      translateLine(nextLine());
+  }
+  m_HoldStreamingOutput = false;
+
+  ProcStats counts;
+  counts.m_PeakLiveNames = uint32_t(m_PeakLiveCount);
+  for (size_t i = 0; i < size_t(TokenType::kCount); ++i)
+    counts.m_Directives[i] = uint32_t(procStats.m_Directives[i]);
+
+  m_Stats = outerStats;
+  m_PeakLiveCount = outerPeakLiveCount;
+  addProcStats(counts);
+
+  const ProcedureDef* proc = findProcedure(m_Symbols.find(span.m_Name));
+  if (m_ErrorCount != startErrors || !proc)
+    return false;
+
+  ProcCacheEntry& entry = *out;
+  entry.m_Stats = counts;
+  entry.m_Proc = *proc;
+  entry.m_InputLines = span.m_LineCount;
+  entry.m_OutputLines = uint32_t(m_CurrentOutputLine - startOutputLine);
+  // Without line directives (or in compact output before the first one),
+  // there is no delta to be relative to.
+  entry.m_LineDeltaAfter = kNoLineDelta == m_LineDelta ? kNoLineDelta : m_LineDelta - entryDelta;
+  entry.m_SpillDepthDelta = m_SpillStackDepth - startSpillDepth;
+
+  if (!withElements)
+    return true;
+
+  entry.m_Elements.reserve(m_OutputSchedule.size() - mark + 1);
+
+  if (m_EmitLineDirectives && !directiveOnEntry)
+    entry.m_Elements.push_back(ProcCacheElement { OutputKind::kLineDirective, ProcCacheElement::Source::kNone, 1, 0, 0 });
+
+  const uint32_t spanBegin = uint32_t(span.m_Text.ptr() - m_InputData);
+  const uint32_t spanEnd = spanBegin + uint32_t(span.m_Text.size());
+  std::string note;
+
+  for (size_t i = mark; i < m_OutputSchedule.size(); ++i)
+  {
+    const OutputElement& elem = m_OutputSchedule[i];
+    ProcCacheElement dst { elem.kind(), ProcCacheElement::Source::kNone, 0, 0, 0 };
+    StringFragment literal;
+
+    switch (elem.kind())
+    {
+      case OutputKind::kStringLiteral:
+      case OutputKind::kEchoLine:
+        if (TextSource::kInput == elem.source() && elem.offset() >= spanBegin && elem.offset() + elem.size() <= spanEnd)
+        {
+          dst.m_Source = ProcCacheElement::Source::kSpan;
+          dst.m_Offset = elem.offset() - spanBegin;
+          dst.m_Length = elem.size();
+        }
+        else
+        {
+          literal = textOf(elem);
+        }
+        break;
+
+      case OutputKind::kLiveRegNote:
+      {
+        // Names are specific to this run, so store the finished text.
+        StringSink sink(&note);
+        note.clear();
+        writeLiveRegNote(sink, elem);
+        sink.flush();
+        dst.m_Kind = OutputKind::kStringLiteral;
+        literal = StringFragment(note.data(), note.size());
+        break;
+      }
+
+      case OutputKind::kLineDirective:
+        dst.m_IntValue = elem.intValue() - startLine;
+        break;
+
+      case OutputKind::kProcHeader:
+      case OutputKind::kProcFooter:
+        break;
+
+      default:
+        dst.m_IntValue = elem.intValue();
+        break;
+    }
+
+    if (literal.ptr())
+    {
+      dst.m_Source = ProcCacheElement::Source::kLiteral;
+      dst.m_Offset = uint32_t(entry.m_Literals.size());
+      dst.m_Length = uint32_t(literal.size());
+      entry.m_Literals.append(literal.ptr(), literal.size());
+    }
+
+    entry.m_Elements.push_back(dst);
+  }
+
+  return true;
+}
+
+void Deluxe68::flushStreamingOutput()
+{
+  if (!m_StreamSink || m_HoldStreamingOutput)
+    return;
+
+  if (m_Stats)
+    collectStats(0, m_OutputSchedule.size());
+
+  generateOutput(*m_StreamSink);
+
+  // Keep the capacity around for the next procedure.
+  m_OutputSchedule.clear();
+
+  // Nothing refers to earlier text anymore; names live in m_Symbols.
+  m_LineText.clear();
+  m_ExtraText.clear();
+}
+
+void Deluxe68::collectStats(size_t begin, size_t end)
+{
+  TranslationStats& stats = *m_Stats;
+  stats.m_OutputElements += end - begin;
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    const OutputElement& elem = m_OutputSchedule[i];
+    switch (elem.kind())
+    {
+      case OutputKind::kPrecomputed:
+        // Stands in for the procedure's own elements, counted by
+        // translatePrecomputedProc().
+        --stats.m_OutputElements;
+        break;
+      case OutputKind::kNamedRegister:
+      case OutputKind::kStackVar:
+        ++stats.m_NameReferences;
+        break;
+      case OutputKind::kSpill:
+        ++stats.m_Spills;
+        break;
+      case OutputKind::kRestore:
+        ++stats.m_Restores;
+        break;
+      case OutputKind::kEchoLine:
+        ++stats.m_Directives[size_t(directiveOf(textOf(elem)))];
+        break;
+      default:
+        break;
+    }
+  }
 }
 
-void Deluxe68::run()
+void Deluxe68::collectFinalStats()
 {
-  int lineDelta = -1;
-  while (dataLeft())
+  TranslationStats& stats = *m_Stats;
+
+  // Whatever wasn't streamed out along the way.
+  collectStats(0, m_OutputSchedule.size());
+
+  stats.m_Lines += uint64_t(m_LineNumber);
+  stats.m_PeakLiveNames = std::max(stats.m_PeakLiveNames, uint32_t(m_PeakLiveCount));
+  stats.m_Symbols = std::max(stats.m_Symbols, uint32_t(m_Symbols.size()));
+  stats.m_SymbolSlots = std::max(stats.m_SymbolSlots, uint32_t(m_Symbols.capacity()));
+
+  uint32_t largestCount = 0;
+  for (uint32_t mask = stats.m_LargestSaveMask; mask; mask &= mask - 1)
+    ++largestCount;
+
+  for (SymbolId id = 0; id < m_Procedures.size(); ++id)
   {
-    StringFragment line = nextLine();
+    if (!m_Procedures[id].m_Defined)
+      continue;
 
-    if (m_EmitLineDirectives)
-    {
-      int currentLineDelta = m_CurrentOutputLine - m_LineNumber;
+    ++stats.m_Procedures;
 
-      if (currentLineDelta != lineDelta)
-      {
-        output(OutputElement(OutputKind::kLineDirective, m_LineNumber + 1));
-        lineDelta = currentLineDelta;
-      }
+    const uint32_t saved = usedRegsForProcecure(id);
+    uint32_t count = 0;
+    for (uint32_t mask = saved; mask; mask &= mask - 1)
+      ++count;
+
+    if (count > largestCount)
+    {
+      largestCount = count;
+      stats.m_LargestSaveMask = saved;
+      const StringFragment name = m_Symbols.name(id);
+      stats.m_LargestSaveProc.assign(name.ptr(), name.size());
     }
+  }
+}
 
-    //printf("processing line: '%.*s'\n", line.length(), line.ptr());
-    ++m_LineNumber;
-    parseLine(line);
+// Directives that generate code (or a label) of their own.
+static bool producesOutput(TokenType type)
+{
+  switch (type)
+  {
+    case TokenType::kProc:
+    case TokenType::kCProc:
+    case TokenType::kEndProc:
+    case TokenType::kSpill:
+    case TokenType::kRestore:
+    case TokenType::kCall:
+      return true;
+    default:
+      return false;
   }
 }
 
@@ -78,17 +1097,30 @@ void Deluxe68::parseLine(StringFragment line)
 
   if (!payload || payload[0] != '@')
   {
+    syncLineDirective();
+    ++m_LineNumber;
     handleRegularLine(line);
     return;
   }
 
-  output(OutputElement(StringFragment("\t\t; ", 4)));
-  output(OutputElement(line));
-  newline();
-
   Tokenizer tokenizer(payload.skip(1));
   Token t = tokenizer.next();
 
+  if (TokenType::kProc == t.m_Type || TokenType::kCProc == t.m_Type)
+    beginProcOutput(m_LineNumber + 1);
+
+  // Without the echoed line, most directives produce no output at all, and
+  // so don't need a line directive either.
+  if (CompactMode::kNone == m_Compact || producesOutput(t.m_Type))
+    syncLineDirective();
+  ++m_LineNumber;
+
+  // Stats count directives off the echoed lines when there are any.
+  if (CompactMode::kNone == m_Compact)
+    outputText(OutputKind::kEchoLine, line);
+  else if (m_Stats)
+    ++m_Stats->m_Directives[size_t(t.m_Type)];
+
   switch (t.m_Type)
   {
     case TokenType::kAreg:
@@ -132,8 +1164,12 @@ void Deluxe68::parseLine(StringFragment line)
       rename(tokenizer);
       break;
 
+    case TokenType::kCall:
+      call(tokenizer);
+      break;
+
     default:
-      error("unsupported syntax: %s: %.*s\n", tokenTypeName(t.m_Type), line.length(), line.ptr());
+      error(DiagnosticCode::kUnsupportedSyntax, "unsupported syntax: %s: %.*s\n", tokenTypeName(t.m_Type), line.length(), line.ptr());
       return;
   }
 }
@@ -146,11 +1182,12 @@ void Deluxe68::allocRegs(Tokenizer& tokenizer, TokenType regType)
     if (!expect(tokenizer, TokenType::kIdentifier, &identToken))
       return;
 
-    StringFragment id = identToken.m_String;
+    StringFragment name = identToken.m_String;
+    SymbolId id = intern(name);
 
-    if (m_LiveRegs.find(id) != m_LiveRegs.end())
+    if (liveReg(id))
     {
-      error("register name already in use: '%.*s'\n", id.length(), id.ptr());
+      error(DiagnosticCode::kNameInUse, "register name already in use: '%.*s'\n", name.length(), name.ptr());
       continue;
     }
 
@@ -174,23 +1211,23 @@ void Deluxe68::allocRegs(Tokenizer& tokenizer, TokenType regType)
 
     if (-1 == index)
     {
-      error("out of %s registers (allocating %.*s)\n", registerClassName(regClass), id.length(), id.ptr());
+      error(DiagnosticCode::kOutOfRegisters, "out of %s registers (allocating %.*s)\n", registerClassName(regClass), name.length(), name.ptr());
       for (int i = 0; i < kRegisterCount; ++i)
       {
         if (m_Registers[i].isAllocated())
         {
-          StringFragment owner = m_Registers[i].m_AllocatingVarName;
+          SymbolId ownerId = m_Registers[i].m_AllocatingVar;
+          StringFragment owner = m_Symbols.name(ownerId);
           int lineNo = 0;
-          const auto it = m_LiveRegs.find(owner);
-          if (it != m_LiveRegs.end())
+          if (const RegAlloc* ownerAlloc = liveReg(ownerId))
           {
-            lineNo = it->second.m_AllocatedLine;
+            lineNo = ownerAlloc->m_AllocatedLine;
           }
-          errorForLine(lineNo, "%s allocated: %.*s\n", regName(i), owner.length(), owner.ptr());
+          errorForLine(lineNo, DiagnosticCode::kRegisterOwner, "%s allocated: %.*s\n", regName(i), owner.length(), owner.ptr());
         }
         else if (m_Registers[i].isReserved())
         {
-          error("%s: (reserved)\n", regName(i));
+          error(DiagnosticCode::kRegisterOwner, "%s: (reserved)\n", regName(i));
         }
       }
       continue;
@@ -205,12 +1242,13 @@ void Deluxe68::allocRegs(Tokenizer& tokenizer, TokenType regType)
   expect(tokenizer, TokenType::kEndOfLine);
 }
 
-bool Deluxe68::doAllocate(StringFragment id, int regIndex)
+bool Deluxe68::doAllocate(SymbolId id, int regIndex)
 {
   if (m_Registers[regIndex].isInUse())
   {
-    StringFragment owner = m_Registers[regIndex].m_AllocatingVarName;
-    error("register %.*s not free here (used by %.*s)\n", 2, regName(regIndex), owner.length(), owner.ptr());
+    SymbolId ownerId = m_Registers[regIndex].m_AllocatingVar;
+    StringFragment owner = kNoSymbol != ownerId ? m_Symbols.name(ownerId) : StringFragment();
+    error(DiagnosticCode::kRegisterNotFree, "register %.*s not free here (used by %.*s)\n", 2, regName(regIndex), owner.length(), owner.ptr());
     return false;
   }
   else
@@ -218,18 +1256,15 @@ bool Deluxe68::doAllocate(StringFragment id, int regIndex)
     RegAlloc a;
     a.m_RegIndex = static_cast<uint8_t>(regIndex);
     a.m_AllocatedLine = m_LineNumber;
-    m_LiveRegs.insert(std::make_pair(id, a));
+    setLive(id, a);
 
     m_Registers[regIndex].setAllocated(true);
     m_CurrentProc.m_UsedRegs |= 1 << regIndex;
 
-    output(OutputElement(StringFragment("\t\t; live reg ")));
-    output(OutputElement(regName(regIndex)));
-    output(OutputElement(StringFragment(" => ")));
-    output(OutputElement(id));
-    newline();
+    if (CompactMode::kNone == m_Compact)
+      output(OutputElement(OutputKind::kLiveRegNote, int(id), uint32_t(regIndex)));
 
-    m_Registers[regIndex].m_AllocatingVarName = id;
+    m_Registers[regIndex].m_AllocatingVar = id;
 
     return true;
   }
@@ -243,19 +1278,18 @@ void Deluxe68::killRegs(Tokenizer& tokenizer)
     if (!expect(tokenizer, TokenType::kIdentifier, &identToken))
       return;
 
-    StringFragment id = identToken.m_String;
-
-    auto it = m_LiveRegs.find(id);
+    StringFragment name = identToken.m_String;
+    SymbolId id = m_Symbols.find(name);
+    const RegAlloc* a = liveReg(id);
 
-    if (it == m_LiveRegs.end())
+    if (!a)
     {
-      error("register name not in use: '%.*s'\n", id.length(), id.ptr());
+      error(DiagnosticCode::kNameNotInUse, "register name not in use: '%.*s'\n", name.length(), name.ptr());
       continue;
     }
 
-    const RegAlloc& a = it->second;
-    m_Registers[a.m_RegIndex].setAllocated(false);
-    m_LiveRegs.erase(it);
+    m_Registers[a->m_RegIndex].setAllocated(false);
+    setDead(id);
 
   } while (accept(tokenizer, TokenType::kComma));
 
@@ -264,23 +1298,27 @@ void Deluxe68::killRegs(Tokenizer& tokenizer)
 
 void Deluxe68::proc(Tokenizer& tokenizer, bool saveInputs)
 {
-  if (m_CurrentProcName)
+  if (kNoSymbol != m_CurrentProcId)
   {
-    error("already inside a procedure definition ('%.*s')\n", m_CurrentProcName.length(), m_CurrentProcName.ptr());
+    StringFragment current = m_Symbols.name(m_CurrentProcId);
+    error(DiagnosticCode::kNestedProc, "already inside a procedure definition ('%.*s')\n", current.length(), current.ptr());
     Tokenizer subt("");
     endProc(subt);
   }
 
   Token ident;
+  SymbolId procId = kNoSymbol;
   if (expect(tokenizer, TokenType::kIdentifier, &ident))
   {
-    if (m_Procedures.find(ident.m_String) != m_Procedures.end())
+    procId = intern(ident.m_String);
+
+    if (findProcedure(procId))
     {
-      error("procedure '%.*s' already defined\n", ident.m_String.length(), ident.m_String.ptr());
+      error(DiagnosticCode::kProcRedefined, "procedure '%.*s' already defined\n", ident.m_String.length(), ident.m_String.ptr());
       return;
     }
 
-    m_CurrentProcName = ident.m_String;
+    m_CurrentProcId = procId;
     m_CurrentProc = ProcedureDef();
   }
 
@@ -305,7 +1343,7 @@ void Deluxe68::proc(Tokenizer& tokenizer, bool saveInputs)
 
       inputRegMask |= 1 << reg.m_Register;
 
-      doAllocate(identToken.m_String, reg.m_Register);
+      doAllocate(intern(identToken.m_String), reg.m_Register);
 
     } while (accept(tokenizer, TokenType::kComma));
 
@@ -330,13 +1368,14 @@ void Deluxe68::proc(Tokenizer& tokenizer, bool saveInputs)
     }
     else
     {
-      error("keyword '%.*s' not allowed here\n", kw.m_String.length(), kw.m_String.ptr());
+      error(DiagnosticCode::kUnknownKeyword, "keyword '%.*s' not allowed here\n", kw.m_String.length(), kw.m_String.ptr());
     }
   }
 
   expect(tokenizer, TokenType::kEndOfLine);
 
-  output(OutputElement(OutputKind::kProcHeader, ident.m_String));
+  output(OutputElement(OutputKind::kProcHeader, int(procId)));
+  forgetLineDelta();
 
   m_CurrentProc.m_InputRegs = inputRegMask;
   m_CurrentProc.m_SaveInputRegs = saveInputs;
@@ -347,13 +1386,18 @@ void Deluxe68::endProc(Tokenizer& tokenizer)
 {
   killAll();
 
-  if (m_CurrentProcName)
+  if (kNoSymbol != m_CurrentProcId)
   {
-    output(OutputElement(OutputKind::kProcFooter, m_CurrentProcName));
-    m_Procedures.insert(std::make_pair(m_CurrentProcName, m_CurrentProc));
+    output(OutputElement(OutputKind::kProcFooter, int(m_CurrentProcId)));
+    forgetLineDelta();
+    endProcOutput(m_CurrentProcId);
+    defineProcedure(m_CurrentProcId, m_CurrentProc);
   }
-  m_CurrentProcName = StringFragment();
+  m_CurrentProcId = kNoSymbol;
   m_CurrentProc = ProcedureDef();
+
+  // Nothing scheduled so far can change anymore.
+  flushStreamingOutput();
 }
 
 void Deluxe68::reserve(Tokenizer& tokenizer)
@@ -368,7 +1412,7 @@ void Deluxe68::reserve(Tokenizer& tokenizer)
 
     if (m_Registers[regIndex].isInUse())
     {
-      error("register %s not free here\n", regName(regIndex));
+      error(DiagnosticCode::kRegisterNotFree, "register %s not free here\n", regName(regIndex));
       continue;
     }
 
@@ -390,7 +1434,7 @@ void Deluxe68::unreserve(Tokenizer& tokenizer)
 
     if (!m_Registers[regIndex].isReserved())
     {
-      error("register %s not reserved here\n", regName(regIndex));
+      error(DiagnosticCode::kRegisterNotReserved, "register %s not reserved here\n", regName(regIndex));
       continue;
     }
 
@@ -426,10 +1470,12 @@ void Deluxe68::spill(Tokenizer& tokenizer)
   do
   {
     Token idToken;
-    StringFragment id;
+    StringFragment name;
+    SymbolId id;
     if (accept(tokenizer, TokenType::kIdentifier, &idToken))
     {
-      id = idToken.m_String;
+      name = idToken.m_String;
+      id = m_Symbols.find(name);
     }
     else if (expect(tokenizer, TokenType::kRegister, &idToken))
     {
@@ -443,25 +1489,26 @@ void Deluxe68::spill(Tokenizer& tokenizer)
         continue;
       }
 
-      id = m_Registers[regIndex].m_AllocatingVarName;
+      id = m_Registers[regIndex].m_AllocatingVar;
+      name = kNoSymbol != id ? m_Symbols.name(id) : StringFragment();
     }
     else
     {
       return;
     }
 
-    auto it = m_LiveRegs.find(id);
-    if (it == m_LiveRegs.end())
+    RegAlloc* live = liveReg(id);
+    if (!live)
     {
-      error("unknown register %.*s\n", id.length(), id.ptr());
+      error(DiagnosticCode::kUnknownRegister, "unknown register %.*s\n", name.length(), name.ptr());
       continue;
     }
 
-    RegAlloc& alloc = it->second;
+    RegAlloc& alloc = *live;
 
     if (alloc.m_Spilled)
     {
-      error("register %.*s is already spilled\n", id.length(), id.ptr());
+      error(DiagnosticCode::kAlreadySpilled, "register %.*s is already spilled\n", name.length(), name.ptr());
       continue;
     }
 
@@ -503,11 +1550,13 @@ void Deluxe68::restore(Tokenizer& tokenizer)
   do
   {
     Token idToken;
-    StringFragment id;
+    StringFragment name;
+    SymbolId id;
 
     if (accept(tokenizer, TokenType::kIdentifier, &idToken))
     {
-      id = idToken.m_String;
+      name = idToken.m_String;
+      id = m_Symbols.find(name);
     }
     else if (expect(tokenizer, TokenType::kRegister, &idToken))
     {
@@ -521,6 +1570,7 @@ void Deluxe68::restore(Tokenizer& tokenizer)
         continue;
       }
       id = m_Registers[registerIndex].m_SpilledVars.back();
+      name = kNoSymbol != id ? m_Symbols.name(id) : StringFragment();
       m_Registers[registerIndex].m_SpilledVars.pop_back();
     }
     else
@@ -528,18 +1578,18 @@ void Deluxe68::restore(Tokenizer& tokenizer)
       return;
     }
 
-    auto it = m_LiveRegs.find(id);
-    if (it == m_LiveRegs.end())
+    RegAlloc* live = liveReg(id);
+    if (!live)
     {
-      error("unknown register %.*s\n", id.length(), id.ptr());
+      error(DiagnosticCode::kUnknownRegister, "unknown register %.*s\n", name.length(), name.ptr());
       continue;
     }
 
-    RegAlloc& alloc = it->second;
+    RegAlloc& alloc = *live;
 
     if (!alloc.m_Spilled)
     {
-      error("register %.*s is not spilled\n", id.length(), id.ptr());
+      error(DiagnosticCode::kNotSpilled, "register %.*s is not spilled\n", name.length(), name.ptr());
       continue;
     }
 
@@ -549,12 +1599,12 @@ void Deluxe68::restore(Tokenizer& tokenizer)
     {
       if (m_Registers[regIndex].isAllocated())
       {
-        StringFragment owner = m_Registers[regIndex].m_AllocatingVarName;
-        error("register %.*s home slot %s is occupied by %.*s\n", id.length(), id.ptr(), regName(regIndex), owner.length(), owner.ptr());
+        StringFragment owner = m_Symbols.name(m_Registers[regIndex].m_AllocatingVar);
+        error(DiagnosticCode::kHomeSlotTaken, "register %.*s home slot %s is occupied by %.*s\n", name.length(), name.ptr(), regName(regIndex), owner.length(), owner.ptr());
       }
       else
       {
-        error("register %.*s home slot %s is reserved\n", id.length(), id.ptr(), regName(regIndex));
+        error(DiagnosticCode::kHomeSlotTaken, "register %.*s home slot %s is reserved\n", name.length(), name.ptr(), regName(regIndex));
       }
       continue;
     }
@@ -563,7 +1613,7 @@ void Deluxe68::restore(Tokenizer& tokenizer)
 
     m_Registers[regIndex].setAllocated(true);
     restoredRegs |= 1 << regIndex;
-    m_Registers[regIndex].m_AllocatingVarName = id;
+    m_Registers[regIndex].m_AllocatingVar = id;
 
   } while (accept(tokenizer, TokenType::kComma));
 
@@ -583,36 +1633,125 @@ void Deluxe68::rename(Tokenizer& tokenizer)
   if (!expect(tokenizer, TokenType::kIdentifier, &tokenNew))
     return;
 
-  StringFragment idOld = tokenOld.m_String;
-  StringFragment idNew = tokenNew.m_String;
+  StringFragment nameOld = tokenOld.m_String;
+  StringFragment nameNew = tokenNew.m_String;
 
   if (!expect(tokenizer, TokenType::kEndOfLine))
     return;
 
-  if (m_LiveRegs.find(idNew) != m_LiveRegs.end())
+  SymbolId idNew = intern(nameNew);
+  SymbolId idOld = m_Symbols.find(nameOld);
+
+  if (liveReg(idNew))
   {
-    error("id %.*s already allocated\n", idNew.length(), idNew.ptr());
+    error(DiagnosticCode::kRenameTargetInUse, "id %.*s already allocated\n", nameNew.length(), nameNew.ptr());
     return;
   }
 
-  auto it = m_LiveRegs.find(idOld);
-  if (it == m_LiveRegs.end())
+  const RegAlloc* live = liveReg(idOld);
+  if (!live)
   {
-    error("id %.*s not allocated\n", idOld.length(), idOld.ptr());
+    error(DiagnosticCode::kRenameSourceNotLive, "id %.*s not allocated\n", nameOld.length(), nameOld.ptr());
     return;
   }
 
-  RegAlloc alloc = it->second;
+  RegAlloc alloc = *live;
 
-  m_LiveRegs.erase(it);
-  m_LiveRegs.insert(std::make_pair(idNew, alloc));
+  setDead(idOld);
+  setLive(idNew, alloc);
 
   m_Registers[alloc.m_RegIndex].handleRename(idOld, idNew);
 }
 
+void Deluxe68::call(Tokenizer& tokenizer)
+{
+  Token ident;
+  if (!expect(tokenizer, TokenType::kIdentifier, &ident))
+    return;
+
+  if (!expect(tokenizer, TokenType::kEndOfLine))
+    return;
+
+  const StringFragment name = ident.m_String;
+
+  // Procedures defined further up come first, then imported ones. Anything
+  // else might touch any register.
+  uint32_t clobbers = ~(1u << kA7) & ((1u << kRegisterCount) - 1);
+  bool known = true;
+
+  if (const ProcedureDef* def = findProcedure(m_Symbols.find(name)))
+    clobbers = clobberedRegs(*def);
+  else if (const ProcSignature* signature = m_Signatures ? m_Signatures->find(name) : nullptr)
+    clobbers = signature->m_Clobbers & ~(1u << kA7);
+  else
+    known = false;
+
+  // Whatever the callee doesn't preserve, the caller's own save has to. An
+  // unknown callee is on its own, as with a plain bsr.
+  if (known && kNoSymbol != m_CurrentProcId)
+    m_CurrentProc.m_UsedRegs |= clobbers;
+
+  uint32_t spilled = 0;
+  for (int i = 0; i < kRegisterCount; ++i)
+  {
+    if (m_Registers[i].isAllocated() && (clobbers & (1u << i)))
+      spilled |= 1u << i;
+  }
+
+  if (spilled)
+    output(OutputElement(OutputKind::kSpill, int(spilled)));
+
+  output(PoolString::kBsr);
+  outputText(OutputKind::kStringLiteral, name);
+  output(PoolString::kNewline);
+
+  if (spilled)
+    output(OutputElement(OutputKind::kRestore, int(spilled)));
+}
+
+void Deluxe68::attachArena()
+{
+  m_LiveRegs.attach(&m_Arena);
+  m_Procedures.attach(&m_Arena);
+  m_LiveIds.attach(&m_Arena);
+
+  for (int i = 0; i < kRegisterCount; ++i)
+  {
+    m_Registers[i].m_SpilledVars.attach(&m_Arena);
+  }
+}
+
+void Deluxe68::clearArena()
+{
+  // The arrays take back as much room as they had, so a translator reused
+  // for similar input doesn't grow them again a step at a time.
+  const size_t nameCapacity = m_LiveRegs.capacity();
+  const size_t liveCapacity = m_LiveIds.capacity();
+
+  m_LiveRegs.release();
+  m_Procedures.release();
+  m_LiveIds.release();
+
+  for (int i = 0; i < kRegisterCount; ++i)
+  {
+    m_Registers[i].m_SpilledVars.release();
+  }
+
+  m_Arena.clear();
+
+  m_LiveRegs.reserve(nameCapacity);
+  m_Procedures.reserve(nameCapacity);
+  m_LiveIds.reserve(liveCapacity);
+}
+
 void Deluxe68::killAll()
 {
-  m_LiveRegs.clear();
+  for (SymbolId id : m_LiveIds)
+  {
+    m_LiveRegs[id].m_Live = 0;
+  }
+  m_LiveIds.clear();
+  m_LiveCount = 0;
 
   for (int i = 0; i < kRegisterCount; ++i)
   {
@@ -640,7 +1779,7 @@ bool Deluxe68::expect(Tokenizer& tokenizer, TokenType type, Token* out)
   }
   else
   {
-    error("expected %s, got %s\n", tokenTypeName(type), tokenTypeName(t.m_Type));
+    error(DiagnosticCode::kUnexpectedToken, "expected %s, got %s\n", tokenTypeName(type), tokenTypeName(t.m_Type));
     return false;
   }
 }
@@ -664,31 +1803,37 @@ bool Deluxe68::accept(Tokenizer& tokenizer, TokenType type, Token* out)
 
 StringFragment Deluxe68::nextLine()
 {
-  const char* start = m_ParsePoint;
-  uint32_t remain = m_InputData + m_InputLen - start;
-
-  if (remain == 0)
-    return StringFragment();
-
-  for (uint32_t i = 0; i < remain; ++i)
+  if (m_Reader)
   {
-    if ('\n' == start[i])
+    StringFragment line = m_Reader->nextLine();
+    if (m_LineText.size() + line.size() > UINT32_MAX)
     {
-      StringFragment f(start, i);
-      m_ParsePoint = start + i + 1;
-      return f;
+      error(DiagnosticCode::kInputTooLarge, "input is too large (the limit is 4 GB between procedures)\n");
+      return StringFragment();
     }
+
+    const size_t offset = m_LineText.size();
+    m_LineText.append(line.ptr(), line.size());
+    return StringFragment(m_LineText.data() + offset, line.size());
   }
 
-  StringFragment f(start, remain);
-  m_ParsePoint = m_InputData + m_InputLen;
-  return f;
+  const char* start = m_ParsePoint;
+  const char* end = m_InputData + m_InputLen;
+
+  if (start == end)
+    return StringFragment();
+
+  const char* nl = findNewline(start, end);
+  m_ParsePoint = nl == end ? end : nl + 1;
+  return StringFragment(start, size_t(nl - start));
 }
 
 bool Deluxe68::dataLeft() const
 {
-  const char* start = m_ParsePoint;
-  return m_InputData + m_InputLen > start;
+  if (m_Reader)
+    return !m_Reader->atEnd();
+
+  return m_ParsePoint < m_InputData + m_InputLen;
 }
 
 int Deluxe68::findFirstFree(RegisterClass regClass) const
@@ -720,66 +1865,247 @@ int Deluxe68::findFirstFree(RegisterClass regClass) const
 
 void Deluxe68::generateOutput(FILE* f) const
 {
-  generateOutput([](const char* n, size_t len, void* user_data)
-  {
-    fwrite(n, 1, len, (FILE*)user_data);
-  }, f);
+  FileSink sink(f);
+  generateOutput(sink);
 }
 
 void Deluxe68::generateOutput(PrintCallback* cb, void* user_data) const
 {
-  m_PrintCallback = cb;
-  m_PrintData = user_data;
+  CallbackSink sink(cb, user_data);
+  generateOutput(sink);
+}
+
+void Deluxe68::generateOutput(OutputSink& sink) const
+{
+  writeElements(sink, 0, m_OutputSchedule.size());
+  sink.flush();
+}
+
+void Deluxe68::beginProcOutput(int firstLine)
+{
+  m_OpenProcOutput.m_Begin = uint32_t(m_OutputSchedule.size());
+  m_OpenProcOutput.m_FirstLine = firstLine;
+}
+
+void Deluxe68::endProcOutput(SymbolId procId)
+{
+  if (!m_SplitOutput)
+    return;
+
+  ProcOutput out = m_OpenProcOutput;
+  out.m_Proc = procId;
+  out.m_End = uint32_t(m_OutputSchedule.size());
+  out.m_NextLine = m_LineNumber + 1;
+  m_ProcOutputs.push_back(out);
+}
+
+StringFragment Deluxe68::procedureOutputName(size_t index) const
+{
+  return m_Symbols.name(m_ProcOutputs[index].m_Proc);
+}
+
+void Deluxe68::generateProcedureOutput(OutputSink& sink, size_t index) const
+{
+  const ProcOutput& out = m_ProcOutputs[index];
+  writePart(sink, out.m_Begin, out.m_End, out.m_FirstLine);
+  sink.flush();
+}
+
+void Deluxe68::generatePrologueOutput(OutputSink& sink) const
+{
+  size_t begin = 0;
+  int firstLine = 1;
+
+  for (const ProcOutput& out : m_ProcOutputs)
+  {
+    writePart(sink, begin, out.m_Begin, firstLine);
+    begin = out.m_End;
+    firstLine = out.m_NextLine;
+  }
+
+  writePart(sink, begin, m_OutputSchedule.size(), firstLine);
+  sink.flush();
+}
+
+void Deluxe68::writePart(OutputSink& sink, size_t begin, size_t end, int firstLine) const
+{
+  if (begin == end)
+    return;
+
+  // A part is assembled on its own, so it can't count on a directive
+  // further up.
+  if (m_EmitLineDirectives)
+  {
+    const OutputElement& first = m_OutputSchedule[begin];
+    if (OutputKind::kPrecomputed == first.kind())
+    {
+      const PrecomputedProcs::Proc& proc = m_Precomputed->m_Procs[first.m_Value];
+      sink.writeRef(proc.m_Output.data(), proc.m_Output.size());
+      ++begin;
+    }
+    else if (OutputKind::kLineDirective != first.kind())
+    {
+      writeLineDirective(sink, firstLine);
+    }
+  }
+
+  writeElements(sink, begin, end);
+}
+
+void Deluxe68::writeLineDirective(OutputSink& sink, int line) const
+{
+  sink.write("\t\ttbl_line ");
+  sink.writeInt(line);
+  sink.put(' ');
+  sink.write(m_Filename);
+  sink.put('\n');
+}
 
-  for (const OutputElement& elem : m_OutputSchedule)
+void Deluxe68::writeElements(OutputSink& sink, size_t begin, size_t end) const
+{
+  for (size_t i = begin; i < end; ++i)
   {
-    switch (elem.m_Kind)
+    const OutputElement& elem = m_OutputSchedule[i];
+    switch (elem.kind())
     {
       case OutputKind::kStringLiteral:
+        sink.writeRef(textOf(elem));
+        break;
       case OutputKind::kNamedRegister:
-        outf("%.*s", elem.m_String.length(), elem.m_String.ptr());
+        sink.write(regName(elem.intValue()), 2);
         break;
       case OutputKind::kSpill:
-        printSpill(elem.m_IntValue);
+        printSpill(sink, elem.m_Value);
         break;
       case OutputKind::kRestore:
-        printRestore(elem.m_IntValue);
+        printRestore(sink, elem.m_Value);
         break;
       case OutputKind::kProcHeader:
+      {
+        const SymbolId procId = SymbolId(elem.m_Value);
+        const StringFragment name = kNoSymbol != procId ? m_Symbols.name(procId) : StringFragment();
         if (m_ProcSections)
-          outf("\t\tsection\tproc_%.*s,code\n", elem.m_String.length(), elem.m_String.ptr());
-        outf("%.*s:\n", elem.m_String.length(), elem.m_String.ptr());
-        printSpill(usedRegsForProcecure(elem.m_String));
+        {
+          sink.write("\t\tsection\tproc_");
+          sink.write(name);
+          sink.write(",code\n");
+        }
+        sink.write(name);
+        sink.write(":\n");
+        printSpill(sink, usedRegsForProcecure(procId));
         break;
+      }
       case OutputKind::kProcFooter:
-        printRestore(usedRegsForProcecure(elem.m_String));
-        outf("\t\trts\n");
+        printRestore(sink, usedRegsForProcecure(SymbolId(elem.m_Value)));
+        sink.write("\t\trts\n");
         break;
       case OutputKind::kStackVar:
         // FIXME: This is broken for word references, needs an additional +2, but we don't know that.
         // Similarily bytes need a +3.
-        outf("%d(sp)", elem.m_IntValue);
+        sink.writeInt(elem.intValue());
+        sink.write("(sp)");
         break;
       case OutputKind::kLineDirective:
-        outf("\t\ttbl_line %d %s\n", elem.m_IntValue, m_Filename);
+        writeLineDirective(sink, elem.intValue());
+        break;
+      case OutputKind::kEchoLine:
+        sink.write("\t\t; ", 4);
+        sink.writeRef(textOf(elem));
+        sink.put('\n');
+        break;
+      case OutputKind::kLiveRegNote:
+        writeLiveRegNote(sink, elem);
+        break;
+      case OutputKind::kPrecomputed:
+      {
+        const PrecomputedProcs::Proc& proc = m_Precomputed->m_Procs[elem.m_Value];
+        const size_t skip = elem.extra() ? proc.m_DirectiveSize : 0;
+        sink.writeRef(proc.m_Output.data() + skip, proc.m_Output.size() - skip);
+        break;
+      }
+      case OutputKind::kCount:
         break;
     }
   }
+}
+
+void Deluxe68::writeLiveRegNote(OutputSink& sink, const OutputElement& elem) const
+{
+  sink.write("\t\t; live reg ");
+  sink.write(regName(int(elem.extra())), 2);
+  sink.write(" => ");
+  sink.write(m_Symbols.name(SymbolId(elem.m_Value)));
+  sink.put('\n');
+}
+
+SymbolId Deluxe68::intern(StringFragment name)
+{
+  SymbolId id = m_Symbols.intern(name);
+
+  if (id >= m_LiveRegs.size())
+  {
+    m_LiveRegs.resize(m_Symbols.size());
+    m_Procedures.resize(m_Symbols.size());
+  }
+
+  return id;
+}
+
+Deluxe68::RegAlloc* Deluxe68::liveReg(SymbolId id)
+{
+  if (kNoSymbol == id || id >= m_LiveRegs.size() || !m_LiveRegs[id].m_Live)
+    return nullptr;
+
+  return &m_LiveRegs[id];
+}
+
+Deluxe68::RegAlloc* Deluxe68::liveReg(StringFragment name)
+{
+  return liveReg(m_Symbols.find(name));
+}
+
+void Deluxe68::setLive(SymbolId id, const RegAlloc& alloc)
+{
+  m_LiveRegs[id] = alloc;
+  m_LiveRegs[id].m_Live = 1;
+  m_LiveIds.push_back(id);
+  if (++m_LiveCount > m_PeakLiveCount)
+    m_PeakLiveCount = m_LiveCount;
+}
+
+void Deluxe68::setDead(SymbolId id)
+{
+  m_LiveRegs[id].m_Live = 0;
+  --m_LiveCount;
+}
+
+const ProcedureDef* Deluxe68::findProcedure(SymbolId id) const
+{
+  if (kNoSymbol == id || id >= m_Procedures.size() || !m_Procedures[id].m_Defined)
+    return nullptr;
 
-  m_PrintCallback = nullptr;
-  m_PrintData = nullptr;
+  return &m_Procedures[id].m_Def;
 }
 
-uint32_t Deluxe68::usedRegsForProcecure(const StringFragment& procName) const
+void Deluxe68::defineProcedure(SymbolId id, const ProcedureDef& def)
 {
-  auto iter = m_Procedures.find(procName);
-  if (iter == m_Procedures.end())
+  m_Procedures[id].m_Defined = true;
+  m_Procedures[id].m_Def = def;
+}
+
+uint32_t Deluxe68::usedRegsForProcecure(SymbolId procId) const
+{
+  const ProcedureDef* def = findProcedure(procId);
+  if (!def)
   {
     return 0;
   }
 
-  const ProcedureDef& procDef = iter->second;
+  return savedRegs(*def);
+}
 
+uint32_t Deluxe68::savedRegs(const ProcedureDef& procDef)
+{
   uint32_t savedMask;
 
   if (procDef.m_SaveInputRegs)
@@ -791,154 +2117,228 @@ uint32_t Deluxe68::usedRegsForProcecure(const StringFragment& procName) const
   return savedMask & ~procDef.m_TrashedRegs;
 }
 
-void Deluxe68::printSpill(uint32_t regMask) const
+uint32_t Deluxe68::clobberedRegs(const ProcedureDef& procDef)
 {
-  if (regMask)
+  // Everything the procedure touches and doesn't put back. Code that uses
+  // registers directly without declaring them isn't seen here, just as it
+  // isn't saved by the procedure's movem.
+  const uint32_t touched = procDef.m_UsedRegs | procDef.m_InputRegs | procDef.m_TrashedRegs;
+  return touched & ~savedRegs(procDef) & ~(1u << kA7);
+}
+
+void Deluxe68::generateSignatures(OutputSink& sink) const
+{
+  std::string text = kSignatureFileHeader;
+
+  for (SymbolId id = 0; id < m_Procedures.size(); ++id)
   {
-    outf("\t\tmovem.l ");
-    printMovemList(regMask);
-    outf(",-(sp)\n");
+    if (!m_Procedures[id].m_Defined)
+      continue;
+
+    const ProcedureDef& def = m_Procedures[id].m_Def;
+    ProcSignature signature;
+    signature.m_InputRegs = def.m_InputRegs;
+    signature.m_Clobbers = clobberedRegs(def);
+    formatSignature(&text, m_Symbols.name(id), signature);
   }
+
+  sink.write(StringFragment(text.data(), text.size()));
+  sink.flush();
 }
 
-void Deluxe68::printRestore(uint32_t regMask) const
+void Deluxe68::printSpill(OutputSink& sink, uint32_t regMask)
 {
   if (regMask)
   {
-    outf("\t\tmovem.l (sp)+,");
-    printMovemList(regMask);
-    outf("\n");
+    char line[kRegisterListMax + 32];
+    size_t len = 0;
+
+    memcpy(line, "\t\tmovem.l ", 10);
+    len += 10;
+    len += formatRegisterList(line + len, regMask);
+    memcpy(line + len, ",-(sp)\n", 7);
+    len += 7;
+
+    sink.write(line, len);
   }
 }
 
-void Deluxe68::printMovemList(uint32_t selectedRegs) const
+void Deluxe68::printRestore(OutputSink& sink, uint32_t regMask)
 {
-  bool printed = false;
-  for (int i = 0, mask = 1; i < kRegisterCount; ++i, mask <<= 1)
+  if (regMask)
   {
-    if (selectedRegs & mask)
-    {
-      outf("%s%s", printed ? "/" : "", regName(i));
-      printed = true;
-    }
+    char line[kRegisterListMax + 32];
+    size_t len = 0;
+
+    memcpy(line, "\t\tmovem.l (sp)+,", 16);
+    len += 16;
+    len += formatRegisterList(line + len, regMask);
+    line[len++] = '\n';
+
+    sink.write(line, len);
   }
 }
 
+namespace
+{
+  struct PooledString
+  {
+    const char* m_Text;
+    uint8_t     m_Size;
+    uint8_t     m_Lines;
+  };
+}
+
+// Indexed by PoolString.
+static constexpr PooledString kStringPool[] =
+{
+  { "\n", 1, 1 },
+  { "@", 1, 0 },
+  { "\t\t; ", 4, 0 },
+  { "\t\tbsr\t", 6, 0 },
+};
+
+// Output lines produced by each kind of element, so output() never has to
+// look at text. Text from the input is part of a line, or a run of lines its
+// caller accounts for; pooled strings are counted in output(PoolString).
+static constexpr uint8_t kOutputLines[] =
+{
+  0,    // kStringLiteral
+  0,    // kNamedRegister
+  1,    // kSpill
+  1,    // kRestore
+  2,    // kProcHeader
+  2,    // kProcFooter
+  0,    // kStackVar
+  0,    // kLineDirective
+  1,    // kEchoLine
+  1,    // kLiveRegNote
+  0,    // kPrecomputed, counted by the caller
+};
+
+static_assert(sizeof kOutputLines == size_t(OutputKind::kCount), "kOutputLines out of sync with OutputKind");
+
 void Deluxe68::output(OutputElement elem)
 {
   m_OutputSchedule.push_back(elem);
+  m_CurrentOutputLine += kOutputLines[size_t(elem.kind())];
+}
+
+void Deluxe68::output(PoolString str)
+{
+  const PooledString& pooled = kStringPool[size_t(str)];
+  m_OutputSchedule.push_back(OutputElement(OutputKind::kStringLiteral, TextSource::kPool, uint32_t(str), pooled.m_Size));
+  m_CurrentOutputLine += pooled.m_Lines;
+}
+
+void Deluxe68::outputText(OutputKind kind, StringFragment text)
+{
+  uint32_t offset = uint32_t(text.ptr() - inputText());
 
-  switch (elem.m_Kind)
+  if (text.size() <= OutputElement::kMaxSize)
   {
-    case OutputKind::kStringLiteral:
-      for (char ch : elem.m_String)
-      {
-        if ('\n' == ch)
-          ++m_CurrentOutputLine;
-      }
-      break;
+    output(OutputElement(kind, TextSource::kInput, offset, uint32_t(text.size())));
+    return;
+  }
 
-    case OutputKind::kSpill:
-    case OutputKind::kRestore:
-      ++m_CurrentOutputLine;
-      break;
+  // Too long for one element; only plain text can be split up.
+  if (OutputKind::kEchoLine == kind)
+    output(PoolString::kCommentPrefix);
 
-    case OutputKind::kProcHeader:
-      m_CurrentOutputLine += 2;
-      break;
-    case OutputKind::kProcFooter:
-      m_CurrentOutputLine += 2;
-      break;
-    default:
-      break;
+  for (size_t left = text.size(); left > 0; )
+  {
+    uint32_t size = left < OutputElement::kMaxSize ? uint32_t(left) : OutputElement::kMaxSize;
+    output(OutputElement(OutputKind::kStringLiteral, TextSource::kInput, offset, size));
+    offset += size;
+    left -= size;
   }
+
+  if (OutputKind::kEchoLine == kind)
+    newline();
 }
 
-void Deluxe68::newline()
+const char* Deluxe68::inputText() const
+{
+  return m_Reader ? m_LineText.data() : m_InputData;
+}
+
+StringFragment Deluxe68::textOf(const OutputElement& elem) const
 {
-  static constexpr OutputElement nl(StringFragment("\n", 1));
+  switch (elem.source())
+  {
+    case TextSource::kInput:
+      return StringFragment(inputText() + elem.offset(), elem.size());
+    case TextSource::kPool:
+      return StringFragment(kStringPool[elem.offset()].m_Text, elem.size());
+    case TextSource::kExtra:
+      return StringFragment(m_ExtraText.data() + elem.offset(), elem.size());
+
+  }
+
+  return StringFragment();
+}
 
-  m_OutputSchedule.push_back(nl);
-  ++m_CurrentOutputLine;
+void Deluxe68::newline()
+{
+  output(PoolString::kNewline);
 }
 
 void Deluxe68::handleRegularLine(StringFragment line)
 {
-  for (int i = 0; i < line.length(); )
+  for (;;)
   {
-    if (line[i] == '@')
+    // Everything up to the next '@' is copied verbatim, and nothing after a
+    // comment is looked at.
+    const char* hit = findAtOrSemicolon(line.ptr(), line.end());
+    if (hit == line.end() || ';' == *hit)
+      break;
+
+    int i = int(hit - line.ptr());
+    if (i > 0)
     {
-      if (i > 0)
-      {
-        output(OutputElement(line.slice(i)));
-      }
+      outputText(OutputKind::kStringLiteral, line.slice(i));
+    }
 
-      line.slice(1); // Eat '@'
+    line.slice(1); // Eat '@'
+
+    int max = line.length();
+    i = 0;
+    while (i < max && isIdentChar(line[i]))
+      ++i;
 
-      int max = line.length();
-      for (i = 0; i < max; ++i)
+    StringFragment varName = line.slice(i);
+    if (varName.length() > 0)
+    {
+      const RegAlloc* live = liveReg(varName);
+      if (!live)
       {
-        char ch = line[i];
-        if (!isalnum(ch) && ch != '_')
-        {
-          break;
-        }
+        error(DiagnosticCode::kUnknownReference, "unknown register '%.*s' referenced\n", varName.length(), varName.ptr());
+        continue;
       }
+      const RegAlloc& alloc = *live;
 
-      StringFragment varName = line.slice(i);
-      if (varName.length() > 0)
+      if (alloc.m_Spilled)
       {
-        auto it = m_LiveRegs.find(varName);
-        if (it == m_LiveRegs.end())
-        {
-          error("unknown register '%.*s' referenced\n", varName.length(), varName.ptr());
-          continue;
-        }
-        const RegAlloc& alloc = it->second;
-
-        if (alloc.m_Spilled)
-        {
-          // Use stack position
-          output(OutputElement(OutputKind::kStackVar, 4 * (m_SpillStackDepth - alloc.m_StackSlot - 1)));
-        }
-        else
-        {
-          // Live.
-          output(OutputElement(StringFragment(regName(it->second.m_RegIndex), 2)));
-        }
+        // Use stack position
+        output(OutputElement(OutputKind::kStackVar, 4 * (m_SpillStackDepth - alloc.m_StackSlot - 1)));
       }
       else
       {
-        // It's a lone '@', retain it, because they're used in macros.
-        output(OutputElement(StringFragment("@", 1)));
+        // Live.
+        output(OutputElement(OutputKind::kNamedRegister, alloc.m_RegIndex));
       }
-
-      i = 0; // restart
-    }
-    else if (line[i] == ';')
-    {
-      break;
     }
     else
     {
-      ++i;
+      // It's a lone '@', retain it, because they're used in macros.
+      output(PoolString::kAt);
     }
   }
 
   if (line.length() > 0)
   {
-    output(OutputElement(line));
+    outputText(OutputKind::kStringLiteral, line);
   }
 
   newline();
 }
-
-void Deluxe68::outf(const char* fmt, ...) const
-{
-  char line[1024];
-  va_list a;
-  va_start(a, fmt);
-  int len = vsnprintf(line, sizeof line, fmt, a);
-  va_end(a);
-  m_PrintCallback(line, len, m_PrintData);
-}
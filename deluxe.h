@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <limits.h>
 
 #include <unordered_map>
 #include <vector>
@@ -10,9 +12,24 @@
 
 #include "tokenizer.h"
 #include "registers.h"
+#include "outputsink.h"
+#include "arena.h"
 #include "stringfragment.h"
+#include "symboltable.h"
 
-enum class OutputKind
+class LineReader;
+class ProcCache;
+class SignatureDb;
+struct ProcCacheKey;
+struct ProcCacheEntry;
+struct ProcStats;
+struct TranslationStats;
+
+// Bump whenever a change alters the output produced for some input. Cached
+// translations are keyed on it.
+static constexpr char kDeluxe68Version[] = "1.3.0";
+
+enum class OutputKind : uint8_t
 {
   kStringLiteral,
   kNamedRegister,
@@ -21,7 +38,57 @@ enum class OutputKind
   kProcHeader,
   kProcFooter,
   kStackVar,
-  kLineDirective
+  kLineDirective,
+  kEchoLine,        // A directive line, echoed as a comment
+  kLiveRegNote,     // "; live reg dN => name"
+  kPrecomputed,     // A procedure translated on another thread, by index
+  kCount
+};
+
+// What to leave out of the output besides the directives themselves.
+enum class CompactMode : uint8_t
+{
+  kNone,
+  kNoAnnotations,   // Echoed directives and "live reg" notes
+  kNoComments,      // Those and comment lines (emptied under -l)
+};
+
+enum class DiagnosticCode : uint8_t
+{
+  kInputTooLarge,
+  kUnsupportedSyntax,
+  kUnexpectedToken,
+  kNameInUse,
+  kOutOfRegisters,
+  kRegisterOwner,       // Who holds a register, after kOutOfRegisters
+  kRegisterNotFree,
+  kNameNotInUse,
+  kNestedProc,
+  kProcRedefined,
+  kUnknownKeyword,
+  kRegisterNotReserved,
+  kUnknownRegister,     // @spill/@restore of a name that isn't allocated
+  kUnknownReference,    // @name in code that isn't allocated
+  kAlreadySpilled,
+  kNotSpilled,
+  kHomeSlotTaken,
+  kRenameTargetInUse,
+  kRenameSourceNotLive,
+  kCount
+};
+
+// Short stable name for a code, e.g. "unknown-reference".
+const char* diagnosticCodeName(DiagnosticCode code);
+
+struct Diagnostic
+{
+  const char*    m_File = "";
+  int            m_Line = 0;          // 0 if not about a particular line
+  DiagnosticCode m_Code = DiagnosticCode::kCount;
+  std::string    m_Message;           // Without location or trailing newline
+  // Identical messages folded into this one, and the line of the last.
+  int            m_Repeats = 0;
+  int            m_LastLine = 0;
 };
 
 struct ProcedureDef
@@ -32,57 +99,160 @@ struct ProcedureDef
   bool m_SaveInputRegs = false;
 };
 
+// Where the text of a string element lives.
+enum class TextSource : uint8_t
+{
+  kInput,     // The input buffer, or the lines copied from a stream
+  kPool,      // The translator's static strings, by index
+  kExtra,     // Text copied in when replaying cached procedures
+};
+
+// One entry in the output schedule. There are a few of these for every input
+// line, so they are packed into 8 bytes: text is referred to by a 32-bit
+// offset into its source, and everything else is a 32-bit value plus a small
+// integer in the bits the text size would otherwise use.
 struct OutputElement
 {
+  static constexpr uint32_t kKindBits = 4;
+  static constexpr uint32_t kSourceBits = 2;
+  static constexpr uint32_t kSizeShift = kKindBits + kSourceBits;
+  static constexpr uint32_t kMaxSize = (1u << (32 - kSizeShift)) - 1;
+
+  uint32_t m_Value = 0;   // Text offset, or the integer payload
+  uint32_t m_Tag = 0;     // Kind, text source, and text size or extra payload
+
   OutputElement() = default;
-  constexpr explicit OutputElement(StringFragment f) : m_String(f) {}
-  explicit OutputElement(OutputKind kind, int intVal) : m_IntValue(intVal), m_Kind(kind) {}
-  explicit OutputElement(OutputKind kind, StringFragment f) : m_String(f), m_Kind(kind) {}
 
-  StringFragment m_String;
-  int            m_IntValue = 0;
-  OutputKind     m_Kind = OutputKind::kStringLiteral;
+  constexpr OutputElement(OutputKind kind, int value, uint32_t extra = 0)
+    : m_Value(uint32_t(value))
+    , m_Tag(uint32_t(kind) | extra << kSizeShift)
+  {}
+
+  constexpr OutputElement(OutputKind kind, TextSource source, uint32_t offset, uint32_t size)
+    : m_Value(offset)
+    , m_Tag(uint32_t(kind) | uint32_t(source) << kKindBits | size << kSizeShift)
+  {}
+
+  OutputKind kind() const { return OutputKind(m_Tag & ((1u << kKindBits) - 1)); }
+  TextSource source() const { return TextSource((m_Tag >> kKindBits) & ((1u << kSourceBits) - 1)); }
+  uint32_t offset() const { return m_Value; }
+  uint32_t size() const { return m_Tag >> kSizeShift; }
+  uint32_t extra() const { return m_Tag >> kSizeShift; }
+  int intValue() const { return int(m_Value); }
 };
 
+static_assert(sizeof(OutputElement) == 8, "schedule entries should stay packed");
+static_assert(uint32_t(OutputKind::kCount) <= 1u << OutputElement::kKindBits, "too many output kinds");
+
 class Deluxe68
 {
 public:
   using PrintCallback = void (const char* buf, size_t len, void* user_data);
 
+  // Receives each diagnostic as a complete, newline terminated message.
+  using DiagnosticCallback = void (const char* msg, size_t len, void* user_data);
+
 public:
   struct PendingRegisterSpill;
 
 private:
   static constexpr size_t kLineMax = 4096;
 
-  const char* m_InputData;
-  size_t      m_InputLen;
+  const char* m_InputData = nullptr;
+  size_t      m_InputLen = 0;
+
+  // Set when input comes from a stream rather than a buffer. Lines are then
+  // appended to m_LineText, which the schedule refers to by offset.
+  LineReader* m_Reader = nullptr;
+  std::string m_LineText;
+
+  // Literal text of replayed procedures, also referred to by offset.
+  std::string m_ExtraText;
+
+  // Register and procedure names. Everything below refers to names by ID.
+  SymbolTable m_Symbols;
+
+  // When set, output is written here as soon as each procedure ends rather
+  // than being held until generateOutput().
+  OutputSink* m_StreamSink = nullptr;
+  std::unique_ptr<OutputSink> m_OwnedStreamSink;
+
+  DiagnosticCallback* m_DiagnosticCallback = nullptr;
+  void* m_DiagnosticData = nullptr;
+
+  // Diagnostics are collected as they come up and written out together when
+  // run() finishes. A message identical to an earlier one (code and text) is
+  // only counted against that one; m_DiagnosticIndex finds it.
+  std::vector<Diagnostic> m_Diagnostics;
+  std::unordered_map<std::string, size_t> m_DiagnosticIndex;
+  int m_MaxErrors = 0;
+  bool m_Stopped = false;
+
+  // Previously translated procedures, replayed instead of translated again
+  // when their source text hasn't changed.
+  ProcCache* m_ProcCache = nullptr;
+
+  // Procedures from other files that @call can refer to.
+  const SignatureDb* m_Signatures = nullptr;
+
+  // Procedures translated on other threads before run() gets to them.
+  struct PrecomputedProcs;
+  std::unique_ptr<PrecomputedProcs> m_Precomputed;
+  int m_ProcedureThreads = 1;
+  // Where each procedure's output is in the schedule, when it is to be
+  // written to a file of its own. Lines are input line numbers: the @proc
+  // line and the one after @endproc.
+  struct ProcOutput
+  {
+    SymbolId m_Proc;
+    uint32_t m_Begin;
+    uint32_t m_End;
+    int      m_FirstLine;
+    int      m_NextLine;
+  };
+  bool m_SplitOutput = false;
+  std::vector<ProcOutput> m_ProcOutputs;
+  ProcOutput m_OpenProcOutput = ProcOutput();
 
-  mutable PrintCallback* m_PrintCallback = nullptr;
-  mutable void* m_PrintData = nullptr;
+  // Counters for --stats. Everything is gathered in passes that only run
+  // when this is set, so translation without it does no extra work.
+  TranslationStats* m_Stats = nullptr;
+  // Set while a procedure is being recorded into m_ProcCache, so its output
+  // isn't streamed away before it has been captured.
+  bool m_HoldStreamingOutput = false;
 
   std::vector<OutputElement> m_OutputSchedule;
 
-  const char* m_Filename;
+  const char* m_Filename = "";
   int m_LineNumber = 0;
   int m_ErrorCount = 0;
-  const char* m_ParsePoint;
+  const char* m_ParsePoint = nullptr;
 
   bool m_EmitLineDirectives = false;
   bool m_ProcSections = false;
+  CompactMode m_Compact = CompactMode::kNone;
   int m_CurrentOutputLine = 0;
+  // Output line minus input line as of the last line directive. Compact
+  // output can leave it anywhere, so the value before the first one can't
+  // be an ordinary number.
+  static constexpr int kNoLineDelta = INT_MIN;
+  int m_LineDelta = kNoLineDelta;
 
-  StringFragment m_CurrentProcName;
+  SymbolId m_CurrentProcId = kNoSymbol;
   ProcedureDef m_CurrentProc;
 
+  // Backs the per-name arrays and the spill stacks below. reset() hands it
+  // all back at once instead of freeing containers one by one.
+  Arena m_Arena;
+
   struct RegState
   {
     static constexpr uint32_t kFlagAllocated = 1 << 0;
     static constexpr uint32_t kFlagReserved  = 1 << 1;
 
-    uint32_t                    m_Flags = 0;
-    StringFragment              m_AllocatingVarName;
-    std::vector<StringFragment> m_SpilledVars;
+    uint32_t             m_Flags = 0;
+    SymbolId             m_AllocatingVar = kNoSymbol;
+    ArenaArray<SymbolId> m_SpilledVars;
 
     bool isAllocated() const { return 0 != (m_Flags & kFlagAllocated); }
     bool isReserved() const { return 0 != (m_Flags & kFlagReserved); }
@@ -107,33 +277,33 @@ private:
     void reset()
     {
       m_Flags = 0;
-      m_AllocatingVarName = StringFragment();
+      m_AllocatingVar = kNoSymbol;
       m_SpilledVars.clear();
     }
 
     void spill()
     {
       setAllocated(false);
-      m_SpilledVars.push_back(m_AllocatingVarName);
-      m_AllocatingVarName = StringFragment();
+      m_SpilledVars.push_back(m_AllocatingVar);
+      m_AllocatingVar = kNoSymbol;
     }
 
     void restore()
     {
     }
 
-    void handleRename(StringFragment idOld, StringFragment idNew)
+    void handleRename(SymbolId idOld, SymbolId idNew)
     {
-      if (m_AllocatingVarName == idOld)
+      if (m_AllocatingVar == idOld)
       {
-        m_AllocatingVarName = idNew;
+        m_AllocatingVar = idNew;
       }
 
-      for (auto& str : m_SpilledVars)
+      for (SymbolId& id : m_SpilledVars)
       {
-        if (str == idOld)
+        if (id == idOld)
         {
-          str = idNew;
+          id = idNew;
         }
       }
     }
@@ -143,31 +313,162 @@ private:
 
   struct RegAlloc
   {
+    uint8_t m_Live = 0;
     uint8_t m_RegIndex = 0;
     uint8_t m_Spilled = 0;
     int     m_StackSlot = 0;
     int     m_AllocatedLine = 0;
   };
 
+  struct ProcEntry
+  {
+    bool         m_Defined = false;
+    ProcedureDef m_Def;
+  };
+
   int m_SpillStackDepth = 0;
-  std::unordered_map<StringFragment, RegAlloc> m_LiveRegs;
-  std::unordered_map<StringFragment, ProcedureDef> m_Procedures;
+
+  // Both indexed by SymbolId, and grown as names are interned.
+  ArenaArray<RegAlloc>  m_LiveRegs;
+  ArenaArray<ProcEntry> m_Procedures;
+
+  // Names made live since the last killAll(), so it doesn't have to sweep
+  // every name in the file. May contain names that have been killed since.
+  ArenaArray<SymbolId> m_LiveIds;
+  int m_LiveCount = 0;
+  int m_PeakLiveCount = 0;
 
 public:
+  // Without input; see reset().
+  Deluxe68();
   explicit Deluxe68(const char* ifn, const char* data, size_t len, bool emitLineDirectives, bool procSections);
+  explicit Deluxe68(const char* ifn, LineReader& reader, bool emitLineDirectives, bool procSections);
 
   ~Deluxe68();
 
-  void error(const char *fmt, ...);
-  void errorForLine(int line, const char *fmt, ...);
+  Deluxe68(const Deluxe68&) = delete;
+  Deluxe68& operator=(const Deluxe68&) = delete;
+
+  // Start over on new input, as if newly constructed. Memory allocated for
+  // earlier input is kept for reuse, and so are the streaming output,
+  // diagnostic callback, procedure cache, signatures and thread count set
+  // before.
+  void reset(const char* ifn, const char* data, size_t len, bool emitLineDirectives, bool procSections);
+  void reset(const char* ifn, LineReader& reader, bool emitLineDirectives, bool procSections);
+
+  void error(DiagnosticCode code, const char *fmt, ...);
+  void errorForLine(int line, DiagnosticCode code, const char *fmt, ...);
+
+  // Emit output incrementally while run() is going. Everything scheduled so
+  // far is written out at each @endproc (the point where the procedure's
+  // save mask is final) and then discarded, and the remainder is written when
+  // run() finishes. generateOutput() has nothing left to print afterwards.
+  void setStreamingOutput(FILE* f);
+  void setStreamingOutput(PrintCallback* cb, void* user_data);
+  void setStreamingOutput(OutputSink* sink);
+
+  // Send diagnostics somewhere other than stderr. Translators share no
+  // mutable state, so each can run on its own thread with its own callback.
+  // Either way they are written out once run() is done: to stderr with a
+  // single write, or to the callback one message at a time.
+  void setDiagnosticCallback(DiagnosticCallback* cb, void* user_data);
+
+  // Stop translating once this many errors have been reported; 0 for no
+  // limit. Useful when one mistake early on sets off thousands more.
+  void setMaxErrors(int count);
+
+  // Reuse and record per-procedure translations. Only used for buffered
+  // input; the cache must outlive run().
+  void setProcedureCache(ProcCache* cache);
+
+  // Translate the procedures of buffered input on this many threads, each on
+  // its own, before run() assembles the output in source order. Procedures
+  // that can't be translated in isolation (errors, registers reserved ahead
+  // of them, redefinitions) are translated in place as usual, so output and
+  // diagnostics are the same as for a serial run.
+  void setProcedureThreads(int threadCount);
+
+  // Leave the translator's annotations (and optionally comment lines) out of
+  // the output. Line directives still match the input.
+  void setCompactMode(CompactMode mode);
+
+  // Add counts for what run() does to 'stats', which must outlive it.
+  // Procedures translated on other threads only show up in the line and
+  // procedure counts.
+  void setStats(TranslationStats* stats);
+
+  // Signatures for @call to use for procedures not defined in this file.
+  // The database must outlive run().
+  void setSignatures(const SignatureDb* signatures);
+
+  // Keep track of where each procedure is in the output, so it can be
+  // written out on its own with generateProcedureOutput() and the text
+  // around the procedures with generatePrologueOutput(). Buffered output
+  // only. With line directives, every piece starts with one.
+  void setSplitOutput(bool split);
 
   void run();
+  // The sink is flushed at the end, as the schedule may refer to text that
+  // doesn't outlive it. Doesn't modify the translator, so the same output can
+  // be generated into several sinks at once.
+  void generateOutput(OutputSink& sink) const;
   void generateOutput(FILE* f) const;
   void generateOutput(PrintCallback* cb, void* user_data) const;
 
+  // Procedures in output order, after run() with setSplitOutput().
+  size_t procedureOutputCount() const { return m_ProcOutputs.size(); }
+  StringFragment procedureOutputName(size_t index) const;
+  void generateProcedureOutput(OutputSink& sink, size_t index) const;
+  // Everything outside of procedures, in order.
+  void generatePrologueOutput(OutputSink& sink) const;
+
+  // A signature file line (see SignatureDb) for every procedure defined, after
+  // run().
+  void generateSignatures(OutputSink& sink) const;
+
+  // Every error counts, including repeats folded into earlier diagnostics.
   int errorCount() const { return m_ErrorCount; }
 
+  const std::vector<Diagnostic>& diagnostics() const { return m_Diagnostics; }
+
 private:
+  // Indices into the static string pool.
+  enum class PoolString : uint8_t
+  {
+    kNewline,
+    kAt,
+    kCommentPrefix,
+    kBsr,
+  };
+
+  // A complete @proc ... @endproc block at the parse point.
+  struct ProcSpan
+  {
+    StringFragment m_Text;        // Up to and including the @endproc line's newline
+    StringFragment m_Name;
+    uint32_t       m_LineCount = 0;
+  };
+
+  void report(int lineNumber, DiagnosticCode code, const char* fmt, va_list args);
+  void flushDiagnostics();
+
+  void translateLine(StringFragment line);
+  void dropCommentLine();
+  void syncLineDirective();
+  void forgetLineDelta();
+  bool translateVerbatimLines(const char* end);
+  bool translateCachedProc();
+  static bool findProcSpan(const char* begin, const char* end, ProcSpan* span);
+  void translateProceduresInParallel();
+  bool translatePrecomputedProc();
+  bool isCleanProcEntry() const;
+  // False, having output nothing, if 'entry' doesn't fit 'span'.
+  bool replayProc(const ProcCacheEntry& entry, const ProcSpan& span);
+  void recordProc(const ProcCacheKey& key, const ProcSpan& span);
+  // Counts for a procedure that was translated elsewhere, see ProcStats.
+  void addProcStats(const ProcStats& counts);
+  bool captureProc(const ProcSpan& span, ProcCacheEntry* entry, bool withElements);
+
   void parseLine(StringFragment line);
 
   void bufferLine(const char* line);
@@ -182,17 +483,42 @@ private:
   void spill(Tokenizer& tokenizer);
   void restore(Tokenizer& tokenizer);
   void rename(Tokenizer& tokenizer);
+  void call(Tokenizer& tokenizer);
 
   void output(OutputElement elem);
+  void output(PoolString str);
+  void outputText(OutputKind kind, StringFragment text);
+  const char* inputText() const;
+  StringFragment textOf(const OutputElement& elem) const;
   void handleRegularLine(StringFragment line);
   void newline();
-
-  uint32_t usedRegsForProcecure(const StringFragment& procName) const;
-  void printSpill(uint32_t regMask) const;
-  void printRestore(uint32_t regMask) const;
-  void printMovemList(uint32_t regMask) const;
+  void flushStreamingOutput();
+  void collectStats(size_t begin, size_t end);
+  void collectFinalStats();
+
+  SymbolId intern(StringFragment name);
+  RegAlloc* liveReg(SymbolId id);
+  RegAlloc* liveReg(StringFragment name);
+  void setLive(SymbolId id, const RegAlloc& alloc);
+  void setDead(SymbolId id);
+  const ProcedureDef* findProcedure(SymbolId id) const;
+  void defineProcedure(SymbolId id, const ProcedureDef& def);
+
+  uint32_t usedRegsForProcecure(SymbolId procId) const;
+  static uint32_t savedRegs(const ProcedureDef& def);
+  static uint32_t clobberedRegs(const ProcedureDef& def);
+  void writeElements(OutputSink& sink, size_t begin, size_t end) const;
+  static void printSpill(OutputSink& sink, uint32_t regMask);
+  static void printRestore(OutputSink& sink, uint32_t regMask);
+  void writeLiveRegNote(OutputSink& sink, const OutputElement& elem) const;
+  void writeLineDirective(OutputSink& sink, int line) const;
+  void writePart(OutputSink& sink, size_t begin, size_t end, int firstLine) const;
+  void beginProcOutput(int firstLine);
+  void endProcOutput(SymbolId procId);
   void killAll();
-  bool doAllocate(StringFragment id, int regIndex);
+  void attachArena();
+  void clearArena();
+  bool doAllocate(SymbolId id, int regIndex);
 
   bool dataLeft() const;
   StringFragment nextLine();
@@ -202,6 +528,5 @@ private:
 
   int findFirstFree(RegisterClass regClass) const;
 
-  void outf(const char* fmt, ...) const;
 };
 
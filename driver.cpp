@@ -0,0 +1,564 @@
+#include "driver.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "atomicfile.h"
+#include "cache.h"
+#include "deluxe.h"
+#include "inputfile.h"
+#include "linereader.h"
+#include "proccache.h"
+#include "signatures.h"
+#include "stats.h"
+
+namespace
+{
+  // Counts the bytes that go out, for --stats.
+  class CountingFileSink : public FileSink
+  {
+    uint64_t m_Bytes = 0;
+
+  public:
+    explicit CountingFileSink(FILE* f) : FileSink(f) {}
+
+    // The base class would flush after this part of the object is gone.
+    ~CountingFileSink() { flush(); }
+
+    uint64_t bytes() const { return m_Bytes; }
+
+  protected:
+    bool writeChunks(const Chunk* chunks, size_t count) override
+    {
+      for (size_t i = 0; i < count; ++i)
+        m_Bytes += chunks[i].m_Len;
+      return FileSink::writeChunks(chunks, count);
+    }
+  };
+
+  class Stopwatch
+  {
+    std::chrono::steady_clock::time_point m_Start = std::chrono::steady_clock::now();
+
+  public:
+    // Seconds since construction or the previous lap().
+    double lap()
+    {
+      auto now = std::chrono::steady_clock::now();
+      std::chrono::duration<double> elapsed = now - m_Start;
+      m_Start = now;
+      return elapsed.count();
+    }
+  };
+}
+
+// Writes one output file besides the main one, counting its bytes for --stats.
+template <typename Generate>
+static bool writeOutputPart(const std::string& path, Generate generate, const DriverOptions& options, uint64_t* bytes)
+{
+  AtomicFile f;
+  if (!f.open(path.c_str()))
+  {
+    fprintf(stderr, "can't open %s for writing\n", path.c_str());
+    return false;
+  }
+
+  {
+    CountingFileSink sink(f.file());
+    generate(sink);
+    *bytes += sink.bytes();
+  }
+
+  if (!f.commit(options.m_WriteIfChanged))
+  {
+    fprintf(stderr, "can't write %s\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+static bool writeSplitOutput(const Deluxe68& d, const char* manifestName, const DriverOptions& options, uint64_t* bytes)
+{
+  std::vector<std::string> parts;
+  std::unordered_set<std::string> written;
+  parts.push_back(std::string(manifestName) + ".prologue.s");
+  if (!writeOutputPart(parts.back(), [&](OutputSink& sink) { d.generatePrologueOutput(sink); }, options, bytes))
+    return false;
+
+  for (size_t i = 0; i < d.procedureOutputCount(); ++i)
+  {
+    const StringFragment name = d.procedureOutputName(i);
+    parts.push_back(std::string(manifestName) + ".proc_" + std::string(name.ptr(), name.size()) + ".s");
+    if (!writeOutputPart(parts.back(), [&](OutputSink& sink) { d.generateProcedureOutput(sink, i); }, options, bytes))
+      return false;
+  }
+
+  // Parts of procedures that are gone would otherwise linger and get
+  // assembled by globbing build rules.
+  written.insert(parts.begin(), parts.end());
+  InputFile previous;
+  if (previous.open(manifestName))
+  {
+    const std::string prefix = std::string(manifestName) + ".";
+    const char* p = previous.data();
+    const char* end = p + previous.size();
+    while (p < end)
+    {
+      const char* nl = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+      if (!nl)
+        nl = end;
+
+      const std::string path(p, nl);
+      if (0 == path.compare(0, prefix.size(), prefix) && 0 == written.count(path))
+        remove(path.c_str());
+
+      p = nl + 1;
+    }
+    previous.close();
+  }
+
+  std::string manifest;
+  for (const std::string& part : parts)
+  {
+    manifest += part;
+    manifest += '\n';
+  }
+
+  StringFragment text(manifest.data(), manifest.size());
+  return writeOutputPart(manifestName, [&](OutputSink& sink) { sink.write(text); sink.flush(); }, options, bytes);
+}
+
+static int translateOutput(const char* inputName, const char* outputName, const DriverOptions& options, const WarmState* warm)
+{
+  const bool inputIsPipe = 0 == strcmp("-", inputName);
+  const bool outputIsPipe = 0 == strcmp("-", outputName);
+  // Split output is written piece by piece once everything is translated.
+  bool streaming = options.m_Streaming && !options.m_Split;
+
+  InputFile input;
+  ProcCache procCache;
+  ProcCache* procs = &procCache;
+  std::string sidecarName;
+  std::unique_ptr<LineReader> reader;
+  std::unique_ptr<Deluxe68> translator;
+  Deluxe68* d = nullptr;
+  std::string cacheKey;
+
+  const bool wantStats = StatsFormat::kNone != options.m_Stats;
+  TranslationStats stats;
+  Stopwatch clock;
+
+  if (options.m_Split && (inputIsPipe || outputIsPipe))
+  {
+    fprintf(stderr, "--split needs named input and output files\n");
+    return 1;
+  }
+
+  if (options.m_ExportSignatures && outputIsPipe)
+  {
+    fprintf(stderr, "--export needs a named output file\n");
+    return 1;
+  }
+
+  if (inputIsPipe)
+  {
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    reader.reset(new LineReader(stdin));
+    translator.reset(new Deluxe68(options.m_StdinName, *reader, options.m_EmitLineDirectives, options.m_ProcSections));
+    d = translator.get();
+
+    // There's no point in reading a pipe in chunks only to hold on to all of
+    // it in the output schedule.
+    streaming = true;
+  }
+  else
+  {
+    if (!input.open(inputName))
+    {
+      fprintf(stderr, "can't open %s for reading\n", inputName);
+      return 1;
+    }
+
+    stats.m_InputBytes = input.size();
+
+    // Signatures only come out of a translation.
+    if (options.m_Cache && !outputIsPipe && !options.m_Split && !options.m_ExportSignatures)
+    {
+      cacheKey = options.m_Cache->makeKey(input.data(), input.size(), inputName, options);
+
+      if (options.m_Cache->fetch(cacheKey, outputName, options.m_WriteIfChanged))
+      {
+        if (wantStats)
+        {
+          stats.m_CacheHit = true;
+          stats.m_ReadTime = clock.lap();
+          printStats(stderr, inputName, stats, StatsFormat::kJson == options.m_Stats);
+        }
+        return 0;
+      }
+
+      // The whole output is needed to populate the cache anyway.
+      streaming = false;
+    }
+
+    if (warm && warm->m_Translator)
+    {
+      d = warm->m_Translator;
+      d->reset(inputName, input.data(), input.size(), options.m_EmitLineDirectives, options.m_ProcSections);
+    }
+    else
+    {
+      translator.reset(new Deluxe68(inputName, input.data(), input.size(), options.m_EmitLineDirectives, options.m_ProcSections));
+      d = translator.get();
+    }
+
+    if (warm && warm->m_Procedures)
+    {
+      procs = warm->m_Procedures;
+      d->setProcedureCache(procs);
+    }
+
+    if (options.m_Incremental && !outputIsPipe)
+    {
+      sidecarName = std::string(outputName) + ".d68inc";
+      // A warm cache is at least as current as the sidecar.
+      if (0 == procs->size())
+        procs->load(sidecarName.c_str());
+      d->setProcedureCache(procs);
+    }
+
+    d->setProcedureThreads(options.m_ProcedureThreads);
+  }
+
+  d->setCompactMode(options.m_Compact);
+  d->setSplitOutput(options.m_Split);
+  d->setSignatures(options.m_Signatures);
+  d->setStats(wantStats ? &stats : nullptr);
+  d->setMaxErrors(options.m_MaxErrors);
+  stats.m_ReadTime = clock.lap();
+
+  AtomicFile outputFile;
+  FILE* f = stdout;
+
+  if (!outputIsPipe && !options.m_Split)
+  {
+    if (!outputFile.open(outputName))
+    {
+      fprintf(stderr, "can't open %s for writing\n", outputName);
+      return 1;
+    }
+    f = outputFile.file();
+  }
+
+  CountingFileSink sink(f);
+
+  if (streaming)
+  {
+    d->setStreamingOutput(&sink);
+  }
+
+  clock.lap();
+  d->run();
+  stats.m_RunTime = clock.lap();
+
+  if (d->errorCount())
+  {
+    // Error storms cost time too.
+    if (wantStats)
+      printStats(stderr, inputName, stats, StatsFormat::kJson == options.m_Stats);
+
+    // Named the way the diagnostics above name it.
+    const char* reportName = inputIsPipe ? options.m_StdinName : inputName;
+
+    if (streaming && outputIsPipe)
+    {
+      fflush(f);
+      fprintf(stderr, "%s: output is incomplete - %d errors\n", reportName, d->errorCount());
+    }
+    else
+    {
+      // Any partial output is discarded along with outputFile.
+      fprintf(stderr, "%s: exiting without writing output - %d errors\n", reportName, d->errorCount());
+    }
+    return 1;
+  }
+
+  if (options.m_Split)
+  {
+    if (!writeSplitOutput(*d, outputName, options, &stats.m_BytesWritten))
+      return 1;
+  }
+  else if (!cacheKey.empty())
+  {
+    std::string text;
+    StringSink textSink(&text);
+    d->generateOutput(textSink);
+    fwrite(text.data(), 1, text.size(), f);
+    options.m_Cache->store(cacheKey, text);
+    stats.m_BytesWritten = text.size();
+  }
+  else if (!streaming)
+  {
+    d->generateOutput(sink);
+  }
+
+  if (outputIsPipe)
+  {
+    fflush(f);
+  }
+  else if (!options.m_Split && !outputFile.commit(options.m_WriteIfChanged))
+  {
+    fprintf(stderr, "can't write %s\n", outputName);
+    return 1;
+  }
+
+  if (options.m_ExportSignatures)
+  {
+    const std::string path = std::string(outputName) + ".sig";
+    if (!writeOutputPart(path, [&](OutputSink& sink) { d->generateSignatures(sink); }, options, &stats.m_BytesWritten))
+      return 1;
+  }
+
+  // Not fatal, the next run just has less to work with.
+  if (!sidecarName.empty() && !procs->save(sidecarName.c_str()))
+  {
+    fprintf(stderr, "warning: can't write %s\n", sidecarName.c_str());
+  }
+
+  if (procs != &procCache)
+    procs->prune();
+
+  if (wantStats)
+  {
+    stats.m_OutputTime = clock.lap();
+    stats.m_BytesWritten += sink.bytes();
+    printStats(stderr, inputName, stats, StatsFormat::kJson == options.m_Stats);
+  }
+
+  return 0;
+}
+
+int translateFile(const char* inputName, const char* outputName, const DriverOptions& options, const WarmState* warm)
+{
+  int result = translateOutput(inputName, outputName, options, warm);
+
+  if (0 == result && !writeDepFile(inputName, outputName, options))
+    result = 1;
+
+  return result;
+}
+
+// Make treats spaces, '#' and '$' specially in rules.
+static void appendEscapedPath(std::string* out, const char* path)
+{
+  for (const char* p = path; *p; ++p)
+  {
+    if (' ' == *p || '#' == *p)
+      out->push_back('\\');
+    else if ('$' == *p)
+      out->push_back('$');
+    out->push_back(*p);
+  }
+}
+
+bool writeDepFile(const char* inputName, const char* outputName, const DriverOptions& options)
+{
+  std::string path;
+  if (options.m_DepFile)
+    path = options.m_DepFile;
+  else if (options.m_DepFilePerOutput)
+    path = std::string(outputName) + ".d";
+  else
+    return true;
+
+  if (0 == strcmp("-", inputName) || 0 == strcmp("-", outputName))
+  {
+    fprintf(stderr, "warning: no dependency file for stdin/stdout, %s not written\n", path.c_str());
+    return true;
+  }
+
+  std::string text;
+  appendEscapedPath(&text, outputName);
+  text += ": ";
+  appendEscapedPath(&text, inputName);
+  if (options.m_Signatures)
+  {
+    for (const std::string& signatures : options.m_Signatures->paths())
+    {
+      text += " ";
+      appendEscapedPath(&text, signatures.c_str());
+    }
+  }
+  text += "\n";
+
+  AtomicFile f;
+  if (!f.open(path.c_str()))
+  {
+    fprintf(stderr, "can't open %s for writing\n", path.c_str());
+    return false;
+  }
+
+  fwrite(text.data(), 1, text.size(), f.file());
+
+  if (!f.commit(options.m_WriteIfChanged))
+  {
+    fprintf(stderr, "can't write %s\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool parseBatchJob(const char* spec, BatchJob* job)
+{
+  // Don't split "c:\foo.s:c:\foo.out" at the drive letter.
+  const char* searchStart = spec;
+  if (isalpha((unsigned char)spec[0]) && ':' == spec[1] && ('\\' == spec[2] || '/' == spec[2]))
+    searchStart = spec + 2;
+
+  const char* sep = strchr(searchStart, ':');
+  if (!sep || sep == spec || '\0' == sep[1])
+    return false;
+
+  job->m_Input.assign(spec, sep);
+  job->m_Output.assign(sep + 1);
+  return true;
+}
+
+bool readResponseFile(const char* path, std::vector<BatchJob>* jobs)
+{
+  InputFile file;
+  if (!file.open(path))
+  {
+    fprintf(stderr, "can't open response file %s\n", path);
+    return false;
+  }
+
+  const char* p = file.data();
+  const char* end = p + file.size();
+  int lineNumber = 0;
+  bool ok = true;
+
+  while (p < end)
+  {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (!eol)
+      eol = end;
+
+    ++lineNumber;
+    std::string line(p, eol);
+    p = eol + 1;
+
+    // Trim surrounding whitespace, including stray carriage returns.
+    size_t first = line.find_first_not_of(" \t\r");
+    if (std::string::npos == first || '#' == line[first])
+      continue;
+    size_t last = line.find_last_not_of(" \t\r");
+    line = line.substr(first, last - first + 1);
+
+    BatchJob job;
+    if (!parseBatchJob(line.c_str(), &job))
+    {
+      fprintf(stderr, "%s(%d): expected input:output, got '%s'\n", path, lineNumber, line.c_str());
+      ok = false;
+      continue;
+    }
+
+    jobs->push_back(job);
+  }
+
+  return ok;
+}
+
+int runBatch(const std::vector<BatchJob>& jobs, const DriverOptions& options, int threadCount)
+{
+  // Most likely a build rule whose file list came out empty.
+  if (jobs.empty())
+  {
+    fprintf(stderr, "no input:output pairs given\n");
+    return 1;
+  }
+
+  if (threadCount <= 0)
+  {
+    threadCount = static_cast<int>(std::thread::hardware_concurrency());
+    if (threadCount <= 0)
+      threadCount = 1;
+  }
+
+  if (size_t(threadCount) > jobs.size())
+    threadCount = static_cast<int>(jobs.size());
+
+  // Streaming only makes sense for a single output - batch mode writes whole
+  // files, and stdin/stdout can't be shared between jobs.
+  DriverOptions jobOptions = options;
+  jobOptions.m_Streaming = false;
+
+  // Files are already spread over the threads.
+  if (threadCount > 1)
+    jobOptions.m_ProcedureThreads = 1;
+
+  std::atomic<size_t> nextJob(0);
+  std::atomic<int> failedCount(0);
+
+  auto worker = [&]()
+  {
+    for (;;)
+    {
+      size_t index = nextJob.fetch_add(1);
+      if (index >= jobs.size())
+        break;
+
+      const BatchJob& job = jobs[index];
+
+      if (job.m_Input == "-" || job.m_Output == "-")
+      {
+        fprintf(stderr, "%s: stdin/stdout can't be used in batch mode\n", job.m_Input.c_str());
+        ++failedCount;
+        continue;
+      }
+
+      if (0 != translateFile(job.m_Input.c_str(), job.m_Output.c_str(), jobOptions))
+      {
+        ++failedCount;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < threadCount; ++i)
+  {
+    threads.emplace_back(worker);
+  }
+
+  // The calling thread works too.
+  worker();
+
+  for (std::thread& t : threads)
+  {
+    t.join();
+  }
+
+  if (failedCount > 0)
+  {
+    fprintf(stderr, "%d of %d files failed\n", failedCount.load(), int(jobs.size()));
+    return 1;
+  }
+
+  return 0;
+}
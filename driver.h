@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Command line level operations shared by the different ways deluxe68 can be
+// run (single file, batch, ...).
+
+class Deluxe68;
+class ProcCache;
+class SignatureDb;
+class TranslationCache;
+enum class CompactMode : uint8_t;
+
+enum class StatsFormat
+{
+  kNone,
+  kText,
+  kJson,
+};
+
+struct DriverOptions
+{
+  bool              m_EmitLineDirectives = false;
+  bool              m_ProcSections = false;
+  bool              m_Streaming = false;
+  CompactMode       m_Compact = CompactMode();  // kNone
+  // Treat the output name as a manifest and write the text outside of
+  // procedures to <output>.prologue.s and every procedure to
+  // <output>.proc_<name>.s, so they can be assembled in parallel.
+  bool              m_Split = false;
+  // Keep per-procedure translations in a sidecar next to the output file
+  // (<output>.d68inc) and only translate procedures that changed.
+  bool              m_Incremental = false;
+  // Threads translating the procedures of a single file; 1 is serial.
+  int               m_ProcedureThreads = 1;
+  // Leave an existing output alone (timestamp included) when the translation
+  // comes out the same, so build tools don't redo downstream steps.
+  bool              m_WriteIfChanged = false;
+  // Makefile syntax dependency file for the output (-MF), or one per output
+  // named <output>.d (-MD).
+  const char*       m_DepFile = nullptr;
+  bool              m_DepFilePerOutput = false;
+  // Report timings and counters for every file on stderr.
+  StatsFormat       m_Stats = StatsFormat::kNone;
+  // Stop translating a file after this many errors; 0 for no limit.
+  int               m_MaxErrors = 0;
+  // Write the register signature of every procedure to <output>.sig, for
+  // other files to import.
+  bool              m_ExportSignatures = false;
+  // Signatures of procedures in other files, for @call.
+  const SignatureDb* m_Signatures = nullptr;
+  const char*       m_StdinName = "stdin";
+  TranslationCache* m_Cache = nullptr;
+};
+
+// A translator and procedure cache kept alive between translations of the
+// same file, so that repeated runs (see Watcher) start warm.
+struct WarmState
+{
+  Deluxe68*  m_Translator = nullptr;
+  ProcCache* m_Procedures = nullptr;
+};
+
+// Translate 'input' into 'output'. Either can be "-" for stdin/stdout.
+// Diagnostics go to stderr. Returns 0 on success. Output files are replaced
+// atomically, and left alone if translation fails.
+int translateFile(const char* input, const char* output, const DriverOptions& options, const WarmState* warm = nullptr);
+
+// Write the dependency file 'options' asks for, if any, after 'output' has
+// been produced from 'input'. Returns false if it couldn't be written.
+bool writeDepFile(const char* input, const char* output, const DriverOptions& options);
+
+struct BatchJob
+{
+  std::string m_Input;
+  std::string m_Output;
+};
+
+// Parse an "input:output" pair.
+bool parseBatchJob(const char* spec, BatchJob* job);
+
+// Read "input:output" pairs, one per line, from a response file. Blank lines
+// and lines starting with '#' are skipped.
+bool readResponseFile(const char* path, std::vector<BatchJob>* jobs);
+
+// Translate every job on a pool of 'threadCount' workers (0 = one per core).
+// Each file gets its own translator and error count. Returns 0 if all files
+// were translated successfully, and 1 if there were none to translate.
+int runBatch(const std::vector<BatchJob>& jobs, const DriverOptions& options, int threadCount);
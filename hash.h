@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// 64-bit non-cryptographic hash (MurmurHash64A), reading 8 bytes at a time.
+// Results depend on byte order, so don't share them between machines.
+inline uint64_t hash64(const void* data, size_t len, uint64_t seed)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ull;
+  const int r = 47;
+
+  uint64_t h = seed ^ (len * m);
+
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* end = p + (len & ~size_t(7));
+
+  while (p != end)
+  {
+    uint64_t k;
+    memcpy(&k, p, sizeof k);
+    p += sizeof k;
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  if (size_t tail = len & 7)
+  {
+    uint64_t k = 0;
+    memcpy(&k, p, tail);
+    h ^= k;
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
@@ -0,0 +1,110 @@
+#include "inputfile.h"
+
+#include <stdio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define D68_HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define D68_HAVE_MMAP 0
+#endif
+
+InputFile::~InputFile()
+{
+  close();
+}
+
+bool InputFile::open(const char* path)
+{
+  close();
+
+#if D68_HAVE_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (0 == fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+  {
+    bool mapped = map(fd, size_t(st.st_size));
+    ::close(fd);
+    if (mapped)
+      return true;
+  }
+  else
+  {
+    ::close(fd);
+  }
+#endif
+
+  return readAll(path);
+}
+
+void InputFile::close()
+{
+#if D68_HAVE_MMAP
+  if (m_Mapping)
+  {
+    munmap(m_Mapping, m_MappingSize);
+  }
+#endif
+
+  m_Mapping = nullptr;
+  m_MappingSize = 0;
+  m_Data = nullptr;
+  m_Size = 0;
+  m_Buffer.clear();
+}
+
+bool InputFile::map(int fd, size_t size)
+{
+#if D68_HAVE_MMAP
+  void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (MAP_FAILED == p)
+    return false;
+
+  // We make a single pass front to back, so let the kernel read ahead
+  // aggressively and drop pages behind us.
+  madvise(p, size, MADV_SEQUENTIAL);
+
+  m_Mapping = p;
+  m_MappingSize = size;
+  m_Data = static_cast<const char*>(p);
+  m_Size = size;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool InputFile::readAll(const char* path)
+{
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return false;
+
+  // Don't trust the file size here - this path also handles files that
+  // can't report one.
+  static constexpr size_t kChunkSize = 64 * 1024;
+  size_t used = 0;
+
+  for (;;)
+  {
+    m_Buffer.resize(used + kChunkSize);
+    size_t got = fread(m_Buffer.data() + used, 1, kChunkSize, f);
+    used += got;
+    if (got < kChunkSize)
+      break;
+  }
+
+  bool ok = !ferror(f);
+  fclose(f);
+
+  m_Buffer.resize(used);
+  m_Data = m_Buffer.data();
+  m_Size = used;
+  return ok;
+}
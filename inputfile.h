@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Read-only view of an input file.
+//
+// Where the platform supports it the file is mapped privately into memory and
+// the translator parses straight out of the mapping, which avoids copying
+// large (generated) sources into a heap buffer first. Files that can't be
+// mapped (pipes, special files, empty files) are read into a buffer instead.
+class InputFile
+{
+  const char*       m_Data = nullptr;
+  size_t            m_Size = 0;
+  void*             m_Mapping = nullptr;
+  size_t            m_MappingSize = 0;
+  std::vector<char> m_Buffer;
+
+public:
+  InputFile() = default;
+  ~InputFile();
+
+  InputFile(const InputFile&) = delete;
+  InputFile& operator=(const InputFile&) = delete;
+
+  bool open(const char* path);
+  void close();
+
+  const char* data() const { return m_Data; }
+  size_t size() const { return m_Size; }
+  bool isMapped() const { return m_Mapping != nullptr; }
+
+private:
+  bool map(int fd, size_t size);
+  bool readAll(const char* path);
+};
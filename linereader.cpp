@@ -0,0 +1,93 @@
+#include "linereader.h"
+
+#include <string.h>
+
+static size_t readFromFile(void* dst, size_t len, void* user_data)
+{
+  return fread(dst, 1, len, (FILE*)user_data);
+}
+
+LineReader::LineReader(FILE* f, size_t chunkSize)
+  : LineReader(readFromFile, f, chunkSize)
+{
+}
+
+LineReader::LineReader(ReadCallback* cb, void* user_data, size_t chunkSize)
+  : m_ReadCallback(cb)
+  , m_ReadData(user_data)
+  , m_ChunkSize(chunkSize ? chunkSize : 1)
+{
+}
+
+bool LineReader::atEnd()
+{
+  while (m_Begin == m_End)
+  {
+    if (!fill())
+      return true;
+  }
+  return false;
+}
+
+StringFragment LineReader::nextLine()
+{
+  for (;;)
+  {
+    const char* base = m_Buffer.data() + m_Begin;
+    size_t avail = m_End - m_Begin;
+
+    if (avail > m_Scanned)
+    {
+      if (const void* nl = memchr(base + m_Scanned, '\n', avail - m_Scanned))
+      {
+        size_t len = static_cast<const char*>(nl) - base;
+        m_Begin += len + 1;
+        m_Scanned = 0;
+        return StringFragment(base, len);
+      }
+
+      m_Scanned = avail;
+    }
+
+    if (!fill())
+    {
+      // Unterminated last line (or nothing at all). fill() may have moved the
+      // data, so don't reuse 'base'.
+      StringFragment rest(m_Buffer.data() + m_Begin, m_End - m_Begin);
+      m_Begin = m_End;
+      m_Scanned = 0;
+      return rest;
+    }
+  }
+}
+
+bool LineReader::fill()
+{
+  if (m_Eof)
+    return false;
+
+  // Slide the partial line down to the start of the buffer, then make room
+  // for a full chunk after it.
+  size_t tail = m_End - m_Begin;
+  if (m_Begin > 0)
+  {
+    memmove(m_Buffer.data(), m_Buffer.data() + m_Begin, tail);
+    m_Begin = 0;
+    m_End = tail;
+  }
+
+  if (m_Buffer.size() < tail + m_ChunkSize)
+  {
+    m_Buffer.resize(tail + m_ChunkSize);
+  }
+
+  size_t got = m_ReadCallback(m_Buffer.data() + m_End, m_ChunkSize, m_ReadData);
+  if (0 == got)
+  {
+    m_Eof = true;
+    return false;
+  }
+
+  m_End += got;
+  return true;
+}
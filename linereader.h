@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+
+#include "stringfragment.h"
+
+// Splits a non-seekable byte stream (e.g. stdin) into lines.
+//
+// Input is pulled in fixed size chunks. Only the unfinished tail of the
+// current chunk is carried over to the next read, so memory use is bounded by
+// the chunk size (or the longest line, if that's larger). Line fragments
+// returned by nextLine() are only valid until the next call.
+class LineReader
+{
+public:
+  using ReadCallback = size_t (void* dst, size_t len, void* user_data);
+
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+private:
+  ReadCallback*     m_ReadCallback;
+  void*             m_ReadData;
+  size_t            m_ChunkSize;
+  std::vector<char> m_Buffer;
+  size_t            m_Begin = 0;    // Start of the first unreturned line
+  size_t            m_Scanned = 0;  // Bytes past m_Begin known to hold no newline
+  size_t            m_End = 0;      // End of valid data in m_Buffer
+  bool              m_Eof = false;
+
+public:
+  explicit LineReader(FILE* f, size_t chunkSize = kDefaultChunkSize);
+  explicit LineReader(ReadCallback* cb, void* user_data, size_t chunkSize = kDefaultChunkSize);
+
+  LineReader(const LineReader&) = delete;
+  LineReader& operator=(const LineReader&) = delete;
+
+  // True once every line has been returned. May block to read more input.
+  bool atEnd();
+
+  // Return the next line without its terminating newline. The last line of
+  // the stream is returned even if it's unterminated.
+  StringFragment nextLine();
+
+private:
+  bool fill();
+};
@@ -1,36 +1,214 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <thread>
 #include <vector>
 
+#include "cache.h"
 #include "deluxe.h"
+#include "driver.h"
+#include "server.h"
+#include "signatures.h"
+#include "watch.h"
+
+static TranslationServer* s_Server = nullptr;
+static Watcher* s_Watcher = nullptr;
+
+static void stopServer(int)
+{
+  s_Server->stop();
+}
+
+static void stopWatcher(int)
+{
+  s_Watcher->stop();
+}
+
+static int serve(const char* socketPath, int threadCount)
+{
+  TranslationServer server;
+  if (!server.listen(socketPath))
+    return 1;
+
+  s_Server = &server;
+  signal(SIGINT, stopServer);
+  signal(SIGTERM, stopServer);
+
+  fprintf(stderr, "deluxe68: serving on %s\n", socketPath);
+  server.run(threadCount);
+  return 0;
+}
+
+static int watch(const std::vector<BatchJob>& jobs, const DriverOptions& options)
+{
+  Watcher watcher(options);
+
+  for (const BatchJob& job : jobs)
+  {
+    if (job.m_Input == "-" || job.m_Output == "-")
+    {
+      fprintf(stderr, "stdin/stdout can't be watched\n");
+      return 1;
+    }
+
+    if (!watcher.add(job))
+      return 1;
+  }
+
+  s_Watcher = &watcher;
+  signal(SIGINT, stopWatcher);
+  signal(SIGTERM, stopWatcher);
+
+  watcher.buildAll();
+  fprintf(stderr, "deluxe68: watching %d files\n", int(jobs.size()));
+  watcher.run();
+  return 0;
+}
 
 static void usage()
 {
   fprintf(stderr, "usage: deluxe68 [options] <input> <output>\n");
+  fprintf(stderr, "       deluxe68 [options] --batch <input:output|@responsefile>...\n");
+  fprintf(stderr, "       deluxe68 [-j <n>] --serve <socket>\n");
+  fprintf(stderr, "       deluxe68 [options] --watch <input> <output> | --watch --batch ...\n");
+  fprintf(stderr, "use - as input or output to read stdin or write stdout\n");
+  fprintf(stderr, "input files must be smaller than 4 GB (from stdin, the text between procedures)\n");
   fprintf(stderr, "options:\n");
   fprintf(stderr, "  -l     emit tbl_line directives\n");
+  fprintf(stderr, "  -p     put each procedure in its own section\n");
+  fprintf(stderr, "  -s     stream output as each procedure completes\n");
+  fprintf(stderr, "  -n <f> file name to report for stdin input\n");
+  fprintf(stderr, "  -j <n> number of batch or server worker threads (default: one per core)\n");
+  fprintf(stderr, "  --compact          leave out echoed directives and live register notes\n");
+  fprintf(stderr, "  --compact=comments also leave out lines holding only a comment\n");
+  fprintf(stderr, "  --split            write <output>.prologue.s and <output>.proc_<name>.s files,\n");
+  fprintf(stderr, "                     with <output> listing them in order\n");
+  fprintf(stderr, "  --cache <dir>      reuse translations stored in <dir>\n");
+  fprintf(stderr, "  --cache-size <mb>  evict old cache entries beyond this size (default: 512)\n");
+  fprintf(stderr, "  --incremental      only retranslate procedures changed since the last run\n");
+  fprintf(stderr, "  --parallel         translate the procedures of a file on -j threads\n");
+  fprintf(stderr, "  --write-if-changed don't touch outputs whose contents stay the same\n");
+  fprintf(stderr, "  -MF <file>         write a Makefile dependency file for the output\n");
+  fprintf(stderr, "  -MD                write <output>.d dependency files (works with --batch)\n");
+  fprintf(stderr, "  --watch            translate again whenever an input changes, until interrupted\n");
+  fprintf(stderr, "  --stats[=json]     report timings and counters for each file on stderr\n");
+  fprintf(stderr, "  --max-errors <n>   stop translating a file after <n> errors\n");
+  fprintf(stderr, "  --export           write procedure signatures to <output>.sig\n");
+  fprintf(stderr, "  --import <file>    use signatures from another file's --export for @call\n");
+  fprintf(stderr, "set DELUXE68_SERVER=<socket> to hand single file translations to a server\n");
   exit(1);
 }
 
 int main(int argc, char* argv[])
 {
-  bool emitLineDirectives = false;
-  bool procSections = false;
-  int positionalCount = 0;
-  const char* positionals[2] = { nullptr, nullptr };
+  DriverOptions options;
+  bool batch = false;
+  const char* serveSocket = nullptr;
+  const char* cacheDir = nullptr;
+  uint64_t cacheMaxBytes = TranslationCache::kDefaultMaxBytes;
+  int threadCount = 0;
+  bool parallel = false;
+  bool watchInputs = false;
+  std::vector<const char*> positionals;
+  std::vector<const char*> imports;
 
   for (int i = 1; i < argc; ++i)
   {
-    if ('-' == argv[i][0])
+    if ('-' == argv[i][0] && '\0' != argv[i][1])
     {
       if (0 == strcmp("-l", argv[i]))
       {
-        emitLineDirectives = true;
+        options.m_EmitLineDirectives = true;
       }
       else if (0 == strcmp("-p", argv[i]))
       {
-        procSections = true;
+        options.m_ProcSections = true;
+      }
+      else if (0 == strcmp("-s", argv[i]))
+      {
+        options.m_Streaming = true;
+      }
+      else if (0 == strcmp("-n", argv[i]) && i + 1 < argc)
+      {
+        options.m_StdinName = argv[++i];
+      }
+      else if (0 == strcmp("-j", argv[i]) && i + 1 < argc)
+      {
+        threadCount = atoi(argv[++i]);
+      }
+      else if (0 == strcmp("--batch", argv[i]))
+      {
+        batch = true;
+      }
+      else if (0 == strcmp("--serve", argv[i]) && i + 1 < argc)
+      {
+        serveSocket = argv[++i];
+      }
+      else if (0 == strcmp("--cache", argv[i]) && i + 1 < argc)
+      {
+        cacheDir = argv[++i];
+      }
+      else if (0 == strcmp("--cache-size", argv[i]) && i + 1 < argc)
+      {
+        cacheMaxBytes = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+      }
+      else if (0 == strcmp("--incremental", argv[i]))
+      {
+        options.m_Incremental = true;
+      }
+      else if (0 == strcmp("--parallel", argv[i]))
+      {
+        parallel = true;
+      }
+      else if (0 == strcmp("--stats", argv[i]))
+      {
+        options.m_Stats = StatsFormat::kText;
+      }
+      else if (0 == strcmp("--stats=json", argv[i]))
+      {
+        options.m_Stats = StatsFormat::kJson;
+      }
+      else if (0 == strcmp("--compact", argv[i]))
+      {
+        options.m_Compact = CompactMode::kNoAnnotations;
+      }
+      else if (0 == strcmp("--compact=comments", argv[i]))
+      {
+        options.m_Compact = CompactMode::kNoComments;
+      }
+      else if (0 == strcmp("--split", argv[i]))
+      {
+        options.m_Split = true;
+      }
+      else if (0 == strcmp("--max-errors", argv[i]) && i + 1 < argc)
+      {
+        options.m_MaxErrors = atoi(argv[++i]);
+      }
+      else if (0 == strcmp("--export", argv[i]))
+      {
+        options.m_ExportSignatures = true;
+      }
+      else if (0 == strcmp("--import", argv[i]) && i + 1 < argc)
+      {
+        imports.push_back(argv[++i]);
+      }
+      else if (0 == strcmp("--watch", argv[i]))
+      {
+        watchInputs = true;
+      }
+      else if (0 == strcmp("--write-if-changed", argv[i]))
+      {
+        options.m_WriteIfChanged = true;
+      }
+      else if (0 == strcmp("-MF", argv[i]) && i + 1 < argc)
+      {
+        options.m_DepFile = argv[++i];
+      }
+      else if (0 == strcmp("-MD", argv[i]))
+      {
+        options.m_DepFilePerOutput = true;
       }
       else
       {
@@ -38,57 +216,114 @@ int main(int argc, char* argv[])
         usage();
       }
     }
-    else if (positionalCount < 2)
-    {
-      positionals[positionalCount++] = argv[i];
-    }
     else
     {
-      usage();
+      positionals.push_back(argv[i]);
     }
   }
 
-  if (positionalCount < 2)
-    usage();
+  if (parallel)
+  {
+    options.m_ProcedureThreads = threadCount > 0 ? threadCount : int(std::thread::hardware_concurrency());
+  }
+
+  if (serveSocket)
+  {
+    if (!positionals.empty())
+      usage();
+
+    return serve(serveSocket, threadCount);
+  }
+
+  SignatureDb signatures;
+  for (const char* path : imports)
+  {
+    if (!signatures.load(path))
+      return 1;
+  }
+  if (!imports.empty())
+    options.m_Signatures = &signatures;
+
+  TranslationCache cache;
+  if (cacheDir)
+  {
+    if (!cache.open(cacheDir, cacheMaxBytes))
+      return 1;
+    options.m_Cache = &cache;
+  }
 
-  std::vector<char> inputData;
+  int result = 1;
 
+  if (batch)
   {
-    FILE* f = fopen(positionals[0], "rb");
-    if (!f)
+    if (options.m_DepFile)
     {
-      fprintf(stderr, "can't open %s for reading\n", positionals[0]);
-      exit(1);
+      fprintf(stderr, "-MF names a single dependency file, use -MD with --batch\n");
+      usage();
     }
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    rewind(f);
 
-    inputData.resize(fsize);
-    fread(inputData.data(), fsize, 1, f);
-    fclose(f);
-  }
+    std::vector<BatchJob> jobs;
 
-  Deluxe68 d(positionals[0], inputData.data(), inputData.size(), emitLineDirectives, procSections);
+    for (const char* arg : positionals)
+    {
+      if ('@' == arg[0])
+      {
+        if (!readResponseFile(arg + 1, &jobs))
+          return 1;
+      }
+      else
+      {
+        BatchJob job;
+        if (!parseBatchJob(arg, &job))
+        {
+          fprintf(stderr, "expected input:output, got '%s'\n", arg);
+          usage();
+        }
+        jobs.push_back(job);
+      }
+    }
 
-  d.run();
+    if (watchInputs && jobs.empty())
+    {
+      fprintf(stderr, "no input:output pairs given\n");
+      return 1;
+    }
 
-  if (d.errorCount())
-  {
-    fprintf(stderr, "exiting without writing output - %d errors\n", d.errorCount());
-    return 1;
+    result = watchInputs ? watch(jobs, options) : runBatch(jobs, options, threadCount);
   }
-
-  if (FILE* f = fopen(positionals[1], "w"))
+  else if (watchInputs)
   {
-    d.generateOutput(f);
-    fclose(f);
+    if (positionals.size() != 2)
+      usage();
+
+    BatchJob job;
+    job.m_Input = positionals[0];
+    job.m_Output = positionals[1];
+    result = watch(std::vector<BatchJob>(1, job), options);
   }
   else
   {
-    fprintf(stderr, "can't open %s for reading\n", positionals[1]);
-    exit(1);
+    if (positionals.size() != 2)
+      usage();
+
+    // Let a running server do the work if there is one; build rules don't
+    // need to know. Incremental state lives next to the output, and
+    // statistics are about a local run, so those stay local, as do split
+    // output, signatures and an error limit the server protocol has no room
+    // for.
+    const bool local = options.m_Incremental || StatsFormat::kNone != options.m_Stats || options.m_MaxErrors || options.m_Split ||
+        options.m_ExportSignatures || options.m_Signatures;
+    const char* socketPath = local ? nullptr : getenv("DELUXE68_SERVER");
+    if (!socketPath || !translateFileViaServer(socketPath, positionals[0], positionals[1], options, &result))
+    {
+      result = translateFile(positionals[0], positionals[1], options);
+    }
   }
 
-  return 0;
+  if (cacheDir)
+  {
+    cache.trim();
+  }
+
+  return result;
 }
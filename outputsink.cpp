@@ -0,0 +1,162 @@
+#include "outputsink.h"
+
+#include <errno.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+OutputSink::OutputSink()
+  : m_Buffer(new char[kBufferSize])
+{
+  m_Chunks.reserve(kMaxChunks);
+}
+
+// Derived sinks flush in their own destructors, while writeChunks() can
+// still be called.
+OutputSink::~OutputSink()
+{
+}
+
+void OutputSink::writeInt(int value)
+{
+  char buf[16];
+  char* end = buf + sizeof buf;
+  char* p = end;
+
+  unsigned magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+  do
+  {
+    *--p = char('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+
+  if (value < 0)
+    *--p = '-';
+
+  write(p, size_t(end - p));
+}
+
+void OutputSink::writeSlow(const char* p, size_t len)
+{
+  flush();
+
+  if (len <= kBufferSize)
+  {
+    memcpy(m_Buffer.get(), p, len);
+    addBuffered(len);
+    return;
+  }
+
+  // Too big to copy, and the caller's memory isn't ours to hold on to.
+  Chunk chunk { p, len };
+  if (!writeChunks(&chunk, 1))
+    m_Ok = false;
+}
+
+bool OutputSink::flush()
+{
+  if (!m_Chunks.empty() && !writeChunks(m_Chunks.data(), m_Chunks.size()))
+    m_Ok = false;
+
+  m_Chunks.clear();
+  m_Used = 0;
+  m_LastChunkIsBuffer = false;
+  return m_Ok;
+}
+
+FileSink::~FileSink()
+{
+  flush();
+}
+
+bool FileSink::writeChunks(const Chunk* chunks, size_t count)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  // Anything written through stdio so far has to go first.
+  if (0 != fflush(m_File))
+    return false;
+
+  const int fd = fileno(m_File);
+
+  struct iovec iov[kMaxChunks];
+  while (count > 0)
+  {
+    size_t n = count < size_t(IOV_MAX) ? count : size_t(IOV_MAX);
+    if (n > kMaxChunks)
+      n = kMaxChunks;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      iov[i].iov_base = const_cast<char*>(chunks[i].m_Ptr);
+      iov[i].iov_len = chunks[i].m_Len;
+    }
+
+    // Retry after short writes, e.g. to a pipe.
+    struct iovec* first = iov;
+    size_t left = n;
+    while (left > 0)
+    {
+      ssize_t written = writev(fd, first, int(left));
+      if (written < 0)
+      {
+        if (EINTR == errno)
+          continue;
+        return false;
+      }
+
+      size_t done = size_t(written);
+      while (left > 0 && done >= first->iov_len)
+      {
+        done -= first->iov_len;
+        ++first;
+        --left;
+      }
+
+      if (left > 0)
+      {
+        first->iov_base = static_cast<char*>(first->iov_base) + done;
+        first->iov_len -= done;
+      }
+    }
+
+    chunks += n;
+    count -= n;
+  }
+
+  return true;
+#else
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (chunks[i].m_Len != fwrite(chunks[i].m_Ptr, 1, chunks[i].m_Len, m_File))
+      return false;
+  }
+  return true;
+#endif
+}
+
+CallbackSink::~CallbackSink()
+{
+  flush();
+}
+
+bool CallbackSink::writeChunks(const Chunk* chunks, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    m_Callback(chunks[i].m_Ptr, chunks[i].m_Len, m_UserData);
+  return true;
+}
+
+StringSink::~StringSink()
+{
+  flush();
+}
+
+bool StringSink::writeChunks(const Chunk* chunks, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    m_String->append(chunks[i].m_Ptr, chunks[i].m_Len);
+  return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "stringfragment.h"
+
+// Destination for generated text.
+//
+// Formatted pieces are copied into a large buffer that is reused between
+// flushes. Longer spans that already live somewhere stable (the input, the
+// static strings of the translator) are queued by reference instead, and
+// everything is handed to the concrete sink as a list of chunks in output
+// order, so a sink that supports scatter-gather I/O writes them all at once.
+class OutputSink
+{
+public:
+  struct Chunk
+  {
+    const char* m_Ptr;
+    size_t      m_Len;
+  };
+
+  static constexpr size_t kBufferSize = 64 * 1024;
+  static constexpr size_t kMaxChunks = 512;
+
+  // Shorter spans are copied; an extra chunk costs more than the copy.
+  static constexpr size_t kMinRefSize = 32;
+
+private:
+  std::unique_ptr<char[]> m_Buffer;
+  size_t                  m_Used = 0;
+  std::vector<Chunk>      m_Chunks;
+  bool                    m_LastChunkIsBuffer = false;
+  bool                    m_Ok = true;
+
+public:
+  OutputSink();
+  virtual ~OutputSink();
+
+  OutputSink(const OutputSink&) = delete;
+  OutputSink& operator=(const OutputSink&) = delete;
+
+  // Copy text into the buffer.
+  void write(const char* p, size_t len)
+  {
+    if (kBufferSize - m_Used >= len && m_Chunks.size() < kMaxChunks)
+    {
+      memcpy(m_Buffer.get() + m_Used, p, len);
+      addBuffered(len);
+      return;
+    }
+
+    writeSlow(p, len);
+  }
+
+  void write(StringFragment f) { write(f.ptr(), f.size()); }
+  void write(const char* s) { write(s, strlen(s)); }
+
+  void put(char ch) { write(&ch, 1); }
+
+  void writeInt(int value);
+
+  // Queue text by reference. It must stay valid until the next flush().
+  void writeRef(const char* p, size_t len)
+  {
+    if (len < kMinRefSize)
+    {
+      write(p, len);
+      return;
+    }
+
+    if (m_Chunks.size() == kMaxChunks)
+      flush();
+
+    m_Chunks.push_back(Chunk { p, len });
+    m_LastChunkIsBuffer = false;
+  }
+
+  void writeRef(StringFragment f) { writeRef(f.ptr(), f.size()); }
+
+  // Hand everything queued so far to the sink. Returns false if this or any
+  // earlier write failed.
+  bool flush();
+
+  bool ok() const { return m_Ok; }
+
+protected:
+  virtual bool writeChunks(const Chunk* chunks, size_t count) = 0;
+
+private:
+  void addBuffered(size_t len)
+  {
+    if (m_LastChunkIsBuffer)
+    {
+      m_Chunks.back().m_Len += len;
+    }
+    else
+    {
+      m_Chunks.push_back(Chunk { m_Buffer.get() + m_Used, len });
+      m_LastChunkIsBuffer = true;
+    }
+    m_Used += len;
+  }
+
+  void writeSlow(const char* p, size_t len);
+};
+
+// Writes to a stdio stream. On POSIX systems the stream is flushed and the
+// chunks go to its descriptor with writev().
+class FileSink : public OutputSink
+{
+  FILE* m_File;
+
+public:
+  explicit FileSink(FILE* f) : m_File(f) {}
+  ~FileSink();
+
+protected:
+  bool writeChunks(const Chunk* chunks, size_t count) override;
+};
+
+// Calls back once per chunk.
+class CallbackSink : public OutputSink
+{
+public:
+  using Callback = void (const char* buf, size_t len, void* user_data);
+
+private:
+  Callback* m_Callback;
+  void*     m_UserData;
+
+public:
+  CallbackSink(Callback* cb, void* user_data) : m_Callback(cb), m_UserData(user_data) {}
+  ~CallbackSink();
+
+protected:
+  bool writeChunks(const Chunk* chunks, size_t count) override;
+};
+
+// Appends to a string.
+class StringSink : public OutputSink
+{
+  std::string* m_String;
+
+public:
+  explicit StringSink(std::string* str) : m_String(str) {}
+  ~StringSink();
+
+protected:
+  bool writeChunks(const Chunk* chunks, size_t count) override;
+};
@@ -0,0 +1,257 @@
+#include "proccache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "atomicfile.h"
+#include "hash.h"
+#include "inputfile.h"
+
+// Sidecar file layout, all integers in host byte order:
+//
+//   u32 magic, u32 format version, u32 entry count
+//   per entry:
+//     u64 key[2]
+//     u32 used regs, u32 input regs, u32 trashed regs, u32 save input regs
+//     u32 input lines, u32 output lines
+//     i32 line delta after, i32 spill depth delta
+//     u32 literal bytes, literal text
+//     u32 element count, elements (u32 kind, u32 source, i32 int, u32 offset, u32 length)
+//     u32 peak live names, u32 directive counts[TokenType::kCount]
+
+static constexpr uint32_t kSidecarMagic = 0x50383644; // 'D68P'
+static constexpr uint32_t kSidecarVersion = 4;
+
+ProcCacheKey ProcCache::makeKey(StringFragment spanText, bool emitLineDirectives, CompactMode compact)
+{
+  // Line directives and compact output change the schedule; the file name
+  // and -p only matter when printing, so they're not part of the key.
+  std::string salt = kDeluxe68Version;
+  salt += emitLineDirectives ? 'l' : '-';
+  if (CompactMode::kNone != compact)
+    salt += char('0' + int(compact));
+
+  uint64_t seed0 = hash64(salt.data(), salt.size(), 0x9e3779b97f4a7c15ull);
+  uint64_t seed1 = hash64(salt.data(), salt.size(), 0xc2b2ae3d27d4eb4full);
+
+  ProcCacheKey key;
+  key.m_Hash[0] = hash64(spanText.ptr(), spanText.size(), seed0);
+  key.m_Hash[1] = hash64(spanText.ptr(), spanText.size(), seed1);
+  return key;
+}
+
+const ProcCacheEntry* ProcCache::find(const ProcCacheKey& key)
+{
+  auto it = m_Entries.find(key);
+  if (it == m_Entries.end())
+  {
+    ++m_Misses;
+    return nullptr;
+  }
+
+  ++m_Hits;
+  it->second.m_Used = true;
+  return &it->second;
+}
+
+void ProcCache::insert(const ProcCacheKey& key, ProcCacheEntry&& entry)
+{
+  entry.m_Used = true;
+  m_Entries[key] = std::move(entry);
+}
+
+void ProcCache::prune()
+{
+  for (auto it = m_Entries.begin(); it != m_Entries.end(); )
+  {
+    if (it->second.m_Used)
+    {
+      it->second.m_Used = false;
+      ++it;
+    }
+    else
+    {
+      it = m_Entries.erase(it);
+    }
+  }
+}
+
+namespace
+{
+  struct SidecarReader
+  {
+    const char* m_Ptr;
+    const char* m_End;
+    bool        m_Ok = true;
+
+    template <typename T>
+    T read()
+    {
+      T v = T();
+      if (size_t(m_End - m_Ptr) < sizeof v)
+      {
+        m_Ok = false;
+        return v;
+      }
+      memcpy(&v, m_Ptr, sizeof v);
+      m_Ptr += sizeof v;
+      return v;
+    }
+
+    void bytes(std::string* out, uint32_t len)
+    {
+      if (size_t(m_End - m_Ptr) < len)
+      {
+        m_Ok = false;
+        return;
+      }
+      out->assign(m_Ptr, len);
+      m_Ptr += len;
+    }
+  };
+
+  template <typename T>
+  void put(FILE* f, T v)
+  {
+    fwrite(&v, sizeof v, 1, f);
+  }
+}
+
+bool ProcCache::load(const char* path)
+{
+  m_Entries.clear();
+
+  InputFile file;
+  if (!file.open(path))
+    return false;
+
+  SidecarReader r { file.data(), file.data() + file.size() };
+
+  if (r.read<uint32_t>() != kSidecarMagic || r.read<uint32_t>() != kSidecarVersion)
+    return false;
+
+  uint32_t count = r.read<uint32_t>();
+
+  for (uint32_t i = 0; i < count && r.m_Ok; ++i)
+  {
+    ProcCacheKey key;
+    key.m_Hash[0] = r.read<uint64_t>();
+    key.m_Hash[1] = r.read<uint64_t>();
+
+    ProcCacheEntry e;
+    e.m_Proc.m_UsedRegs = r.read<uint32_t>();
+    e.m_Proc.m_InputRegs = r.read<uint32_t>();
+    e.m_Proc.m_TrashedRegs = r.read<uint32_t>();
+    e.m_Proc.m_SaveInputRegs = 0 != r.read<uint32_t>();
+    e.m_InputLines = r.read<uint32_t>();
+    e.m_OutputLines = r.read<uint32_t>();
+    e.m_LineDeltaAfter = r.read<int32_t>();
+    e.m_SpillDepthDelta = r.read<int32_t>();
+    r.bytes(&e.m_Literals, r.read<uint32_t>());
+
+    uint32_t elemCount = r.read<uint32_t>();
+    if (size_t(r.m_End - r.m_Ptr) / (5 * sizeof(uint32_t)) < elemCount)
+    {
+      r.m_Ok = false;
+      break;
+    }
+
+    e.m_Elements.resize(elemCount);
+    for (ProcCacheElement& elem : e.m_Elements)
+    {
+      uint32_t kind = r.read<uint32_t>();
+      uint32_t source = r.read<uint32_t>();
+      elem.m_IntValue = r.read<int32_t>();
+      elem.m_Offset = r.read<uint32_t>();
+      elem.m_Length = r.read<uint32_t>();
+
+      using Source = ProcCacheElement::Source;
+
+      if (kind >= uint32_t(OutputKind::kCount) || source > uint32_t(Source::kLiteral))
+        r.m_Ok = false;
+      // Notes refer to names by ID, which is why they're stored as text, and
+      // precomputed procedures only exist during a run.
+      if (uint32_t(OutputKind::kLiveRegNote) == kind || uint32_t(OutputKind::kPrecomputed) == kind)
+        r.m_Ok = false;
+      if (uint32_t(OutputKind::kNamedRegister) == kind && uint32_t(elem.m_IntValue) >= uint32_t(kRegisterCount))
+        r.m_Ok = false;
+      if (Source::kLiteral == Source(source) && uint64_t(elem.m_Offset) + elem.m_Length > e.m_Literals.size())
+        r.m_Ok = false;
+
+      elem.m_Kind = OutputKind(kind);
+      elem.m_Source = Source(source);
+    }
+
+    e.m_Stats.m_PeakLiveNames = r.read<uint32_t>();
+    for (uint32_t& count : e.m_Stats.m_Directives)
+      count = r.read<uint32_t>();
+
+    if (r.m_Ok)
+      m_Entries[key] = std::move(e);
+  }
+
+  if (!r.m_Ok)
+  {
+    // Don't trust any of it.
+    m_Entries.clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool ProcCache::save(const char* path) const
+{
+  AtomicFile file;
+  if (!file.open(path, true))
+    return false;
+
+  FILE* f = file.file();
+
+  uint32_t count = 0;
+  for (const auto& kv : m_Entries)
+  {
+    if (kv.second.m_Used)
+      ++count;
+  }
+
+  put<uint32_t>(f, kSidecarMagic);
+  put<uint32_t>(f, kSidecarVersion);
+  put<uint32_t>(f, count);
+
+  for (const auto& kv : m_Entries)
+  {
+    const ProcCacheEntry& e = kv.second;
+    if (!e.m_Used)
+      continue;
+
+    put<uint64_t>(f, kv.first.m_Hash[0]);
+    put<uint64_t>(f, kv.first.m_Hash[1]);
+    put<uint32_t>(f, e.m_Proc.m_UsedRegs);
+    put<uint32_t>(f, e.m_Proc.m_InputRegs);
+    put<uint32_t>(f, e.m_Proc.m_TrashedRegs);
+    put<uint32_t>(f, e.m_Proc.m_SaveInputRegs ? 1 : 0);
+    put<uint32_t>(f, e.m_InputLines);
+    put<uint32_t>(f, e.m_OutputLines);
+    put<int32_t>(f, e.m_LineDeltaAfter);
+    put<int32_t>(f, e.m_SpillDepthDelta);
+    put<uint32_t>(f, uint32_t(e.m_Literals.size()));
+    fwrite(e.m_Literals.data(), 1, e.m_Literals.size(), f);
+
+    put<uint32_t>(f, uint32_t(e.m_Elements.size()));
+    for (const ProcCacheElement& elem : e.m_Elements)
+    {
+      put<uint32_t>(f, uint32_t(elem.m_Kind));
+      put<uint32_t>(f, uint32_t(elem.m_Source));
+      put<int32_t>(f, elem.m_IntValue);
+      put<uint32_t>(f, elem.m_Offset);
+      put<uint32_t>(f, elem.m_Length);
+    }
+
+    put<uint32_t>(f, e.m_Stats.m_PeakLiveNames);
+    for (uint32_t count : e.m_Stats.m_Directives)
+      put<uint32_t>(f, count);
+  }
+
+  return file.commit();
+}
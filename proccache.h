@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "deluxe.h"
+#include "stats.h"
+
+// Translation results for individual @proc ... @endproc spans, kept in a
+// sidecar file between runs.
+//
+// Register allocation state is reset at every @endproc, so a procedure that
+// starts from a clean state translates the same way wherever it appears.
+// Entries are keyed on a hash of the procedure's source text. Their output
+// schedule refers back into that text by offset, so it can be replayed on top
+// of a different copy of the same bytes.
+struct ProcCacheKey
+{
+  uint64_t m_Hash[2];
+
+  bool operator==(const ProcCacheKey& other) const
+  {
+    return m_Hash[0] == other.m_Hash[0] && m_Hash[1] == other.m_Hash[1];
+  }
+};
+
+struct ProcCacheElement
+{
+  enum class Source : uint8_t
+  {
+    kNone,      // No string
+    kSpan,      // Offset into the procedure's source text
+    kLiteral,   // Offset into the entry's m_Literals
+  };
+
+  OutputKind m_Kind;
+  Source     m_Source;
+  int32_t    m_IntValue;    // Line directives are relative to the span's first line
+  uint32_t   m_Offset;
+  uint32_t   m_Length;
+};
+
+struct ProcCacheEntry
+{
+  ProcedureDef                  m_Proc;
+  uint32_t                      m_InputLines = 0;
+  uint32_t                      m_OutputLines = 0;
+  // Line directive state after the span, relative to the output/input line
+  // difference on entry, or INT_MIN if no directive has been written.
+  int32_t                       m_LineDeltaAfter = 0;
+  int32_t                       m_SpillDepthDelta = 0;
+  std::string                   m_Literals;
+  // With line directives, the first element is always the directive for the
+  // span's first line, which is only emitted if needed on entry.
+  std::vector<ProcCacheElement> m_Elements;
+  ProcStats                     m_Stats;
+  bool                          m_Used = false;
+};
+
+class ProcCache
+{
+  struct KeyHash
+  {
+    size_t operator()(const ProcCacheKey& k) const { return size_t(k.m_Hash[0]); }
+  };
+
+  std::unordered_map<ProcCacheKey, ProcCacheEntry, KeyHash> m_Entries;
+  unsigned m_Hits = 0;
+  unsigned m_Misses = 0;
+
+public:
+  static ProcCacheKey makeKey(StringFragment spanText, bool emitLineDirectives, CompactMode compact = CompactMode::kNone);
+
+  // Entries are never moved once added, so pointers stay valid.
+  const ProcCacheEntry* find(const ProcCacheKey& key);
+  void insert(const ProcCacheKey& key, ProcCacheEntry&& entry);
+  bool contains(const ProcCacheKey& key) const { return m_Entries.count(key) != 0; }
+
+  // Read a sidecar file. A missing or unreadable file leaves the cache empty.
+  bool load(const char* path);
+
+  // Write entries that were used or added since load(), dropping the rest.
+  bool save(const char* path) const;
+
+  // Forget entries that weren't used or added since load() or the previous
+  // prune(), for a cache kept in memory across translations.
+  void prune();
+
+  size_t size() const { return m_Entries.size(); }
+  unsigned hits() const { return m_Hits; }
+  unsigned misses() const { return m_Misses; }
+};
@@ -1,5 +1,70 @@
 #include "registers.h"
 
+#include <string.h>
+
+namespace
+{
+  // Longest list of one class of registers: "d0-d1/d3-d4/d6-d7".
+  constexpr size_t kClassListMax = 17;
+
+  struct ClassList
+  {
+    char    m_Text[kClassListMax];
+    uint8_t m_Length;
+  };
+
+  // The list for every combination of the eight registers of one class,
+  // built at compile time so formatting a movem is two copies.
+  struct ClassListTable
+  {
+    ClassList m_Lists[256];
+  };
+
+  constexpr ClassListTable makeClassListTable(char prefix)
+  {
+    ClassListTable table {};
+    for (int mask = 0; mask < 256; ++mask)
+    {
+      ClassList& list = table.m_Lists[mask];
+      size_t len = 0;
+
+      for (int first = 0; first < 8; )
+      {
+        if (0 == (mask & (1 << first)))
+        {
+          ++first;
+          continue;
+        }
+
+        int last = first;
+        while (last < 7 && (mask & (1 << (last + 1))))
+          ++last;
+
+        if (len)
+          list.m_Text[len++] = '/';
+        list.m_Text[len++] = prefix;
+        list.m_Text[len++] = char('0' + first);
+
+        if (last > first)
+        {
+          list.m_Text[len++] = '-';
+          list.m_Text[len++] = prefix;
+          list.m_Text[len++] = char('0' + last);
+        }
+
+        first = last + 1;
+      }
+
+      list.m_Length = uint8_t(len);
+    }
+    return table;
+  }
+
+  constexpr ClassListTable kDataLists = makeClassListTable('d');
+  constexpr ClassListTable kAddressLists = makeClassListTable('a');
+  static_assert(kAddressLists.m_Lists[0xdb].m_Length == kClassListMax, "longest list doesn't fit");
+}
+
 const char* regName(int index)
 {
   static const char* lut[]
@@ -19,3 +84,70 @@ const char* registerClassName(RegisterClass cls)
 {
   return cls == kAddress ? "address" : "data";
 }
+
+size_t formatRegisterList(char* out, uint32_t mask)
+{
+  const ClassList& data = kDataLists.m_Lists[mask & 0xff];
+  const ClassList& address = kAddressLists.m_Lists[(mask >> 8) & 0xff];
+
+  char* p = out;
+  memcpy(p, data.m_Text, data.m_Length);
+  p += data.m_Length;
+
+  if (data.m_Length && address.m_Length)
+    *p++ = '/';
+
+  memcpy(p, address.m_Text, address.m_Length);
+  p += address.m_Length;
+
+  return size_t(p - out);
+}
+
+// One register name at 'p', as its index, or -1.
+static int parseRegister(const char* p, const char* end)
+{
+  if (end - p < 2 || p[1] < '0' || p[1] > '7')
+    return -1;
+
+  switch (p[0])
+  {
+    case 'd': case 'D': return kDataBase + (p[1] - '0');
+    case 'a': case 'A': return kAddressBase + (p[1] - '0');
+    default:            return -1;
+  }
+}
+
+bool parseRegisterList(const char* text, size_t len, uint32_t* mask)
+{
+  const char* p = text;
+  const char* end = text + len;
+  uint32_t result = 0;
+
+  while (p < end)
+  {
+    const int first = parseRegister(p, end);
+    if (first < 0)
+      return false;
+    p += 2;
+
+    int last = first;
+    if (p < end && '-' == *p)
+    {
+      last = parseRegister(p + 1, end);
+      if (last < first || registerClass(last) != registerClass(first))
+        return false;
+      p += 3;
+    }
+
+    for (int i = first; i <= last; ++i)
+      result |= 1u << i;
+
+    if (p < end && '/' != *p++)
+      return false;
+    if (p == end && '/' == p[-1])
+      return false;
+  }
+
+  *mask = result;
+  return true;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 enum Registers
 {
   kD0 =  0, kD1 =  1, kD2 =  2, kD3 =  3,
@@ -23,3 +26,15 @@ RegisterClass registerClass(int index);
 const char* registerClassName(RegisterClass cls);
 
 const char* regName(int index);
+
+// Longest register list: "d0-d1/d3-d4/d6-d7/a0-a1/a3-a4/a6-a7".
+static constexpr size_t kRegisterListMax = 35;
+
+// Writes the registers in 'mask' (bit n for register n) as a movem list with
+// runs collapsed into ranges, e.g. "d0-d3/a0-a1". Returns the length; 'out'
+// isn't terminated.
+size_t formatRegisterList(char* out, uint32_t mask);
+
+// Reads a list in the form formatRegisterList() writes, e.g. "d0-d3/a0".
+// Ranges can't span both classes. Returns false for anything else.
+bool parseRegisterList(const char* text, size_t len, uint32_t* mask);
@@ -0,0 +1,226 @@
+#include "scan.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define D68_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define D68_SCAN_X86 0
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define D68_TARGET_AVX2
+#else
+#define D68_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static const char* findNewlineScalar(const char* p, const char* end)
+{
+  while (p != end && '\n' != *p)
+    ++p;
+  return p;
+}
+
+static const char* findAtOrSemicolonScalar(const char* p, const char* end)
+{
+  while (p != end && '@' != *p && ';' != *p)
+    ++p;
+  return p;
+}
+
+#if D68_SCAN_X86
+
+static inline unsigned lowestBit(unsigned mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return unsigned(index);
+#else
+  return unsigned(__builtin_ctz(mask));
+#endif
+}
+
+// Most lines are shorter than a vector, so the tail matters as much as the
+// main loop. The last few bytes are copied into a zeroed vector rather than
+// loaded from past 'end'; zero bytes never match what we look for.
+static inline __m128i loadTail(const char* p, const char* end)
+{
+  alignas(16) char buf[16] = {};
+  memcpy(buf, p, size_t(end - p));
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(buf));
+}
+
+static inline const char* firstHit(const char* p, const char* end, unsigned mask)
+{
+  return mask ? p + lowestBit(mask) : end;
+}
+
+static const char* findNewlineSSE2(const char* p, const char* end)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    if (mask)
+      return p + lowestBit(mask);
+    p += 16;
+  }
+
+  if (p == end)
+    return end;
+
+  __m128i v = loadTail(p, end);
+  return firstHit(p, end, unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))));
+}
+
+static const char* findAtOrSemicolonSSE2(const char* p, const char* end)
+{
+  const __m128i at = _mm_set1_epi8('@');
+  const __m128i semi = _mm_set1_epi8(';');
+
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(v, at), _mm_cmpeq_epi8(v, semi));
+    unsigned mask = unsigned(_mm_movemask_epi8(hits));
+    if (mask)
+      return p + lowestBit(mask);
+    p += 16;
+  }
+
+  if (p == end)
+    return end;
+
+  __m128i v = loadTail(p, end);
+  __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(v, at), _mm_cmpeq_epi8(v, semi));
+  return firstHit(p, end, unsigned(_mm_movemask_epi8(hits)));
+}
+
+D68_TARGET_AVX2 static const char* findNewlineAVX2(const char* p, const char* end)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+    if (mask)
+      return p + lowestBit(mask);
+    p += 32;
+  }
+
+  return findNewlineSSE2(p, end);
+}
+
+D68_TARGET_AVX2 static const char* findAtOrSemicolonAVX2(const char* p, const char* end)
+{
+  const __m256i at = _mm256_set1_epi8('@');
+  const __m256i semi = _mm256_set1_epi8(';');
+
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(v, at), _mm256_cmpeq_epi8(v, semi));
+    unsigned mask = unsigned(_mm256_movemask_epi8(hits));
+    if (mask)
+      return p + lowestBit(mask);
+    p += 32;
+  }
+
+  return findAtOrSemicolonSSE2(p, end);
+}
+
+static bool cpuHasAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // The OS has to save the YMM registers too.
+  __cpuid(info, 1);
+  const bool osxsave = 0 != (info[2] & (1 << 27));
+  if (!osxsave || (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return 0 != (info[1] & (1 << 5));
+#else
+  __builtin_cpu_init();
+  return 0 != __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static const ScanFunctions s_Implementations[] =
+{
+  { findNewlineScalar, findAtOrSemicolonScalar },
+#if D68_SCAN_X86
+  { findNewlineSSE2, findAtOrSemicolonSSE2 },
+  { findNewlineAVX2, findAtOrSemicolonAVX2 },
+#endif
+};
+
+static ScanLevel s_Level = ScanLevel::kScalar;
+
+// Until the dispatch is resolved at startup (or by a scan from some other
+// static initializer, whichever comes first), these stand in.
+static const char* findNewlineInit(const char* p, const char* end)
+{
+  setScanLevel(detectScanLevel());
+  return findNewline(p, end);
+}
+
+static const char* findAtOrSemicolonInit(const char* p, const char* end)
+{
+  setScanLevel(detectScanLevel());
+  return findAtOrSemicolon(p, end);
+}
+
+ScanFunctions g_ScanFunctions = { findNewlineInit, findAtOrSemicolonInit };
+
+// Resolved before main() so worker threads never race on the dispatch.
+static const bool s_Resolved = setScanLevel(detectScanLevel());
+
+const char* scanLevelName(ScanLevel level)
+{
+  static const char* names[] = { "scalar", "sse2", "avx2" };
+  static_assert(sizeof(names)/sizeof(names[0]) == int(ScanLevel::kCount), "bad array count");
+
+  return names[int(level)];
+}
+
+ScanLevel detectScanLevel()
+{
+#if D68_SCAN_X86
+  // SSE2 is part of x86-64.
+  return cpuHasAVX2() ? ScanLevel::kAVX2 : ScanLevel::kSSE2;
+#else
+  return ScanLevel::kScalar;
+#endif
+}
+
+ScanLevel scanLevel()
+{
+  return s_Level;
+}
+
+bool setScanLevel(ScanLevel level)
+{
+  if (int(level) > int(detectScanLevel()))
+    return false;
+
+  s_Level = level;
+  g_ScanFunctions = s_Implementations[int(level)];
+  return true;
+}
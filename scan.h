@@ -0,0 +1,50 @@
+#pragma once
+
+// Byte scanning primitives for the hot loops of the translator. Most input
+// lines contain no directives, so finding line ends and '@'/';' characters in
+// bulk is where the time goes on large files.
+//
+// The best implementation the CPU supports (AVX2, SSE2 or plain C) is picked
+// the first time a scan function is used.
+
+enum class ScanLevel
+{
+  kScalar,
+  kSSE2,
+  kAVX2,
+  kCount
+};
+
+const char* scanLevelName(ScanLevel level);
+
+// The best level this CPU can run.
+ScanLevel detectScanLevel();
+
+// The level currently used by the scan functions.
+ScanLevel scanLevel();
+
+// Force a particular implementation, for tests and benchmarks. Returns false
+// if the CPU doesn't support it. Not safe while other threads are scanning.
+bool setScanLevel(ScanLevel level);
+
+using ScanFunction = const char* (const char* p, const char* end);
+
+struct ScanFunctions
+{
+  ScanFunction* m_FindNewline;
+  ScanFunction* m_FindAtOrSemicolon;
+};
+
+extern ScanFunctions g_ScanFunctions;
+
+// First '\n' in [p, end), or end.
+inline const char* findNewline(const char* p, const char* end)
+{
+  return g_ScanFunctions.m_FindNewline(p, end);
+}
+
+// First '@' or ';' in [p, end), or end.
+inline const char* findAtOrSemicolon(const char* p, const char* end)
+{
+  return g_ScanFunctions.m_FindAtOrSemicolon(p, end);
+}
@@ -0,0 +1,588 @@
+#include "server.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "atomicfile.h"
+#include "deluxe.h"
+#include "inputfile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define D68_HAVE_UNIX_SOCKETS 1
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#else
+#define D68_HAVE_UNIX_SOCKETS 0
+#endif
+
+// Wire format
+//
+// Every message is a 4 byte magic, an 8 byte body length and the body, all
+// integers in host byte order (both ends are on the same machine).
+//
+// Request body:  u32 flags, str display name, str path, str inline text
+// Response body: u32 input failed, u32 error count, str diagnostics, str output
+//
+// where str is a u64 length followed by that many bytes. A connection can
+// carry any number of requests back to back.
+
+static constexpr uint32_t kRequestMagic  = 0x52383644; // 'D68R'
+static constexpr uint32_t kResponseMagic = 0x41383644; // 'D68A'
+
+static constexpr uint32_t kFlagLineDirectives = 1 << 0;
+static constexpr uint32_t kFlagProcSections   = 1 << 1;
+static constexpr uint32_t kFlagInline         = 1 << 2;
+static constexpr uint32_t kFlagNoAnnotations  = 1 << 3;
+static constexpr uint32_t kFlagNoComments     = 1 << 4;
+
+// The largest request body a server accepts: inline text up to the
+// translator's 4 GB input limit, plus room for the flags and names. Anything
+// longer comes from a confused or hostile client, and the connection is
+// dropped rather than allocating for it.
+static constexpr uint64_t kMaxRequestSize = (uint64_t(1) << 32) + 64 * 1024;
+
+// Responses come from the server the client chose to talk to.
+static constexpr uint64_t kMaxResponseSize = UINT64_MAX;
+
+// How long a server worker waits for a client before checking for stop().
+static constexpr int kPollIntervalMs = 100;
+
+namespace
+{
+  struct MessageWriter
+  {
+    std::string& m_Buf;
+
+    explicit MessageWriter(std::string& buf, uint32_t magic)
+      : m_Buf(buf)
+    {
+      m_Buf.clear();
+      u32(magic);
+      u64(0); // Patched by finish()
+    }
+
+    void u32(uint32_t v) { m_Buf.append(reinterpret_cast<const char*>(&v), sizeof v); }
+    void u64(uint64_t v) { m_Buf.append(reinterpret_cast<const char*>(&v), sizeof v); }
+
+    void str(const std::string& s)
+    {
+      u64(s.size());
+      m_Buf.append(s);
+    }
+
+    void finish()
+    {
+      uint64_t bodyLen = m_Buf.size() - sizeof(uint32_t) - sizeof(uint64_t);
+      memcpy(&m_Buf[sizeof(uint32_t)], &bodyLen, sizeof bodyLen);
+    }
+  };
+
+  struct MessageReader
+  {
+    const char* m_Ptr;
+    const char* m_End;
+    bool        m_Ok = true;
+
+    explicit MessageReader(const std::string& body)
+      : m_Ptr(body.data())
+      , m_End(body.data() + body.size())
+    {}
+
+    template <typename T>
+    T read()
+    {
+      T v = T();
+      if (size_t(m_End - m_Ptr) < sizeof v)
+      {
+        m_Ok = false;
+        return v;
+      }
+      memcpy(&v, m_Ptr, sizeof v);
+      m_Ptr += sizeof v;
+      return v;
+    }
+
+    uint32_t u32() { return read<uint32_t>(); }
+    uint64_t u64() { return read<uint64_t>(); }
+
+    void str(std::string* out)
+    {
+      uint64_t len = u64();
+      if (!m_Ok || uint64_t(m_End - m_Ptr) < len)
+      {
+        m_Ok = false;
+        out->clear();
+        return;
+      }
+      out->assign(m_Ptr, size_t(len));
+      m_Ptr += len;
+    }
+  };
+
+  void appendToString(const char* buf, size_t len, void* user_data)
+  {
+    static_cast<std::string*>(user_data)->append(buf, len);
+  }
+
+  void encodeRequest(const ServerRequest& request, std::string& buf)
+  {
+    uint32_t flags = 0;
+    if (request.m_EmitLineDirectives)
+      flags |= kFlagLineDirectives;
+    if (request.m_ProcSections)
+      flags |= kFlagProcSections;
+    if (request.m_Inline)
+      flags |= kFlagInline;
+    if (CompactMode::kNoAnnotations == request.m_Compact)
+      flags |= kFlagNoAnnotations;
+    if (CompactMode::kNoComments == request.m_Compact)
+      flags |= kFlagNoComments;
+
+    MessageWriter w(buf, kRequestMagic);
+    w.u32(flags);
+    w.str(request.m_DisplayName);
+    w.str(request.m_Path);
+    w.str(request.m_Text);
+    w.finish();
+  }
+
+  bool decodeRequest(const std::string& body, ServerRequest* request)
+  {
+    MessageReader r(body);
+    uint32_t flags = r.u32();
+    request->m_EmitLineDirectives = 0 != (flags & kFlagLineDirectives);
+    request->m_ProcSections = 0 != (flags & kFlagProcSections);
+    request->m_Inline = 0 != (flags & kFlagInline);
+    if (flags & kFlagNoComments)
+      request->m_Compact = CompactMode::kNoComments;
+    else if (flags & kFlagNoAnnotations)
+      request->m_Compact = CompactMode::kNoAnnotations;
+    else
+      request->m_Compact = CompactMode::kNone;
+    r.str(&request->m_DisplayName);
+    r.str(&request->m_Path);
+    r.str(&request->m_Text);
+    return r.m_Ok;
+  }
+
+  void encodeResponse(const ServerResponse& response, std::string& buf)
+  {
+    MessageWriter w(buf, kResponseMagic);
+    w.u32(response.m_InputFailed ? 1 : 0);
+    w.u32(uint32_t(response.m_ErrorCount));
+    w.str(response.m_Diagnostics);
+    w.str(response.m_Output);
+    w.finish();
+  }
+
+  bool decodeResponse(const std::string& body, ServerResponse* response)
+  {
+    MessageReader r(body);
+    response->m_InputFailed = 0 != r.u32();
+    response->m_ErrorCount = int(r.u32());
+    r.str(&response->m_Diagnostics);
+    r.str(&response->m_Output);
+    return r.m_Ok;
+  }
+}
+
+void translateRequest(const ServerRequest& request, ServerResponse* response, Deluxe68* translator)
+{
+  response->m_InputFailed = false;
+  response->m_ErrorCount = 0;
+  response->m_Diagnostics.clear();
+  response->m_Output.clear();
+
+  InputFile file;
+  const char* data = request.m_Text.data();
+  size_t len = request.m_Text.size();
+
+  if (!request.m_Inline)
+  {
+    if (!file.open(request.m_Path.c_str()))
+    {
+      response->m_InputFailed = true;
+      response->m_Diagnostics = "can't open " + request.m_Path + " for reading\n";
+      return;
+    }
+
+    data = file.data();
+    len = file.size();
+  }
+
+  Deluxe68 local;
+  Deluxe68& d = translator ? *translator : local;
+  d.reset(request.m_DisplayName.c_str(), data, len, request.m_EmitLineDirectives, request.m_ProcSections);
+  d.setCompactMode(request.m_Compact);
+  d.setDiagnosticCallback(appendToString, &response->m_Diagnostics);
+  d.run();
+
+  response->m_ErrorCount = d.errorCount();
+
+  if (0 == response->m_ErrorCount)
+  {
+    StringSink sink(&response->m_Output);
+    d.generateOutput(sink);
+  }
+}
+
+#if D68_HAVE_UNIX_SOCKETS
+
+static bool writeAll(int fd, const char* data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = ::write(fd, data, len);
+    if (n < 0)
+    {
+      if (EINTR == errno)
+        continue;
+      return false;
+    }
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+// With 'stop' set, waits for data in slices and gives up once *stop is, so a
+// client that connects and goes quiet can't hold up stop().
+static bool readAll(int fd, char* data, size_t len, const std::atomic<int>* stop = nullptr)
+{
+  while (len > 0)
+  {
+    if (stop)
+    {
+      pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+
+      int ready = poll(&pfd, 1, kPollIntervalMs);
+      if (*stop)
+        return false;
+      if (ready < 0 && EINTR != errno)
+        return false;
+      if (ready <= 0)
+        continue;
+    }
+
+    ssize_t n = ::read(fd, data, len);
+    if (n < 0)
+    {
+      if (EINTR == errno)
+        continue;
+      return false;
+    }
+    if (0 == n)
+      return false;
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+// Read one framed message into 'body'. Returns false on EOF, error, a body
+// longer than 'maxLen', or once *stop is set (see readAll()).
+static bool readMessage(int fd, uint32_t expectedMagic, uint64_t maxLen, std::string& body, const std::atomic<int>* stop = nullptr)
+{
+  char header[sizeof(uint32_t) + sizeof(uint64_t)];
+  if (!readAll(fd, header, sizeof header, stop))
+    return false;
+
+  uint32_t magic;
+  uint64_t len;
+  memcpy(&magic, header, sizeof magic);
+  memcpy(&len, header + sizeof magic, sizeof len);
+
+  if (magic != expectedMagic || len > maxLen || len > SIZE_MAX)
+    return false;
+
+  body.resize(size_t(len));
+  return readAll(fd, &body[0], body.size(), stop);
+}
+
+static bool makeAddress(const char* socketPath, sockaddr_un* addr)
+{
+  memset(addr, 0, sizeof *addr);
+  addr->sun_family = AF_UNIX;
+
+  if (strlen(socketPath) >= sizeof(addr->sun_path))
+    return false;
+
+  strcpy(addr->sun_path, socketPath);
+  return true;
+}
+
+static int connectTo(const char* socketPath)
+{
+  sockaddr_un addr;
+  if (!makeAddress(socketPath, &addr))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (0 != connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr))
+  {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+TranslationServer::TranslationServer()
+  : m_Stop(0)
+{
+  // A client going away mid-response must not take the server down.
+  signal(SIGPIPE, SIG_IGN);
+}
+
+TranslationServer::~TranslationServer()
+{
+  if (m_ListenFd >= 0)
+  {
+    close(m_ListenFd);
+    unlink(m_SocketPath.c_str());
+  }
+}
+
+bool TranslationServer::listen(const char* socketPath)
+{
+  sockaddr_un addr;
+  if (!makeAddress(socketPath, &addr))
+  {
+    fprintf(stderr, "socket path too long: %s\n", socketPath);
+    return false;
+  }
+
+  // Refuse to steal the socket from a live server, but clean up after a dead one.
+  int probe = connectTo(socketPath);
+  if (probe >= 0)
+  {
+    close(probe);
+    fprintf(stderr, "%s: a server is already listening\n", socketPath);
+    return false;
+  }
+  unlink(socketPath);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    perror("socket");
+    return false;
+  }
+
+  if (0 != bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) || 0 != ::listen(fd, 64))
+  {
+    fprintf(stderr, "%s: can't listen: %s\n", socketPath, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  // Workers race to accept, so losers must not block.
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  m_SocketPath = socketPath;
+  m_ListenFd = fd;
+  return true;
+}
+
+void TranslationServer::run(int threadCount)
+{
+  if (threadCount <= 0)
+  {
+    threadCount = static_cast<int>(std::thread::hardware_concurrency());
+    if (threadCount <= 0)
+      threadCount = 1;
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < threadCount; ++i)
+  {
+    threads.emplace_back([this]() { workerLoop(); });
+  }
+
+  workerLoop();
+
+  for (std::thread& t : threads)
+  {
+    t.join();
+  }
+}
+
+void TranslationServer::stop()
+{
+  m_Stop = 1;
+}
+
+void TranslationServer::workerLoop()
+{
+  // Kept across requests so steady state serving doesn't reallocate.
+  std::string message;
+  ServerRequest request;
+  ServerResponse response;
+  Deluxe68 translator;
+
+  while (!m_Stop)
+  {
+    pollfd pfd;
+    pfd.fd = m_ListenFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    // Wake up regularly to notice stop().
+    if (poll(&pfd, 1, kPollIntervalMs) <= 0)
+      continue;
+
+    int fd = accept(m_ListenFd, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    while (!m_Stop && readMessage(fd, kRequestMagic, kMaxRequestSize, message, &m_Stop))
+    {
+      if (!decodeRequest(message, &request))
+        break;
+
+      translateRequest(request, &response, &translator);
+      encodeResponse(response, message);
+
+      if (!writeAll(fd, message.data(), message.size()))
+        break;
+    }
+
+    close(fd);
+  }
+}
+
+bool sendServerRequest(const char* socketPath, const ServerRequest& request, ServerResponse* response)
+{
+  int fd = connectTo(socketPath);
+  if (fd < 0)
+    return false;
+
+  std::string message;
+  encodeRequest(request, message);
+
+  bool ok =
+    writeAll(fd, message.data(), message.size()) &&
+    readMessage(fd, kResponseMagic, kMaxResponseSize, message) &&
+    decodeResponse(message, response);
+
+  close(fd);
+  return ok;
+}
+
+bool translateFileViaServer(const char* socketPath, const char* input, const char* output, const DriverOptions& options, int* exitCode)
+{
+  if (0 == strcmp("-", input) || 0 == strcmp("-", output))
+    return false;
+
+  // The server doesn't share our working directory.
+  char absPath[PATH_MAX];
+  if (!realpath(input, absPath))
+    return false;
+
+  ServerRequest request;
+  request.m_EmitLineDirectives = options.m_EmitLineDirectives;
+  request.m_ProcSections = options.m_ProcSections;
+  request.m_Compact = options.m_Compact;
+  request.m_DisplayName = input;
+  request.m_Path = absPath;
+
+  ServerResponse response;
+  if (!sendServerRequest(socketPath, request, &response))
+    return false;
+
+  fwrite(response.m_Diagnostics.data(), 1, response.m_Diagnostics.size(), stderr);
+
+  if (response.m_InputFailed)
+  {
+    *exitCode = 1;
+    return true;
+  }
+
+  if (response.m_ErrorCount)
+  {
+    fprintf(stderr, "%s: exiting without writing output - %d errors\n", input, response.m_ErrorCount);
+    *exitCode = 1;
+    return true;
+  }
+
+  AtomicFile f;
+  if (!f.open(output))
+  {
+    fprintf(stderr, "can't open %s for writing\n", output);
+    *exitCode = 1;
+    return true;
+  }
+
+  fwrite(response.m_Output.data(), 1, response.m_Output.size(), f.file());
+
+  if (!f.commit(options.m_WriteIfChanged))
+  {
+    fprintf(stderr, "can't write %s\n", output);
+    *exitCode = 1;
+    return true;
+  }
+
+  *exitCode = writeDepFile(input, output, options) ? 0 : 1;
+  return true;
+}
+
+#else
+
+TranslationServer::TranslationServer()
+  : m_Stop(0)
+{
+}
+
+TranslationServer::~TranslationServer()
+{
+}
+
+bool TranslationServer::listen(const char* socketPath)
+{
+  fprintf(stderr, "the translation server isn't supported on this platform\n");
+  return false;
+}
+
+void TranslationServer::run(int threadCount)
+{
+}
+
+void TranslationServer::stop()
+{
+  m_Stop = 1;
+}
+
+void TranslationServer::workerLoop()
+{
+}
+
+bool sendServerRequest(const char* socketPath, const ServerRequest& request, ServerResponse* response)
+{
+  return false;
+}
+
+bool translateFileViaServer(const char* socketPath, const char* input, const char* output, const DriverOptions& options, int* exitCode)
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "driver.h"
+
+class Deluxe68;
+
+// A long lived translation server listening on a Unix domain socket.
+//
+// Starting deluxe68 costs more than translating a typical file, so build
+// loops can instead keep a server running and have the regular command line
+// forward its work to it (see translateFileViaServer). Only supported on
+// platforms with Unix domain sockets.
+
+struct ServerRequest
+{
+  bool        m_EmitLineDirectives = false;
+  bool        m_ProcSections = false;
+  CompactMode m_Compact = CompactMode();  // kNone
+  bool        m_Inline = false;   // Translate m_Text rather than reading m_Path
+  std::string m_DisplayName;      // File name used in diagnostics and tbl_line
+  std::string m_Path;
+  std::string m_Text;
+};
+
+struct ServerResponse
+{
+  bool        m_InputFailed = false;  // The server couldn't read m_Path
+  int         m_ErrorCount = 0;
+  std::string m_Diagnostics;
+  std::string m_Output;               // Empty if there were errors
+};
+
+class TranslationServer
+{
+  std::string      m_SocketPath;
+  int              m_ListenFd = -1;
+  std::atomic<int> m_Stop;
+
+public:
+  TranslationServer();
+  ~TranslationServer();
+
+  TranslationServer(const TranslationServer&) = delete;
+  TranslationServer& operator=(const TranslationServer&) = delete;
+
+  // Bind to 'socketPath', replacing a stale socket file if one is left over.
+  bool listen(const char* socketPath);
+
+  // Serve requests until stop() is called. Connections are handled by
+  // 'threadCount' workers (0 = one per core), each of which keeps its buffers
+  // warm between requests.
+  void run(int threadCount);
+
+  // Ask run() to return. Safe to call from any thread or a signal handler.
+  void stop();
+
+private:
+  void workerLoop();
+};
+
+// Translate one request in-process, exactly as the server would. A translator
+// passed in is reset() and used instead of a new one.
+void translateRequest(const ServerRequest& request, ServerResponse* response, Deluxe68* translator = nullptr);
+
+// Send a request to the server at 'socketPath' and wait for the answer.
+// Returns false if the server couldn't be reached or the exchange failed.
+bool sendServerRequest(const char* socketPath, const ServerRequest& request, ServerResponse* response);
+
+// Drop-in for translateFile() that lets the server do the work. Returns false
+// if the server can't be reached, in which case the caller should translate
+// locally. Otherwise *exitCode receives what translateFile() would return.
+bool translateFileViaServer(const char* socketPath, const char* input, const char* output, const DriverOptions& options, int* exitCode);
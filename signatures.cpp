@@ -0,0 +1,118 @@
+#include "signatures.h"
+#include "hash.h"
+#include "inputfile.h"
+#include "registers.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  bool isSpace(char c)
+  {
+    return ' ' == c || '\t' == c || '\r' == c;
+  }
+
+  // The next whitespace separated field of 'line', advancing past it.
+  StringFragment nextField(const char** p, const char* end)
+  {
+    while (*p < end && isSpace(**p))
+      ++*p;
+
+    const char* start = *p;
+    while (*p < end && !isSpace(**p))
+      ++*p;
+
+    return StringFragment(start, size_t(*p - start));
+  }
+
+  bool parseMask(StringFragment field, uint32_t* mask)
+  {
+    if (StringFragment("-") == field)
+    {
+      *mask = 0;
+      return true;
+    }
+
+    return field && parseRegisterList(field.ptr(), field.size(), mask);
+  }
+
+  void appendMask(std::string* out, uint32_t mask)
+  {
+    char list[kRegisterListMax];
+    size_t len = formatRegisterList(list, mask);
+    if (len)
+      out->append(list, len);
+    else
+      out->push_back('-');
+  }
+}
+
+bool SignatureDb::load(const char* path)
+{
+  InputFile file;
+  if (!file.open(path))
+  {
+    fprintf(stderr, "can't open %s for reading\n", path);
+    return false;
+  }
+
+  m_Paths.push_back(path);
+  return parse(path, file.data(), file.size());
+}
+
+bool SignatureDb::parse(const char* name, const char* data, size_t len)
+{
+  m_Fingerprint = hash64(data, len, m_Fingerprint ^ 0x9e3779b97f4a7c15ull);
+
+  const char* p = data;
+  const char* end = data + len;
+  int lineNumber = 0;
+
+  while (p < end)
+  {
+    const char* nl = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+    if (!nl)
+      nl = end;
+
+    const char* cursor = p;
+    p = nl + 1;
+    ++lineNumber;
+
+    StringFragment procName = nextField(&cursor, nl);
+    if (!procName || ';' == procName[0])
+      continue;
+
+    ProcSignature signature;
+    if (!parseMask(nextField(&cursor, nl), &signature.m_InputRegs) ||
+        !parseMask(nextField(&cursor, nl), &signature.m_Clobbers) ||
+        nextField(&cursor, nl))
+    {
+      fprintf(stderr, "%s(%d): expected <name> <input registers> <clobbered registers>\n", name, lineNumber);
+      return false;
+    }
+
+    SymbolId id = m_Names.intern(procName);
+    if (id >= m_Signatures.size())
+      m_Signatures.resize(m_Names.size());
+    m_Signatures[id] = signature;
+  }
+
+  return true;
+}
+
+const ProcSignature* SignatureDb::find(StringFragment name) const
+{
+  SymbolId id = m_Names.find(name);
+  return kNoSymbol != id ? &m_Signatures[id] : nullptr;
+}
+
+void formatSignature(std::string* out, StringFragment name, const ProcSignature& signature)
+{
+  out->append(name.ptr(), name.size());
+  out->push_back(' ');
+  appendMask(out, signature.m_InputRegs);
+  out->push_back(' ');
+  appendMask(out, signature.m_Clobbers);
+  out->push_back('\n');
+}
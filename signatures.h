@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "stringfragment.h"
+#include "symboltable.h"
+
+// What a caller in another file needs to know about a procedure: the
+// registers it takes arguments in, and the ones it doesn't give back as it
+// found them.
+struct ProcSignature
+{
+  uint32_t m_InputRegs = 0;
+  uint32_t m_Clobbers = 0;
+};
+
+// Procedure signatures exported from other translation units (--export),
+// consulted by @call. Names are interned into a SymbolTable, so a lookup is
+// one hash probe no matter how many procedures are loaded.
+//
+// Signature files have a line per procedure:
+//
+//   <name> <input registers> <clobbered registers>
+//
+// with registers written as movem lists ("d0-d1/a0") and "-" for none. Blank
+// lines and lines starting with ';' are skipped.
+class SignatureDb
+{
+  SymbolTable                m_Names;
+  std::vector<ProcSignature> m_Signatures;   // Indexed by SymbolId
+  std::vector<std::string>   m_Paths;
+  uint64_t                   m_Fingerprint = 0;
+
+public:
+  // Adds the signatures in a file; a name seen before takes its new
+  // signature. Problems are reported on stderr.
+  bool load(const char* path);
+
+  // The same for text already in memory. 'name' is for error messages.
+  bool parse(const char* name, const char* data, size_t len);
+
+  const ProcSignature* find(StringFragment name) const;
+
+  size_t size() const { return m_Names.size(); }
+
+  // The files loaded, for dependency files.
+  const std::vector<std::string>& paths() const { return m_Paths; }
+
+  // Changes with everything parsed, so translations cached with one set of
+  // signatures aren't reused with another.
+  uint64_t fingerprint() const { return m_Fingerprint; }
+};
+
+// The first line of every signature file.
+static constexpr char kSignatureFileHeader[] = "; deluxe68 procedure signatures\n";
+
+// Appends the line for one procedure.
+void formatSignature(std::string* out, StringFragment name, const ProcSignature& signature);
@@ -0,0 +1,188 @@
+#include "stats.h"
+
+#include <stdarg.h>
+
+#include "registers.h"
+
+namespace
+{
+  void appendf(std::string* out, const char* fmt, ...)
+  {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+
+    if (len > 0)
+      out->append(buf, size_t(len) < sizeof buf ? size_t(len) : sizeof buf - 1);
+  }
+
+  void appendJsonString(std::string* out, const char* s)
+  {
+    out->push_back('"');
+    for (; *s; ++s)
+    {
+      unsigned char ch = (unsigned char)*s;
+      if ('"' == ch || '\\' == ch)
+      {
+        out->push_back('\\');
+        out->push_back(char(ch));
+      }
+      else if (ch < 0x20)
+      {
+        appendf(out, "\\u%04x", ch);
+      }
+      else
+      {
+        out->push_back(char(ch));
+      }
+    }
+    out->push_back('"');
+  }
+
+  int registerCount(uint32_t mask)
+  {
+    int count = 0;
+    for (; mask; mask &= mask - 1)
+      ++count;
+    return count;
+  }
+
+  std::string registerList(uint32_t mask)
+  {
+    char list[kRegisterListMax];
+    return std::string(list, formatRegisterList(list, mask));
+  }
+
+  // Directives are the keywords that can follow '@' at the start of a line.
+  bool isDirective(TokenType type)
+  {
+    switch (type)
+    {
+      case TokenType::kAreg:
+      case TokenType::kDreg:
+      case TokenType::kKill:
+      case TokenType::kReserve:
+      case TokenType::kUnreserve:
+      case TokenType::kProc:
+      case TokenType::kCProc:
+      case TokenType::kEndProc:
+      case TokenType::kSpill:
+      case TokenType::kRestore:
+      case TokenType::kRename:
+      case TokenType::kCall:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  double toMs(double seconds)
+  {
+    return seconds * 1000.0;
+  }
+
+  double load(const TranslationStats& stats)
+  {
+    return stats.m_SymbolSlots ? double(stats.m_Symbols) / stats.m_SymbolSlots : 0.0;
+  }
+}
+
+static void formatText(std::string* out, const char* inputName, const TranslationStats& stats)
+{
+  appendf(out, "%s:\n", inputName);
+
+  if (stats.m_CacheHit)
+  {
+    appendf(out, "  taken from the translation cache in %.3f ms\n", toMs(stats.m_ReadTime));
+    return;
+  }
+
+  const double totalTime = stats.m_ReadTime + stats.m_RunTime + stats.m_OutputTime;
+  appendf(out, "  time         read %.3f ms, run %.3f ms, output %.3f ms", toMs(stats.m_ReadTime), toMs(stats.m_RunTime), toMs(stats.m_OutputTime));
+  if (totalTime > 0.0)
+    appendf(out, " (%.1f MB/s)", stats.m_InputBytes / totalTime / (1024.0 * 1024.0));
+  out->push_back('\n');
+
+  appendf(out, "  input        %llu bytes, %llu lines, %llu procedures\n",
+      (unsigned long long) stats.m_InputBytes, (unsigned long long) stats.m_Lines, (unsigned long long) stats.m_Procedures);
+
+  out->append("  directives  ");
+  bool any = false;
+  for (size_t i = 0; i < size_t(TokenType::kCount); ++i)
+  {
+    if (stats.m_Directives[i])
+    {
+      appendf(out, " %s %llu", tokenTypeName(TokenType(i)), (unsigned long long) stats.m_Directives[i]);
+      any = true;
+    }
+  }
+  out->append(any ? "\n" : " none\n");
+
+  appendf(out, "  output       %llu elements, %llu bytes\n", (unsigned long long) stats.m_OutputElements, (unsigned long long) stats.m_BytesWritten);
+  appendf(out, "  references   %llu @names, %llu spills, %llu restores\n",
+      (unsigned long long) stats.m_NameReferences, (unsigned long long) stats.m_Spills, (unsigned long long) stats.m_Restores);
+  appendf(out, "  names        %u interned, peak %u live, hash load %.2f (%u slots)\n",
+      stats.m_Symbols, stats.m_PeakLiveNames, load(stats), stats.m_SymbolSlots);
+
+  if (stats.m_LargestSaveMask)
+  {
+    appendf(out, "  largest save %d registers in %s (%s)\n",
+        registerCount(stats.m_LargestSaveMask), stats.m_LargestSaveProc.c_str(), registerList(stats.m_LargestSaveMask).c_str());
+  }
+}
+
+static void formatJson(std::string* out, const char* inputName, const TranslationStats& stats)
+{
+  out->append("{\"file\":");
+  appendJsonString(out, inputName);
+
+  if (stats.m_CacheHit)
+  {
+    appendf(out, ",\"cache_hit\":true,\"read_ms\":%.3f}\n", toMs(stats.m_ReadTime));
+    return;
+  }
+
+  appendf(out, ",\"cache_hit\":false,\"read_ms\":%.3f,\"run_ms\":%.3f,\"output_ms\":%.3f",
+      toMs(stats.m_ReadTime), toMs(stats.m_RunTime), toMs(stats.m_OutputTime));
+  appendf(out, ",\"input_bytes\":%llu,\"lines\":%llu,\"procedures\":%llu",
+      (unsigned long long) stats.m_InputBytes, (unsigned long long) stats.m_Lines, (unsigned long long) stats.m_Procedures);
+
+  out->append(",\"directives\":{");
+  bool first = true;
+  for (size_t i = 0; i < size_t(TokenType::kCount); ++i)
+  {
+    // Every directive is listed so consumers see a fixed shape; anything
+    // else after an '@' is only listed if it occurred.
+    if (!isDirective(TokenType(i)) && !stats.m_Directives[i])
+      continue;
+
+    appendf(out, "%s\"%s\":%llu", first ? "" : ",", tokenTypeName(TokenType(i)), (unsigned long long) stats.m_Directives[i]);
+    first = false;
+  }
+  out->push_back('}');
+
+  appendf(out, ",\"output_elements\":%llu,\"bytes_written\":%llu", (unsigned long long) stats.m_OutputElements, (unsigned long long) stats.m_BytesWritten);
+  appendf(out, ",\"name_references\":%llu,\"spills\":%llu,\"restores\":%llu",
+      (unsigned long long) stats.m_NameReferences, (unsigned long long) stats.m_Spills, (unsigned long long) stats.m_Restores);
+  appendf(out, ",\"symbols\":%u,\"symbol_slots\":%u,\"symbol_load\":%.4f,\"peak_live_names\":%u",
+      stats.m_Symbols, stats.m_SymbolSlots, load(stats), stats.m_PeakLiveNames);
+
+  out->append(",\"largest_save_set\":{\"proc\":");
+  appendJsonString(out, stats.m_LargestSaveProc.c_str());
+  appendf(out, ",\"registers\":%d,\"list\":\"%s\"}}\n", registerCount(stats.m_LargestSaveMask), registerList(stats.m_LargestSaveMask).c_str());
+}
+
+void printStats(FILE* f, const char* inputName, const TranslationStats& stats, bool json)
+{
+  std::string text;
+
+  if (json)
+    formatJson(&text, inputName, stats);
+  else
+    formatText(&text, inputName, stats);
+
+  fwrite(text.data(), 1, text.size(), f);
+  fflush(f);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "tokenizer.h"
+
+// What --stats reports for one translation. The translator fills in the
+// counters (see Deluxe68::setStats()), the driver the timings and sizes.
+struct TranslationStats
+{
+  // Wall time of each phase, in seconds. With streaming output most of the
+  // writing happens during run().
+  double      m_ReadTime = 0.0;
+  double      m_RunTime = 0.0;
+  double      m_OutputTime = 0.0;
+
+  uint64_t    m_InputBytes = 0;
+  uint64_t    m_BytesWritten = 0;
+  bool        m_CacheHit = false;     // Nothing was translated
+
+  uint64_t    m_Lines = 0;
+  uint64_t    m_Directives[size_t(TokenType::kCount)] = {};
+  uint64_t    m_OutputElements = 0;
+  uint64_t    m_NameReferences = 0;   // @name uses in code
+  uint64_t    m_Spills = 0;           // movem.l from @spill
+  uint64_t    m_Restores = 0;         // movem.l from @restore
+  uint64_t    m_Procedures = 0;
+
+  uint32_t    m_PeakLiveNames = 0;
+  uint32_t    m_Symbols = 0;
+  uint32_t    m_SymbolSlots = 0;      // Hash table size
+
+  // The procedure saving the most registers on entry.
+  uint32_t    m_LargestSaveMask = 0;
+  std::string m_LargestSaveProc;
+};
+
+// The counts a procedure's translation adds that can't be read back off its
+// output schedule: the peak number of live names, and directives that
+// weren't echoed (see CompactMode). Kept with cached translations, so that
+// replaying one reports the same as translating it.
+struct ProcStats
+{
+  uint32_t    m_PeakLiveNames = 0;
+  uint32_t    m_Directives[size_t(TokenType::kCount)] = {};
+};
+
+// Write 'stats' for 'inputName' with a single call, as a few lines of text or
+// as one line of JSON.
+void printStats(FILE* f, const char* inputName, const TranslationStats& stats, bool json);
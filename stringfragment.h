@@ -36,10 +36,13 @@ public:
   // Int is convenient for %.* style printfs
   int length() const { return static_cast<int>(m_Len); }
 
+  // Full width length, for anything that can span more than a line.
+  size_t size() const { return m_Len; }
+
   const char* ptr() const { return m_Ptr; }
 
   const char* begin() const { return ptr(); }
-  const char* end() const { return ptr() + length(); }
+  const char* end() const { return ptr() + m_Len; }
 
   StringFragment slice(size_t count)
   {
@@ -0,0 +1,144 @@
+#include "symboltable.h"
+
+SymbolTable::SymbolTable()
+  : m_Slots(&m_Arena)
+  , m_Names(&m_Arena)
+{
+  initSlots(kInitialCapacity);
+}
+
+void SymbolTable::initSlots(size_t capacity)
+{
+  m_Slots.resize(capacity);
+  for (Slot& slot : m_Slots)
+    slot = Slot { 0, kNoSymbol };
+}
+
+static inline uint64_t load64(const char* p)
+{
+  uint64_t w;
+  memcpy(&w, p, sizeof w);
+  return w;
+}
+
+static inline uint64_t load32(const char* p)
+{
+  uint32_t w;
+  memcpy(&w, p, sizeof w);
+  return w;
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t w)
+{
+  h = (h ^ w) * 0xff51afd7ed558ccdull;
+  return h ^ (h >> 29);
+}
+
+uint32_t SymbolTable::hashName(StringFragment name)
+{
+  // Eight bytes per step. Tails are read with overlapping fixed size loads
+  // rather than byte by byte; names are rarely longer than two words.
+  const char* p = name.ptr();
+  const size_t len = name.size();
+  uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+
+  if (len >= 8)
+  {
+    const char* last = p + len - 8;
+    for (; p < last; p += 8)
+      h = mix(h, load64(p));
+    h = mix(h, load64(last));
+  }
+  else if (len >= 4)
+  {
+    h = mix(h, load32(p) | load32(p + len - 4) << 32);
+  }
+  else if (len > 0)
+  {
+    h = mix(h, uint64_t(uint8_t(p[0])) | uint64_t(uint8_t(p[len >> 1])) << 8 | uint64_t(uint8_t(p[len - 1])) << 16);
+  }
+
+  h *= 0xc4ceb9fe1a85ec53ull;
+  return uint32_t(h >> 32);
+}
+
+SymbolId SymbolTable::intern(StringFragment name)
+{
+  const uint32_t hash = hashName(name);
+  const size_t mask = m_Slots.size() - 1;
+
+  for (size_t i = hash & mask; ; i = (i + 1) & mask)
+  {
+    Slot& slot = m_Slots[i];
+
+    if (kNoSymbol == slot.m_Id)
+    {
+      SymbolId id = SymbolId(m_Names.size());
+      m_Names.push_back(m_Arena.copy(name));
+      slot.m_Hash = hash;
+      slot.m_Id = id;
+
+      // Keep the load factor at or below one half.
+      if (m_Names.size() * 2 > m_Slots.size())
+        grow();
+
+      return id;
+    }
+
+    if (slot.m_Hash == hash && m_Names[slot.m_Id] == name)
+      return slot.m_Id;
+  }
+}
+
+SymbolId SymbolTable::find(StringFragment name) const
+{
+  const uint32_t hash = hashName(name);
+  const size_t mask = m_Slots.size() - 1;
+
+  for (size_t i = hash & mask; ; i = (i + 1) & mask)
+  {
+    const Slot& slot = m_Slots[i];
+
+    if (kNoSymbol == slot.m_Id)
+      return kNoSymbol;
+
+    if (slot.m_Hash == hash && m_Names[slot.m_Id] == name)
+      return slot.m_Id;
+  }
+}
+
+void SymbolTable::clear()
+{
+  const size_t capacity = m_Slots.size();
+  const size_t nameCapacity = m_Names.capacity();
+
+  m_Slots.release();
+  m_Names.release();
+  m_Arena.clear();
+
+  initSlots(capacity);
+  m_Names.reserve(nameCapacity);
+}
+
+void SymbolTable::grow()
+{
+  ArenaArray<Slot> slots(&m_Arena);
+  slots.resize(m_Slots.size() * 2);
+  for (Slot& slot : slots)
+    slot = Slot { 0, kNoSymbol };
+
+  const size_t mask = slots.size() - 1;
+
+  for (const Slot& slot : m_Slots)
+  {
+    if (kNoSymbol == slot.m_Id)
+      continue;
+
+    size_t i = slot.m_Hash & mask;
+    while (kNoSymbol != slots[i].m_Id)
+      i = (i + 1) & mask;
+    slots[i] = slot;
+  }
+
+  m_Slots.swap(slots);
+}
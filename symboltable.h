@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "stringfragment.h"
+#include "arena.h"
+
+using SymbolId = uint32_t;
+
+static constexpr SymbolId kNoSymbol = ~SymbolId(0);
+
+// Interns names into dense integer IDs, starting from 0, so state kept per
+// name can live in flat arrays indexed by ID instead of hash maps keyed on
+// strings. The table keeps its own copy of every name.
+//
+// Lookups use open addressing with linear probing over (hash, id) pairs, so a
+// miss or a hit usually touches one cache line before the final compare.
+//
+// The slots, the name list and the names themselves all live in one Arena,
+// so a table that has been used once and cleared interns the same number of
+// names again without going to the heap.
+class SymbolTable
+{
+  struct Slot
+  {
+    uint32_t m_Hash;
+    SymbolId m_Id;
+  };
+
+  static constexpr size_t kInitialCapacity = 64;
+
+  Arena                      m_Arena;
+  ArenaArray<Slot>           m_Slots;
+  ArenaArray<StringFragment> m_Names;
+
+public:
+  SymbolTable();
+
+  // The ID for 'name', adding it if it's new.
+  SymbolId intern(StringFragment name);
+
+  // The ID for 'name', or kNoSymbol.
+  SymbolId find(StringFragment name) const;
+
+  StringFragment name(SymbolId id) const { return m_Names[id]; }
+
+  size_t size() const { return m_Names.size(); }
+  size_t capacity() const { return m_Slots.size(); }
+
+  // Forget all names, keeping the allocated space.
+  void clear();
+
+  static uint32_t hashName(StringFragment name);
+
+private:
+  void initSlots(size_t capacity);
+  void grow();
+};
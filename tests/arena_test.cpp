@@ -0,0 +1,74 @@
+#include "arena.h"
+#include "gtest/gtest.h"
+
+TEST(Arena, ClearKeepsOneBlock)
+{
+  Arena arena;
+  for (int i = 0; i < 100; ++i)
+    arena.allocate(16 * 1024, 8);
+
+  EXPECT_LT(1u, arena.blockCount());
+  const size_t reserved = arena.bytesReserved();
+
+  arena.clear();
+  EXPECT_EQ(1u, arena.blockCount());
+  EXPECT_EQ(reserved, arena.bytesReserved());
+
+  // The same amount again fits in the one block.
+  for (int i = 0; i < 100; ++i)
+    arena.allocate(16 * 1024, 8);
+  EXPECT_EQ(1u, arena.blockCount());
+}
+
+TEST(Arena, AlignsAndCopies)
+{
+  Arena arena;
+  arena.allocate(3, 1);
+  void* p = arena.allocate(8, 8);
+  EXPECT_EQ(0u, uintptr_t(p) & 7);
+
+  char text[] = "spilled";
+  StringFragment copy = arena.copy(StringFragment(text));
+  text[0] = 'x';
+  EXPECT_EQ(StringFragment("spilled"), copy);
+  EXPECT_FALSE(arena.copy(StringFragment()));
+}
+
+TEST(ArenaArray, GrowsAndKeepsContents)
+{
+  Arena arena;
+  ArenaArray<uint32_t> a(&arena);
+  ArenaArray<uint32_t> b(&arena);
+
+  for (uint32_t i = 0; i < 10000; ++i)
+  {
+    a.push_back(i);
+    b.push_back(~i);
+  }
+
+  ASSERT_EQ(10000u, a.size());
+  for (uint32_t i = 0; i < 10000; ++i)
+  {
+    ASSERT_EQ(i, a[i]);
+    ASSERT_EQ(~i, b[i]);
+  }
+
+  b.resize(20000);
+  EXPECT_EQ(0u, b[19999]);
+  EXPECT_EQ(~9999u, b[9999]);
+
+  a.pop_back();
+  EXPECT_EQ(9998u, a.back());
+}
+
+// The last allocation grows where it is.
+TEST(ArenaArray, ExtendsInPlace)
+{
+  Arena arena;
+  ArenaArray<uint32_t> a(&arena);
+  a.reserve(16);
+  const uint32_t* data = a.data();
+
+  a.reserve(1024);
+  EXPECT_EQ(data, a.data());
+}
@@ -0,0 +1,223 @@
+#include "cache.h"
+#include "driver.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+namespace
+{
+  void writeFile(const std::string& path, const std::string& contents)
+  {
+    FILE* f = fopen(path.c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+  }
+
+  std::string readFile(const std::string& path)
+  {
+    std::string result;
+    if (FILE* f = fopen(path.c_str(), "rb"))
+    {
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+        result.append(buf, n);
+      fclose(f);
+    }
+    return result;
+  }
+
+  class CacheTest : public ::testing::Test
+  {
+  protected:
+    std::string m_Dir;
+
+    void SetUp() override
+    {
+      m_Dir = ::testing::TempDir() + "d68_cache_test";
+      clean();
+    }
+
+    void TearDown() override
+    {
+      clean();
+    }
+
+    void clean()
+    {
+      if (DIR* d = opendir(m_Dir.c_str()))
+      {
+        while (dirent* de = readdir(d))
+        {
+          if ('.' != de->d_name[0])
+            remove((m_Dir + "/" + de->d_name).c_str());
+        }
+        closedir(d);
+      }
+      rmdir(m_Dir.c_str());
+    }
+
+    int entryCount()
+    {
+      int count = 0;
+      if (DIR* d = opendir(m_Dir.c_str()))
+      {
+        while (dirent* de = readdir(d))
+        {
+          if ('.' != de->d_name[0])
+            ++count;
+        }
+        closedir(d);
+      }
+      return count;
+    }
+  };
+}
+
+TEST_F(CacheTest, KeyDependsOnInputAndOptions)
+{
+  TranslationCache cache;
+  DriverOptions plain, lines;
+  lines.m_EmitLineDirectives = true;
+
+  std::string k0 = cache.makeKey("abc", 3, "a.s", plain);
+  EXPECT_EQ(32u, k0.size());
+  EXPECT_EQ(k0, cache.makeKey("abc", 3, "b.s", plain));
+  EXPECT_NE(k0, cache.makeKey("abd", 3, "a.s", plain));
+  EXPECT_NE(k0, cache.makeKey("abc", 3, "a.s", lines));
+
+  // With line directives the file name ends up in the output.
+  EXPECT_NE(cache.makeKey("abc", 3, "a.s", lines), cache.makeKey("abc", 3, "b.s", lines));
+}
+
+TEST_F(CacheTest, StoreAndFetch)
+{
+  TranslationCache cache;
+  ASSERT_TRUE(cache.open(m_Dir.c_str()));
+
+  std::string out = m_Dir + "_out.s";
+  EXPECT_FALSE(cache.fetch("00000000000000000000000000000000", out.c_str()));
+
+  cache.store("0123456789abcdef0123456789abcdef", "translated\n");
+  ASSERT_TRUE(cache.fetch("0123456789abcdef0123456789abcdef", out.c_str()));
+  EXPECT_EQ("translated\n", readFile(out));
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  remove(out.c_str());
+}
+
+TEST_F(CacheTest, TranslateFileHitsCache)
+{
+  TranslationCache cache;
+  ASSERT_TRUE(cache.open(m_Dir.c_str()));
+
+  std::string in = m_Dir + "_in.s";
+  std::string out = m_Dir + "_out.s";
+  writeFile(in, "\t\t@proc foo\n\t\t@dreg a\n\t\tmoveq #0,@a\n\t\t@endproc\n");
+
+  DriverOptions options;
+  options.m_Cache = &cache;
+
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  std::string first = readFile(out);
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1, entryCount());
+
+  remove(out.c_str());
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(first, readFile(out));
+
+  // Writing over a hard linked output must not change the cache entry.
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), DriverOptions()));
+  writeFile(in, "\t\tnop\n");
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), DriverOptions()));
+  writeFile(in, "\t\t@proc foo\n\t\t@dreg a\n\t\tmoveq #0,@a\n\t\t@endproc\n");
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  EXPECT_EQ(2u, cache.hits());
+  EXPECT_EQ(first, readFile(out));
+
+  remove(in.c_str());
+  remove(out.c_str());
+}
+
+TEST_F(CacheTest, WriteIfChangedKeepsTimestampOfHits)
+{
+  TranslationCache cache;
+  ASSERT_TRUE(cache.open(m_Dir.c_str()));
+
+  std::string in = m_Dir + "_in.s";
+  std::string out = m_Dir + "_out.s";
+  writeFile(in, "\t\t@proc foo\n\t\t@dreg a\n\t\tmoveq #0,@a\n\t\t@endproc\n");
+
+  DriverOptions options;
+  options.m_Cache = &cache;
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+
+  // A plain hit hard links the output to the entry.
+  remove(out.c_str());
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  ASSERT_EQ(1u, cache.hits());
+
+  struct utimbuf old = { 1000, 1000 };
+  struct stat st;
+  ASSERT_EQ(0, utime(out.c_str(), &old));
+
+  options.m_WriteIfChanged = true;
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  EXPECT_EQ(2u, cache.hits());
+  ASSERT_EQ(0, stat(out.c_str(), &st));
+  EXPECT_EQ(1000, st.st_mtime);
+
+  // A hit written with write-if-changed is a copy, so later hits leave it be.
+  remove(out.c_str());
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  ASSERT_EQ(0, utime(out.c_str(), &old));
+  ASSERT_EQ(0, translateFile(in.c_str(), out.c_str(), options));
+  EXPECT_EQ(4u, cache.hits());
+  ASSERT_EQ(0, stat(out.c_str(), &st));
+  EXPECT_EQ(1000, st.st_mtime);
+  EXPECT_EQ(1u, st.st_nlink);
+
+  remove(in.c_str());
+  remove(out.c_str());
+}
+
+TEST_F(CacheTest, TrimEvictsOldestEntries)
+{
+  TranslationCache cache;
+  ASSERT_TRUE(cache.open(m_Dir.c_str(), 1000));
+
+  std::string payload(300, 'x');
+  const char* keys[] = { "a0", "a1", "a2", "a3", "a4" };
+
+  for (int i = 0; i < 5; ++i)
+  {
+    cache.store(keys[i], payload);
+
+    // Make the age order unambiguous.
+    std::string path = m_Dir + "/" + keys[i];
+    utimbuf times = { 1000 + i, 1000 + i };
+    ASSERT_EQ(0, utime(path.c_str(), &times));
+  }
+
+  cache.trim();
+
+  EXPECT_EQ(3, entryCount());
+  std::string out = m_Dir + "_out.s";
+  EXPECT_FALSE(cache.fetch("a0", out.c_str()));
+  EXPECT_FALSE(cache.fetch("a1", out.c_str()));
+  EXPECT_TRUE(cache.fetch("a4", out.c_str()));
+  remove(out.c_str());
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include "deluxe.h"
+#include "proccache.h"
+#include "d68test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+  // Lines that make it into the output end in "; L<line number>".
+  const char kProgram[] =
+    "; header comment\n"
+    "\t\tsection code,code\t; L2\n"
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\t; L5\n"
+    "* old style comment\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\t; L8\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "\t\t; between\n"
+    "\t\tnop\t; L12\n"
+    "\t\t@cproc bar(d0:x) modifies d0\n"
+    "\t\t@areg p\n"
+    "\t\t; inside\n"
+    "\t\t@rename p q\n"
+    "\t\tlea (@q),@q\t; L17\n"
+    "\t\t@endproc\n"
+    "\n"
+    "\t\tnop\t; L20\n";
+
+  std::string translate(CompactMode mode, int threads = 1, ProcCache* cache = nullptr)
+  {
+    TranslateOptions options;
+    options.m_LineDirectives = true;
+    options.m_Compact = mode;
+    options.m_Threads = threads;
+    options.m_Cache = cache;
+    return ::translate(kProgram, options);
+  }
+
+  // Follows the tbl_line directives through the output and checks that
+  // every marked line is attributed to the line it came from.
+  void expectLinesMatch(const std::string& output)
+  {
+    int line = 0;
+    int marked = 0;
+
+    for (size_t pos = 0; pos < output.size(); )
+    {
+      size_t nl = output.find('\n', pos);
+      std::string text = output.substr(pos, nl - pos);
+      pos = nl + 1;
+
+      if (0 == text.find("\t\ttbl_line "))
+      {
+        line = atoi(text.c_str() + 11);
+        continue;
+      }
+
+      size_t mark = text.find("; L");
+      if (std::string::npos != mark)
+      {
+        EXPECT_EQ(atoi(text.c_str() + mark + 3), line) << text;
+        ++marked;
+      }
+      ++line;
+    }
+
+    EXPECT_EQ(6, marked);
+  }
+}
+
+TEST(CompactTest, DropsAnnotations)
+{
+  std::string full = translate(CompactMode::kNone);
+  std::string compact = translate(CompactMode::kNoAnnotations);
+
+  EXPECT_NE(std::string::npos, full.find("; live reg"));
+  EXPECT_EQ(std::string::npos, compact.find("; live reg"));
+  EXPECT_EQ(std::string::npos, compact.find("@"));
+  EXPECT_NE(std::string::npos, compact.find("; header comment"));
+  EXPECT_NE(std::string::npos, compact.find("\t\tmovem.l d6-d7,-(sp)\n"));
+  EXPECT_LT(compact.size(), full.size());
+}
+
+TEST(CompactTest, DropsComments)
+{
+  std::string compact = translate(CompactMode::kNoComments);
+
+  EXPECT_EQ(std::string::npos, compact.find("comment"));
+  EXPECT_EQ(std::string::npos, compact.find("between"));
+  EXPECT_EQ(std::string::npos, compact.find("inside"));
+  // Comments after code stay.
+  EXPECT_NE(std::string::npos, compact.find("nop\t; L12"));
+  // So do blank lines.
+  EXPECT_NE(std::string::npos, compact.find("\n\n"));
+}
+
+TEST(CompactTest, LineDirectivesMatchInput)
+{
+  expectLinesMatch(translate(CompactMode::kNone));
+  expectLinesMatch(translate(CompactMode::kNoAnnotations));
+  expectLinesMatch(translate(CompactMode::kNoComments));
+}
+
+// Procedures translated on other threads or replayed from the cache come
+// out the same as they would in place.
+TEST(CompactTest, ParallelAndCachedMatchSerial)
+{
+  const CompactMode modes[] = { CompactMode::kNoAnnotations, CompactMode::kNoComments };
+  for (CompactMode mode : modes)
+  {
+    std::string serial = translate(mode);
+    EXPECT_EQ(serial, translate(mode, 4));
+
+    ProcCache cache;
+    EXPECT_EQ(serial, translate(mode, 1, &cache));
+    EXPECT_EQ(serial, translate(mode, 1, &cache));
+    EXPECT_LT(0u, cache.hits());
+  }
+}
+
+// Without line directives the translator never has a line delta to carry
+// across a procedure; recording and replaying one must cope with that.
+TEST(CompactTest, CachedWithoutLineDirectives)
+{
+  const CompactMode modes[] = { CompactMode::kNoAnnotations, CompactMode::kNoComments };
+  for (CompactMode mode : modes)
+  {
+    TranslateOptions options;
+    options.m_Compact = mode;
+    const std::string serial = ::translate(kProgram, options);
+
+    ProcCache cache;
+    options.m_Cache = &cache;
+    EXPECT_EQ(serial, ::translate(kProgram, options));
+    EXPECT_EQ(serial, ::translate(kProgram, options));
+    EXPECT_LT(0u, cache.hits());
+
+    options.m_Threads = 4;
+    EXPECT_EQ(serial, ::translate(kProgram, options));
+  }
+}
+
+// The header counts as two lines, but is one when the procedure saves
+// nothing. Directives that produce no output don't resync in compact
+// output, so the line after the header has to.
+TEST(CompactTest, LineAfterHeaderWithoutSaves)
+{
+  const char text[] =
+    "\t@proc P(a0:x)\n"
+    "\t@kill x\n"
+    "\tnop ; line3\n"
+    "\t@endproc\n";
+
+  const CompactMode modes[] = { CompactMode::kNoAnnotations, CompactMode::kNoComments };
+  for (CompactMode mode : modes)
+  {
+    TranslateOptions options;
+    options.m_LineDirectives = true;
+    options.m_Compact = mode;
+    EXPECT_EQ(
+      "\t\ttbl_line 1 test.s\n"
+      "P:\n"
+      "\t\ttbl_line 3 test.s\n"
+      "\tnop ; line3\n"
+      "\t\trts\n", ::translate(text, options));
+  }
+}
+
+// Lines that produce nothing don't leave a directive behind for the next
+// one to override.
+TEST(CompactTest, NoBackToBackDirectives)
+{
+  const char text[] =
+    "\t@proc P\n"
+    "\t@dreg a\n"
+    "\tmoveq #0,@a ; line3\n"
+    "\t@kill a\n"
+    "\t@spill d3\n"
+    "\t@spill d4\n"
+    "\tnop ; line7\n"
+    "\t@endproc\n";
+
+  TranslateOptions options;
+  options.m_LineDirectives = true;
+  options.m_Compact = CompactMode::kNoAnnotations;
+  EXPECT_EQ(
+    "\t\ttbl_line 1 test.s\n"
+    "P:\n"
+    "\t\tmovem.l d3-d4/d7,-(sp)\n"
+    "\t\ttbl_line 3 test.s\n"
+    "\tmoveq #0,d7 ; line3\n"
+    "\t\ttbl_line 7 test.s\n"
+    "\tnop ; line7\n"
+    "\t\tmovem.l (sp)+,d3-d4/d7\n"
+    "\t\trts\n", ::translate(text, options));
+}
@@ -1,15 +1,53 @@
 #include "d68test.h"
 #include "deluxe.h"
 
+void appendToString(const char* buf, size_t len, void* user_data)
+{
+  std::string* s = static_cast<std::string*>(user_data);
+  s->insert(s->end(), buf, buf + len);
+}
+
+std::string translate(const std::string& text, const TranslateOptions& options)
+{
+  std::string output;
+  Deluxe68 d("test.s", text.data(), text.size(), options.m_LineDirectives, options.m_ProcSections);
+  d.setCompactMode(options.m_Compact);
+  d.setProcedureThreads(options.m_Threads);
+  d.setProcedureCache(options.m_Cache);
+  d.setSignatures(options.m_Signatures);
+  d.setStats(options.m_Stats);
+  if (options.m_Diagnostics)
+    d.setDiagnosticCallback(appendToString, options.m_Diagnostics);
+  if (options.m_Streaming)
+    d.setStreamingOutput(appendToString, &output);
+  d.run();
+  if (!options.m_Diagnostics)
+  {
+    EXPECT_EQ(0, d.errorCount());
+  }
+  d.generateOutput(appendToString, &output);
+  return output;
+}
+
 std::string DeluxeTest::xform(const char* in, bool line_directives)
 {
   Deluxe68 d68("<unittest>", in, strlen(in), line_directives, false);
   d68.run();
-  d68.generateOutput([](const char* buf, size_t len, void* user_data)
-  {
-    std::string* s = static_cast<std::string*>(user_data);
-    s->insert(s->end(), buf, buf + len);
-  }, &output);
+  d68.generateOutput(appendToString, &output);
+
+  return filter(output);
+}
+
+std::string DeluxeTest::xformStreaming(const char* in, bool line_directives)
+{
+  Deluxe68 d68("<unittest>", in, strlen(in), line_directives, false);
+  d68.setStreamingOutput(appendToString, &output);
+  d68.run();
+
+  // Everything should have been written during run().
+  std::string leftover;
+  d68.generateOutput(appendToString, &leftover);
+  EXPECT_EQ("", leftover);
 
   return filter(output);
 }
@@ -1,6 +1,32 @@
 #pragma once
 #include "gtest/gtest.h"
 
+#include <string>
+
+#include "deluxe.h"
+
+// Print callback appending to the std::string passed as 'user_data'.
+void appendToString(const char* buf, size_t len, void* user_data);
+
+// How translate() sets up its translator.
+struct TranslateOptions
+{
+  bool               m_LineDirectives = false;
+  bool               m_ProcSections = false;
+  bool               m_Streaming = false;
+  CompactMode        m_Compact = CompactMode::kNone;
+  int                m_Threads = 1;
+  ProcCache*         m_Cache = nullptr;
+  const SignatureDb* m_Signatures = nullptr;
+  TranslationStats*  m_Stats = nullptr;
+  // Where diagnostics go. Without it, the translation is expected to
+  // succeed.
+  std::string*       m_Diagnostics = nullptr;
+};
+
+// Translate 'text' as "test.s" with a fresh translator.
+std::string translate(const std::string& text, const TranslateOptions& options = TranslateOptions());
+
 class DeluxeTest : public ::testing::Test
 {
 protected:
@@ -12,6 +38,7 @@ public:
 
 protected:
   std::string xform(const char* in, bool line_directives = false);
+  std::string xformStreaming(const char* in, bool line_directives = false);
 
   std::string filter(const std::string& in);
 
@@ -0,0 +1,105 @@
+#include "deluxe.h"
+#include "d68test.h"
+
+#include <string.h>
+
+#include <string>
+
+namespace
+{
+  const char kRepeated[] =
+    "\t\t@proc foo\n"
+    "\t\tmove.l @nope,d0\n"
+    "\t\tmove.l @nope,d1\n"
+    "\t\t@kill gone\n"
+    "\t\tmove.l @nope,d2\n"
+    "\t\t@endproc\n";
+}
+
+TEST(DiagnosticTest, CollectsStructuredList)
+{
+  std::string text;
+  Deluxe68 d("test.s", kRepeated, strlen(kRepeated), false, false);
+  d.setDiagnosticCallback(appendToString, &text);
+  d.run();
+
+  EXPECT_EQ(4, d.errorCount());
+
+  const std::vector<Diagnostic>& list = d.diagnostics();
+  ASSERT_EQ(2u, list.size());
+
+  EXPECT_STREQ("test.s", list[0].m_File);
+  EXPECT_EQ(2, list[0].m_Line);
+  EXPECT_EQ(DiagnosticCode::kUnknownReference, list[0].m_Code);
+  EXPECT_EQ("unknown register 'nope' referenced", list[0].m_Message);
+  EXPECT_STREQ("unknown-reference", diagnosticCodeName(list[0].m_Code));
+
+  EXPECT_EQ(4, list[1].m_Line);
+  EXPECT_EQ(DiagnosticCode::kNameNotInUse, list[1].m_Code);
+}
+
+// The same message on several lines is written once, with a note saying how
+// often it came up.
+TEST(DiagnosticTest, FoldsRepeats)
+{
+  std::string text;
+  Deluxe68 d("test.s", kRepeated, strlen(kRepeated), false, false);
+  d.setDiagnosticCallback(appendToString, &text);
+  d.run();
+
+  const std::vector<Diagnostic>& list = d.diagnostics();
+  ASSERT_EQ(2u, list.size());
+  EXPECT_EQ(2, list[0].m_Repeats);
+  EXPECT_EQ(5, list[0].m_LastLine);
+  EXPECT_EQ(0, list[1].m_Repeats);
+
+  EXPECT_EQ(
+      "test.s(2): unknown register 'nope' referenced\n"
+      "test.s(2): note: repeated 2 more times, last on line 5\n"
+      "test.s(4): register name not in use: 'gone'\n", text);
+}
+
+TEST(DiagnosticTest, StopsAtErrorLimit)
+{
+  std::string source;
+  for (int i = 0; i < 100; ++i)
+    source += "\t\tmove.l @nope" + std::to_string(i) + ",d0\n";
+
+  std::string text;
+  Deluxe68 d("test.s", source.data(), source.size(), false, false);
+  d.setDiagnosticCallback(appendToString, &text);
+  d.setMaxErrors(3);
+  d.run();
+
+  EXPECT_EQ(3, d.errorCount());
+  EXPECT_EQ(3u, d.diagnostics().size());
+  EXPECT_EQ(
+      "test.s(1): unknown register 'nope0' referenced\n"
+      "test.s(2): unknown register 'nope1' referenced\n"
+      "test.s(3): unknown register 'nope2' referenced\n"
+      "test.s(3): error limit of 3 reached, stopping\n", text);
+
+  // The limit is a setting and outlives reset(); the list doesn't.
+  text.clear();
+  d.reset("test.s", kRepeated, strlen(kRepeated), false, false);
+  EXPECT_TRUE(d.diagnostics().empty());
+  d.run();
+  EXPECT_EQ(3, d.errorCount());
+  EXPECT_EQ(2u, d.diagnostics().size());
+}
+
+// Everything reported for one run goes out in a single call per message, and
+// only once run() is done.
+TEST(DiagnosticTest, WrittenWhenRunFinishes)
+{
+  struct Counter
+  {
+    int m_Calls = 0;
+    static void count(const char*, size_t, void* user_data) { ++static_cast<Counter*>(user_data)->m_Calls; }
+  } counter;
+
+  Deluxe68 d("test.s", kRepeated, strlen(kRepeated), false, false);
+  d.setDiagnosticCallback(Counter::count, &counter);
+  d.run();
+  EXPECT_EQ(2, counter.m_Calls);
+}
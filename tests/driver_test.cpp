@@ -0,0 +1,259 @@
+#include "driver.h"
+#include "signatures.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+namespace
+{
+  std::string tempPath(const char* name)
+  {
+    return ::testing::TempDir() + name;
+  }
+
+  void writeFile(const std::string& path, const std::string& contents)
+  {
+    FILE* f = fopen(path.c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+  }
+
+  std::string readFile(const std::string& path)
+  {
+    std::string result;
+    if (FILE* f = fopen(path.c_str(), "rb"))
+    {
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+        result.append(buf, n);
+      fclose(f);
+    }
+    return result;
+  }
+}
+
+TEST(Driver, ParseBatchJob)
+{
+  BatchJob job;
+  ASSERT_TRUE(parseBatchJob("in.s:out.s", &job));
+  EXPECT_EQ("in.s", job.m_Input);
+  EXPECT_EQ("out.s", job.m_Output);
+
+  ASSERT_TRUE(parseBatchJob("c:\\src\\in.s:c:\\obj\\out.s", &job));
+  EXPECT_EQ("c:\\src\\in.s", job.m_Input);
+  EXPECT_EQ("c:\\obj\\out.s", job.m_Output);
+
+  EXPECT_FALSE(parseBatchJob("in.s", &job));
+  EXPECT_FALSE(parseBatchJob("in.s:", &job));
+  EXPECT_FALSE(parseBatchJob(":out.s", &job));
+}
+
+TEST(Driver, BatchTranslatesAllFiles)
+{
+  std::vector<BatchJob> jobs;
+
+  for (int i = 0; i < 8; ++i)
+  {
+    BatchJob job;
+    job.m_Input = tempPath(("d68_batch_in" + std::to_string(i) + ".s").c_str());
+    job.m_Output = tempPath(("d68_batch_out" + std::to_string(i) + ".s").c_str());
+    writeFile(job.m_Input, "\t\t@proc p" + std::to_string(i) + "\n\t\t@dreg a\n\t\tmoveq #0,@a\n\t\t@endproc\n");
+    remove(job.m_Output.c_str());
+    jobs.push_back(job);
+  }
+
+  EXPECT_EQ(0, runBatch(jobs, DriverOptions(), 4));
+
+  for (int i = 0; i < 8; ++i)
+  {
+    std::string out = readFile(jobs[i].m_Output);
+    EXPECT_NE(std::string::npos, out.find("p" + std::to_string(i) + ":\n"));
+    EXPECT_NE(std::string::npos, out.find("moveq #0,d7"));
+    remove(jobs[i].m_Input.c_str());
+    remove(jobs[i].m_Output.c_str());
+  }
+}
+
+TEST(Driver, BatchFailsIfAnyFileFails)
+{
+  std::vector<BatchJob> jobs(2);
+  jobs[0].m_Input = tempPath("d68_batch_good.s");
+  jobs[0].m_Output = tempPath("d68_batch_good.out");
+  jobs[1].m_Input = tempPath("d68_batch_bad.s");
+  jobs[1].m_Output = tempPath("d68_batch_bad.out");
+
+  writeFile(jobs[0].m_Input, "\t\tnop\n");
+  writeFile(jobs[1].m_Input, "\t\tmove.l @nope,d0\n");
+  remove(jobs[1].m_Output.c_str());
+
+  EXPECT_NE(0, runBatch(jobs, DriverOptions(), 2));
+
+  // The good file is still translated, the bad one has no output.
+  EXPECT_EQ("\t\tnop\n", readFile(jobs[0].m_Output));
+  EXPECT_EQ("", readFile(jobs[1].m_Output));
+
+  for (const BatchJob& job : jobs)
+  {
+    remove(job.m_Input.c_str());
+    remove(job.m_Output.c_str());
+  }
+}
+
+// An empty file list is a broken build rule, not a successful build.
+TEST(Driver, BatchFailsWithoutJobs)
+{
+  EXPECT_EQ(1, runBatch(std::vector<BatchJob>(), DriverOptions(), 2));
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST(Driver, WriteIfChangedKeepsIdenticalOutput)
+{
+  const std::string input = tempPath("d68_wic_in.s");
+  const std::string output = tempPath("d68_wic_out.s");
+  writeFile(input, "\t\t@proc p\n\t\t@dreg a\n\t\tmoveq #0,@a\n\t\t@endproc\n");
+
+  DriverOptions options;
+  options.m_WriteIfChanged = true;
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+
+  // Backdate the output so any rewrite shows.
+  struct utimbuf old = { 1000, 1000 };
+  ASSERT_EQ(0, utime(output.c_str(), &old));
+
+  struct stat st;
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+  ASSERT_EQ(0, stat(output.c_str(), &st));
+  EXPECT_EQ(1000, st.st_mtime);
+
+  // A change in the translation does replace it.
+  writeFile(input, "\t\t@proc p\n\t\t@dreg a\n\t\tmoveq #1,@a\n\t\t@endproc\n");
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+  ASSERT_EQ(0, stat(output.c_str(), &st));
+  EXPECT_NE(1000, st.st_mtime);
+  EXPECT_NE(std::string::npos, readFile(output).find("moveq #1,d7"));
+
+  remove(input.c_str());
+  remove(output.c_str());
+}
+#endif
+
+TEST(Driver, WritesDepFile)
+{
+  const std::string input = tempPath("d68 dep#in.s");
+  const std::string output = tempPath("d68_dep_out.s");
+  const std::string depFile = tempPath("d68_dep_out.d");
+  writeFile(input, "\t\tnop\n");
+
+  DriverOptions options;
+  options.m_DepFile = depFile.c_str();
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+
+  std::string escapedInput = input;
+  escapedInput.replace(escapedInput.find("d68 dep#in.s"), strlen("d68 dep#in.s"), "d68\\ dep\\#in.s");
+  EXPECT_EQ(output + ": " + escapedInput + "\n", readFile(depFile));
+
+  // -MD names the file after each output.
+  options.m_DepFile = nullptr;
+  options.m_DepFilePerOutput = true;
+  remove(depFile.c_str());
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+  EXPECT_EQ(output + ": " + escapedInput + "\n", readFile(output + ".d"));
+
+  // Nothing is written for a failed translation.
+  remove((output + ".d").c_str());
+  writeFile(input, "\t\tmove.l @nope,d0\n");
+  EXPECT_NE(0, translateFile(input.c_str(), output.c_str(), options));
+  EXPECT_EQ("", readFile(output + ".d"));
+
+  remove(input.c_str());
+  remove(output.c_str());
+}
+
+TEST(Driver, SplitWritesPartsAndManifest)
+{
+  const std::string input = tempPath("d68_split_in.s");
+  const std::string output = tempPath("d68_split_out");
+  writeFile(input,
+    "\t\tnop\n"
+    "\t\t@proc foo\n"
+    "\t\t@endproc\n"
+    "\t\t@proc bar\n"
+    "\t\t@endproc\n");
+
+  DriverOptions options;
+  options.m_Split = true;
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+
+  const std::string prologue = output + ".prologue.s";
+  const std::string foo = output + ".proc_foo.s";
+  const std::string bar = output + ".proc_bar.s";
+  EXPECT_EQ(prologue + "\n" + foo + "\n" + bar + "\n", readFile(output));
+  EXPECT_EQ("\t\tnop\n", readFile(prologue));
+  EXPECT_NE(std::string::npos, readFile(foo).find("foo:\n"));
+  EXPECT_NE(std::string::npos, readFile(bar).find("bar:\n"));
+
+  // Parts of procedures that went away are removed.
+  writeFile(input,
+    "\t\t@proc foo\n"
+    "\t\t@endproc\n");
+  ASSERT_EQ(0, translateFile(input.c_str(), output.c_str(), options));
+  EXPECT_EQ(prologue + "\n" + foo + "\n", readFile(output));
+  EXPECT_EQ("", readFile(prologue));
+  EXPECT_EQ(nullptr, fopen(bar.c_str(), "rb"));
+
+  remove(input.c_str());
+  remove(output.c_str());
+  remove(prologue.c_str());
+  remove(foo.c_str());
+}
+
+TEST(Driver, ExportsAndImportsSignatures)
+{
+  const std::string lib = tempPath("d68_sig_lib.s");
+  const std::string libOut = tempPath("d68_sig_lib.out.s");
+  const std::string main = tempPath("d68_sig_main.s");
+  const std::string mainOut = tempPath("d68_sig_main.out.s");
+  const std::string depFile = tempPath("d68_sig_main.d");
+  writeFile(lib,
+    "\t\t@cproc Clear(a0:dst) modifies d0\n"
+    "\t\tmoveq #0,d0\n"
+    "\t\tmove.l d0,(@dst)\n"
+    "\t\t@endproc\n");
+  writeFile(main,
+    "\t\t@proc Main\n"
+    "\t\t@dreg x\n"
+    "\t\t@areg p\n"
+    "\t\t@call Clear\n"
+    "\t\t@endproc\n");
+
+  DriverOptions options;
+  options.m_ExportSignatures = true;
+  ASSERT_EQ(0, translateFile(lib.c_str(), libOut.c_str(), options));
+  EXPECT_EQ(std::string(kSignatureFileHeader) + "Clear a0 d0\n", readFile(libOut + ".sig"));
+
+  SignatureDb signatures;
+  ASSERT_TRUE(signatures.load((libOut + ".sig").c_str()));
+
+  // Neither x (d7) nor p (a6) needs saving around the call.
+  DriverOptions importing;
+  importing.m_Signatures = &signatures;
+  importing.m_DepFile = depFile.c_str();
+  ASSERT_EQ(0, translateFile(main.c_str(), mainOut.c_str(), importing));
+  EXPECT_NE(std::string::npos, readFile(mainOut).find("\t\t@call Clear\n\t\tbsr\tClear\n"));
+  EXPECT_NE(std::string::npos, readFile(depFile).find(libOut + ".sig"));
+
+  remove(lib.c_str());
+  remove(libOut.c_str());
+  remove((libOut + ".sig").c_str());
+  remove(main.c_str());
+  remove(mainOut.c_str());
+  remove(depFile.c_str());
+}
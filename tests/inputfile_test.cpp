@@ -0,0 +1,45 @@
+#include "inputfile.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+static std::string writeTempFile(const char* name, const std::string& contents)
+{
+  std::string path = ::testing::TempDir() + name;
+  FILE* f = fopen(path.c_str(), "wb");
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+  return path;
+}
+
+TEST(InputFile, ReadsContents)
+{
+  std::string text = "\t\t@proc foo\n\t\t@endproc\n";
+  std::string path = writeTempFile("d68_inputfile.s", text);
+
+  InputFile f;
+  ASSERT_TRUE(f.open(path.c_str()));
+  ASSERT_EQ(text.size(), f.size());
+  EXPECT_EQ(0, memcmp(text.data(), f.data(), text.size()));
+
+  remove(path.c_str());
+}
+
+TEST(InputFile, Empty)
+{
+  std::string path = writeTempFile("d68_inputfile_empty.s", "");
+
+  InputFile f;
+  ASSERT_TRUE(f.open(path.c_str()));
+  EXPECT_EQ(0u, f.size());
+
+  remove(path.c_str());
+}
+
+TEST(InputFile, Missing)
+{
+  InputFile f;
+  EXPECT_FALSE(f.open("this/file/does/not/exist.s"));
+}
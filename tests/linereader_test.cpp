@@ -0,0 +1,146 @@
+#include "linereader.h"
+#include "deluxe.h"
+#include "d68test.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+  // Hands out at most 'm_MaxRead' bytes per read, like a slow pipe.
+  struct MemoryStream
+  {
+    const char* m_Data;
+    size_t      m_Remain;
+    size_t      m_MaxRead;
+
+    static size_t read(void* dst, size_t len, void* user_data)
+    {
+      MemoryStream* self = static_cast<MemoryStream*>(user_data);
+      size_t n = std::min(std::min(len, self->m_MaxRead), self->m_Remain);
+      memcpy(dst, self->m_Data, n);
+      self->m_Data += n;
+      self->m_Remain -= n;
+      return n;
+    }
+  };
+
+  std::vector<std::string> splitLines(const char* text, size_t chunkSize, size_t maxRead)
+  {
+    MemoryStream stream { text, strlen(text), maxRead };
+    LineReader reader(MemoryStream::read, &stream, chunkSize);
+
+    std::vector<std::string> lines;
+    while (!reader.atEnd())
+    {
+      StringFragment line = reader.nextLine();
+      lines.emplace_back(line.ptr(), line.size());
+    }
+    return lines;
+  }
+}
+
+TEST(LineReader, Empty)
+{
+  EXPECT_TRUE(splitLines("", 16, 16).empty());
+}
+
+TEST(LineReader, UnterminatedLastLine)
+{
+  std::vector<std::string> expected = { "a", "", "bc" };
+  EXPECT_EQ(expected, splitLines("a\n\nbc", 16, 16));
+}
+
+TEST(LineReader, LinesAcrossChunks)
+{
+  std::vector<std::string> expected = { "first line", "x", "", "a much longer third line", "end" };
+  const char* text = "first line\nx\n\na much longer third line\nend\n";
+
+  for (size_t chunk = 1; chunk < 8; ++chunk)
+  {
+    for (size_t maxRead = 1; maxRead < 8; ++maxRead)
+    {
+      EXPECT_EQ(expected, splitLines(text, chunk, maxRead)) << "chunk " << chunk << " maxRead " << maxRead;
+    }
+  }
+}
+
+// Translating from a stream in tiny chunks must match translating the same
+// text from a buffer, including tbl_line numbering.
+TEST(LineReader, TranslationMatchesBuffer)
+{
+  const char* text =
+    "; header\n"
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "\t\t@proc bar\n"
+    "\t\t@areg p\n"
+    "\t\tlea (@p),@p\n"
+    "\t\t@endproc\n"
+    "\t\tdc.l 0";
+
+  std::string expected;
+  {
+    Deluxe68 d("t.s", text, strlen(text), true, true);
+    d.run();
+    ASSERT_EQ(0, d.errorCount());
+    d.generateOutput(appendToString, &expected);
+  }
+
+  for (size_t chunk = 1; chunk < 12; chunk += 5)
+  {
+    MemoryStream stream { text, strlen(text), 3 };
+    LineReader reader(MemoryStream::read, &stream, chunk);
+
+    std::string actual;
+    Deluxe68 d("t.s", reader, true, true);
+    d.setStreamingOutput(appendToString, &actual);
+    d.run();
+    EXPECT_EQ(0, d.errorCount());
+    EXPECT_EQ(expected, actual);
+  }
+}
+
+// Runs of lines without directives are copied as one span from a buffer, but
+// line by line from a stream. Both must agree, down to the tbl_line numbers.
+TEST(LineReader, VerbatimRunsMatchStream)
+{
+  const char* text =
+    "; header @not a reference\n"
+    "\n"
+    "\t\tnop\n"
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a\n"
+    "\t\tmove.l d0,d1\t; @a is left alone in comments\n"
+    "\t\tmove.l d1,d2\n"
+    "\t\tmove.l (@ptr)+,@a\n"
+    "\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l d2,d3\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "\t\tdc.l 0\n"
+    "\t\tdc.l 1";
+
+  std::string expected;
+  {
+    MemoryStream stream { text, strlen(text), 7 };
+    LineReader reader(MemoryStream::read, &stream, 16);
+    Deluxe68 d("t.s", reader, true, false);
+    d.run();
+    ASSERT_EQ(0, d.errorCount());
+    d.generateOutput(appendToString, &expected);
+  }
+
+  std::string actual;
+  Deluxe68 d("t.s", text, strlen(text), true, false);
+  d.run();
+  EXPECT_EQ(0, d.errorCount());
+  d.generateOutput(appendToString, &actual);
+  EXPECT_EQ(expected, actual);
+}
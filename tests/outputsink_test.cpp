@@ -0,0 +1,115 @@
+#include "outputsink.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string>
+
+namespace
+{
+  // Records how the text arrived, not just what it was.
+  class RecordingSink : public OutputSink
+  {
+  public:
+    std::string m_Text;
+    int         m_Calls = 0;
+    size_t      m_Chunks = 0;
+
+    ~RecordingSink() { flush(); }
+
+  protected:
+    bool writeChunks(const Chunk* chunks, size_t count) override
+    {
+      ++m_Calls;
+      m_Chunks += count;
+      for (size_t i = 0; i < count; ++i)
+        m_Text.append(chunks[i].m_Ptr, chunks[i].m_Len);
+      return true;
+    }
+  };
+}
+
+TEST(OutputSink, WriteInt)
+{
+  std::string text;
+  {
+    StringSink sink(&text);
+    for (int v : { 0, 7, -4, 120, 2147483647, -2147483647 - 1 })
+    {
+      sink.writeInt(v);
+      sink.put(' ');
+    }
+  }
+  EXPECT_EQ("0 7 -4 120 2147483647 -2147483648 ", text);
+}
+
+// Small pieces are coalesced into one chunk; long references are passed
+// through without copying; everything goes out in one call.
+TEST(OutputSink, BatchesChunks)
+{
+  const std::string big(100, 'x');
+
+  RecordingSink sink;
+  sink.write("a");
+  sink.write("bc");
+  sink.writeRef(big.data(), big.size());
+  sink.write("d");
+  sink.writeRef("short", 5);
+  EXPECT_TRUE(sink.flush());
+
+  EXPECT_EQ("abc" + big + "dshort", sink.m_Text);
+  EXPECT_EQ(1, sink.m_Calls);
+  EXPECT_EQ(3u, sink.m_Chunks);
+}
+
+TEST(OutputSink, HandlesOverflow)
+{
+  std::string expected;
+  RecordingSink sink;
+
+  const std::string line(1000, 'y');
+  const std::string huge(OutputSink::kBufferSize * 2, 'z');
+
+  for (int i = 0; i < 200; ++i)
+  {
+    sink.write(line.data(), line.size());
+    expected += line;
+    sink.writeRef(huge.data(), 40);
+    expected.append(huge.data(), 40);
+  }
+
+  sink.write(huge.data(), huge.size());
+  expected += huge;
+  sink.flush();
+
+  EXPECT_EQ(expected, sink.m_Text);
+  EXPECT_GT(sink.m_Calls, 1);
+}
+
+// Text written through stdio before the sink stays in front of it.
+TEST(OutputSink, FileSinkKeepsOrder)
+{
+  FILE* f = tmpfile();
+  ASSERT_NE(nullptr, f);
+
+  const std::string body(200, 'b');
+
+  fputs("header\n", f);
+  {
+    FileSink sink(f);
+    sink.write("start\n");
+    sink.writeRef(body.data(), body.size());
+    sink.put('\n');
+  }
+  fputs("trailer\n", f);
+  fflush(f);
+
+  rewind(f);
+  std::string contents;
+  char buf[512];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+    contents.append(buf, n);
+  fclose(f);
+
+  EXPECT_EQ("header\nstart\n" + std::string(200, 'b') + "\ntrailer\n", contents);
+}
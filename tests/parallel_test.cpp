@@ -0,0 +1,131 @@
+#include "deluxe.h"
+#include "proccache.h"
+#include "d68test.h"
+
+#include <string.h>
+#include <string>
+
+namespace
+{
+  // Procedures with and without spills, a register reserved ahead of one,
+  // a redefinition and an error, so some of them have to be translated in
+  // place.
+  const char kProgram[] =
+    "\t\tsection code,code\n"
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "\t\tnop\n"
+    "\t\t@cproc bar(d0:x) modifies d0\n"
+    "\t\t@areg p\n"
+    "\t\tlea (@p),@p\n"
+    "\t\t@endproc\n"
+    "\t\t@reserve d7\n"
+    "\t\t@proc baz\n"
+    "\t\t@dreg q\n"
+    "\t\tmoveq #0,@q\n"
+    "\t\t@endproc\n"
+    "\t\tnop\n"
+    "\n"
+    "\t\t@proc qux\n"
+    "\t\t@dreg r\n"
+    "\t\tmoveq #1,@r\n"
+    "\t\t@endproc\n";
+
+  struct Result
+  {
+    std::string m_Output;
+    std::string m_Diagnostics;
+  };
+
+  Result translate(const std::string& text, int threads, bool lineDirectives, bool streaming = false)
+  {
+    Result result;
+    TranslateOptions options;
+    options.m_LineDirectives = lineDirectives;
+    options.m_ProcSections = true;
+    options.m_Streaming = streaming;
+    options.m_Threads = threads;
+    options.m_Diagnostics = &result.m_Diagnostics;
+    result.m_Output = ::translate(text, options);
+    return result;
+  }
+
+  void expectSameAsSerial(const std::string& text)
+  {
+    for (int directives = 0; directives < 2; ++directives)
+    {
+      for (int streaming = 0; streaming < 2; ++streaming)
+      {
+        Result serial = translate(text, 1, 0 != directives, 0 != streaming);
+        Result parallel = translate(text, 4, 0 != directives, 0 != streaming);
+        EXPECT_EQ(serial.m_Output, parallel.m_Output);
+        EXPECT_EQ(serial.m_Diagnostics, parallel.m_Diagnostics);
+      }
+    }
+  }
+}
+
+TEST(ParallelTest, MatchesSerial)
+{
+  expectSameAsSerial(kProgram);
+}
+
+TEST(ParallelTest, ManyProcedures)
+{
+  std::string text;
+  char buf[256];
+  for (int i = 0; i < 200; ++i)
+  {
+    snprintf(buf, sizeof buf,
+        "\t\t@proc fn%d(a0:src)\n"
+        "\t\t@dreg x\n"
+        "\t\tmove.l (@src)+,@x\n"
+        "%s"
+        "\t\t@endproc\n"
+        "; between\n", i, i % 3 ? "\t\tnop\n\t\tnop\n" : "\t\t@spill x\n\t\t@restore x\n");
+    text += buf;
+  }
+
+  expectSameAsSerial(text);
+}
+
+// Errors are reported by the serial pass, in order and with the line numbers
+// of the whole file.
+TEST(ParallelTest, DiagnosticsMatchSerial)
+{
+  std::string text = kProgram;
+  text += "\t\t@proc foo\n\t\t@endproc\n";                        // Redefinition
+  text += "\t\t@proc bad\n\t\tmove.l @nope,d0\n\t\t@endproc\n";  // Unknown register
+
+  Result parallel = translate(text, 4, true);
+  EXPECT_NE(std::string::npos, parallel.m_Diagnostics.find("test.s(28)"));
+  expectSameAsSerial(text);
+}
+
+// Procedures the cache already has are replayed from there; the others are
+// added to it.
+TEST(ParallelTest, FillsProcedureCache)
+{
+  const std::string text = kProgram;
+  const std::string expected = translate(text, 1, true).m_Output;
+
+  ProcCache cache;
+  TranslateOptions options;
+  options.m_LineDirectives = true;
+  options.m_ProcSections = true;
+  options.m_Threads = 4;
+  options.m_Cache = &cache;
+
+  for (int run = 0; run < 2; ++run)
+  {
+    EXPECT_EQ(expected, ::translate(text, options));
+  }
+
+  // baz is entered with d7 reserved, so it's never cached.
+  EXPECT_EQ(3u, cache.size());
+}
@@ -0,0 +1,173 @@
+#include "deluxe.h"
+#include "proccache.h"
+#include "d68test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+  const char kProgram[] =
+    "\t\tsection code,code\n"
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "\t\tnop\n"
+    "\t\t@cproc bar(d0:x) modifies d0\n"
+    "\t\t@areg p\n"
+    "\t\tlea (@p),@p\n"
+    "\t\t@endproc\n"
+    "\t\t@proc baz\n"
+    "\t\t@dreg q\n"
+    "\t\tmoveq #0,@q\n"
+    "\t\t@endproc\n"
+    "\t\tdc.l 0\n";
+
+  std::string replace(std::string text, const char* from, const char* to)
+  {
+    size_t pos = text.find(from);
+    EXPECT_NE(std::string::npos, pos);
+    text.replace(pos, strlen(from), to);
+    return text;
+  }
+}
+
+TEST(ProcCacheTest, ColdAndWarmMatchFullTranslation)
+{
+  for (bool lineDirectives : { false, true })
+  {
+    TranslateOptions options;
+    options.m_LineDirectives = lineDirectives;
+    const std::string expected = translate(kProgram, options);
+
+    ProcCache cache;
+    options.m_Cache = &cache;
+    EXPECT_EQ(expected, translate(kProgram, options));
+    EXPECT_EQ(3u, cache.size());
+    EXPECT_EQ(0u, cache.hits());
+
+    EXPECT_EQ(expected, translate(kProgram, options));
+    EXPECT_EQ(3u, cache.hits());
+
+    options.m_Streaming = true;
+    EXPECT_EQ(expected, translate(kProgram, options));
+  }
+}
+
+// Adding lines to one procedure shifts everything after it. Replayed
+// procedures further down must still carry the right line numbers.
+TEST(ProcCacheTest, EditedProcedureKeepsLineNumbers)
+{
+  ProcCache cache;
+  TranslateOptions plain, cached;
+  plain.m_LineDirectives = cached.m_LineDirectives = true;
+  cached.m_Cache = &cache;
+  translate(kProgram, cached);
+
+  std::string edited = replace(kProgram, "\t\tmove.l @a,@b\n", "\t\tmove.l @a,@b\n\t\t@spill b\n\t\tadd.l @b,@a\n\t\t@restore b\n");
+  EXPECT_EQ(translate(edited, plain), translate(edited, cached));
+  EXPECT_EQ(2u, cache.hits());
+
+  // Moving a procedure keeps its cache entry.
+  std::string moved = replace(kProgram, "\t\tnop\n", "\t\tnop\n\t\tnop\n\t\tnop\n");
+  EXPECT_EQ(translate(moved, plain), translate(moved, cached));
+}
+
+// Procedures that don't start from a clean register state depend on their
+// surroundings and are translated normally. @endproc resets everything, so
+// the ones after it are cached again.
+TEST(ProcCacheTest, ReservedRegistersBypassCache)
+{
+  const std::string text = std::string("\t\t@reserve d7\n") + kProgram;
+
+  ProcCache cache;
+  TranslateOptions cached;
+  cached.m_Cache = &cache;
+  EXPECT_EQ(translate(text), translate(text, cached));
+  EXPECT_EQ(2u, cache.size());
+}
+
+// Entries that don't fit the procedure they're found for (a hash collision,
+// or a sidecar from a broken build) are translated again, not replayed.
+TEST(ProcCacheTest, MismatchedEntriesAreTranslatedAgain)
+{
+  const std::string text = kProgram;
+  const size_t begin = text.find("\t\t@proc baz\n");
+  const size_t end = text.find("\t\tdc.l 0\n");
+  const StringFragment span(text.data() + begin, end - begin);
+
+  for (bool lineDirectives : { false, true })
+  {
+    TranslateOptions options;
+    options.m_LineDirectives = lineDirectives;
+    const std::string expected = translate(text, options);
+    const ProcCacheKey key = ProcCache::makeKey(span, lineDirectives);
+
+    ProcCache cache;
+    options.m_Cache = &cache;
+    translate(text, options);
+    ProcCacheEntry good = *cache.find(key);
+
+    // Text past the end of the span.
+    ProcCacheEntry entry = good;
+    for (ProcCacheElement& elem : entry.m_Elements)
+    {
+      if (ProcCacheElement::Source::kSpan == elem.m_Source)
+        elem.m_Offset = uint32_t(span.size());
+    }
+    cache.insert(key, std::move(entry));
+    EXPECT_EQ(expected, translate(text, options));
+
+    // No directive for the first line.
+    if (lineDirectives)
+    {
+      entry = good;
+      entry.m_Elements.clear();
+      cache.insert(key, std::move(entry));
+      EXPECT_EQ(expected, translate(text, options));
+    }
+  }
+}
+
+TEST(ProcCacheTest, SaveAndLoad)
+{
+  const std::string path = ::testing::TempDir() + "d68_proccache_test.d68inc";
+
+  TranslateOptions plain, cached;
+  plain.m_LineDirectives = cached.m_LineDirectives = true;
+
+  {
+    ProcCache cache;
+    cached.m_Cache = &cache;
+    translate(kProgram, cached);
+    ASSERT_TRUE(cache.save(path.c_str()));
+  }
+
+  ProcCache cache;
+  cached.m_Cache = &cache;
+  ASSERT_TRUE(cache.load(path.c_str()));
+  EXPECT_EQ(3u, cache.size());
+
+  std::string edited = replace(kProgram, "\t\tmoveq #0,@q\n", "\t\tmoveq #1,@q\n");
+  EXPECT_EQ(translate(edited, plain), translate(edited, cached));
+  EXPECT_EQ(2u, cache.hits());
+
+  // Only entries used in this run are written back.
+  ASSERT_TRUE(cache.save(path.c_str()));
+  ASSERT_TRUE(cache.load(path.c_str()));
+  EXPECT_EQ(3u, cache.size());
+
+  // Garbage is ignored rather than trusted.
+  FILE* f = fopen(path.c_str(), "wb");
+  fputs("D68Pnot really", f);
+  fclose(f);
+  EXPECT_FALSE(cache.load(path.c_str()));
+  EXPECT_EQ(0u, cache.size());
+
+  remove(path.c_str());
+}
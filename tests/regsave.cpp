@@ -35,8 +35,8 @@ TEST_F(DeluxeTest, MultiReg)
 {
   EXPECT_EQ(
         "foo:\n"
-        "\t\tmovem.l d7/a5/a6,-(sp)\n"
-        "\t\tmovem.l (sp)+,d7/a5/a6\n"
+        "\t\tmovem.l d7/a5-a6,-(sp)\n"
+        "\t\tmovem.l (sp)+,d7/a5-a6\n"
         "\t\trts\n",
       //---------------------
       xform(
@@ -64,15 +64,15 @@ TEST_F(DeluxeTest, StackSlots)
 {
   EXPECT_EQ(
         "foo:\n"
-        "\t\tmovem.l d6/d7,-(sp)\n"
+        "\t\tmovem.l d6-d7,-(sp)\n"
         "\t\tmove.l #$aaaaaaaa,d7\n"
         "\t\tmove.l #$bbbbbbbb,d6\n"
-        "\t\tmovem.l d6/d7,-(sp)\n"
+        "\t\tmovem.l d6-d7,-(sp)\n"
         "\t\tmove.l 4(sp),d7\n"
         "\t\tmove.l 0(sp),d6\n"
         "\t\tbsr ExternalProc\n"
-        "\t\tmovem.l (sp)+,d6/d7\n"
-        "\t\tmovem.l (sp)+,d6/d7\n"
+        "\t\tmovem.l (sp)+,d6-d7\n"
+        "\t\tmovem.l (sp)+,d6-d7\n"
         "\t\trts\n",
       //---------------------
       xform(
@@ -92,15 +92,15 @@ TEST_F(DeluxeTest, StackSlots2)
 {
   EXPECT_EQ(
         "foo:\n"
-        "\t\tmovem.l d6/d7,-(sp)\n"
+        "\t\tmovem.l d6-d7,-(sp)\n"
         "\t\tmove.l #$aaaaaaaa,d7\n"
         "\t\tmove.l #$bbbbbbbb,d6\n"
-        "\t\tmovem.l d6/d7,-(sp)\n"
+        "\t\tmovem.l d6-d7,-(sp)\n"
         "\t\tmove.l 4(sp),d7\n"
         "\t\tmove.l 0(sp),d6\n"
         "\t\tbsr ExternalProc\n"
-        "\t\tmovem.l (sp)+,d6/d7\n"
-        "\t\tmovem.l (sp)+,d6/d7\n"
+        "\t\tmovem.l (sp)+,d6-d7\n"
+        "\t\tmovem.l (sp)+,d6-d7\n"
         "\t\trts\n",
       //---------------------
       xform(
@@ -122,8 +122,8 @@ TEST_F(DeluxeTest, ReserveSaves)
 {
   EXPECT_EQ(
         "foo:\n"
-        "\t\tmovem.l d3/d4,-(sp)\n"
-        "\t\tmovem.l (sp)+,d3/d4\n"
+        "\t\tmovem.l d3-d4,-(sp)\n"
+        "\t\tmovem.l (sp)+,d3-d4\n"
         "\t\trts\n",
       //---------------------
       xform(
@@ -172,3 +172,41 @@ TEST_F(DeluxeTest, CProcSavesParamsModifies)
         "\t\t@cproc foo(d0:foo) modifies d0\n"
         "\t\t@endproc\n"));
 }
+
+static std::string registerList(uint32_t mask)
+{
+  char buf[kRegisterListMax];
+  return std::string(buf, formatRegisterList(buf, mask));
+}
+
+// Runs of two or more registers are written as ranges, one class at a time.
+TEST(RegisterList, Ranges)
+{
+  EXPECT_EQ("", registerList(0));
+  EXPECT_EQ("d0", registerList(0x0001));
+  EXPECT_EQ("d0-d1", registerList(0x0003));
+  EXPECT_EQ("d0-d3/a0-a1", registerList(0x030f));
+  EXPECT_EQ("d7/a0", registerList(0x0180));
+  EXPECT_EQ("a6", registerList(0x4000));
+  EXPECT_EQ("d0-d7/a0-a7", registerList(0xffff));
+  EXPECT_EQ("d0/d2/d4/d6/a1/a3/a5/a7", registerList(0xaa55));
+  EXPECT_EQ(kRegisterListMax, registerList(0xdbdb).size());
+}
+
+TEST(RegisterList, ParsesWhatItFormats)
+{
+  for (uint32_t mask = 0; mask < 0x10000; mask += 0x0123)
+  {
+    const std::string text = registerList(mask);
+    uint32_t parsed = ~0u;
+    ASSERT_TRUE(parseRegisterList(text.data(), text.size(), &parsed)) << text;
+    EXPECT_EQ(mask, parsed) << text;
+  }
+
+  uint32_t mask;
+  EXPECT_FALSE(parseRegisterList("d0-a1", 5, &mask));
+  EXPECT_FALSE(parseRegisterList("d3-d1", 5, &mask));
+  EXPECT_FALSE(parseRegisterList("d0/", 3, &mask));
+  EXPECT_FALSE(parseRegisterList("d0,d1", 5, &mask));
+  EXPECT_FALSE(parseRegisterList("sp", 2, &mask));
+}
@@ -0,0 +1,129 @@
+#include "deluxe.h"
+#include "d68test.h"
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  const char kFirst[] =
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n";
+
+  const char kSecond[] =
+    "; some code\n"
+    "\t\t@cproc bar(d0:x) modifies d0\n"
+    "\t\t@areg p\n"
+    "\t\tlea (@p),@p\n"
+    "\t\t@endproc\n"
+    "\t\t@proc foo\n"
+    "\t\t@endproc\n";
+
+  const char kBroken[] =
+    "\t\t@proc foo\n"
+    "\t\t@dreg a\n"
+    "\t\tmove.l @nope,d0\n";
+
+  std::string translateFresh(const char* text, bool lineDirectives)
+  {
+    TranslateOptions options;
+    options.m_LineDirectives = lineDirectives;
+    return translate(text, options);
+  }
+}
+
+// Nothing from an earlier input (names, procedures, errors, line numbers)
+// may leak into the next one.
+TEST(ReuseTest, ResetMatchesFreshTranslator)
+{
+  Deluxe68 d;
+  std::string diagnostics;
+  d.setDiagnosticCallback(appendToString, &diagnostics);
+
+  const char* inputs[] = { kFirst, kBroken, kSecond, kFirst, kSecond };
+
+  for (const char* text : inputs)
+  {
+    for (int directives = 0; directives < 2; ++directives)
+    {
+      diagnostics.clear();
+      d.reset("test.s", text, strlen(text), 0 != directives, false);
+      d.run();
+
+      if (text == kBroken)
+      {
+        EXPECT_EQ(1, d.errorCount());
+        EXPECT_EQ("test.s(3): unknown register 'nope' referenced\n", diagnostics);
+        continue;
+      }
+
+      EXPECT_EQ(0, d.errorCount());
+      EXPECT_EQ("", diagnostics);
+
+      std::string output;
+      d.generateOutput(appendToString, &output);
+      EXPECT_EQ(translateFresh(text, 0 != directives), output);
+    }
+  }
+}
+
+// Separate translators on separate threads, each reporting through its own
+// callback.
+TEST(ReuseTest, ConcurrentTranslators)
+{
+  const std::string expected = translateFresh(kSecond, true);
+
+  std::vector<std::string> outputs(4);
+  std::vector<std::string> diagnostics(4);
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < outputs.size(); ++i)
+  {
+    threads.emplace_back([&, i]()
+    {
+      Deluxe68 d;
+      d.setDiagnosticCallback(appendToString, &diagnostics[i]);
+
+      for (int round = 0; round < 50; ++round)
+      {
+        d.reset("test.s", kBroken, strlen(kBroken), true, false);
+        d.run();
+
+        outputs[i].clear();
+        d.reset("test.s", kSecond, strlen(kSecond), true, false);
+        d.run();
+        d.generateOutput(appendToString, &outputs[i]);
+      }
+    });
+  }
+
+  for (std::thread& t : threads)
+    t.join();
+
+  for (size_t i = 0; i < outputs.size(); ++i)
+  {
+    EXPECT_EQ(expected, outputs[i]);
+    EXPECT_EQ(50u * strlen("test.s(3): unknown register 'nope' referenced\n"), diagnostics[i].size());
+  }
+}
+
+// generateOutput() leaves the translator alone, so it can run repeatedly.
+TEST(ReuseTest, GenerateOutputIsRepeatable)
+{
+  Deluxe68 d("test.s", kFirst, strlen(kFirst), true, true);
+  d.run();
+
+  std::string first, second;
+  d.generateOutput(appendToString, &first);
+  d.generateOutput(appendToString, &second);
+  EXPECT_FALSE(first.empty());
+  EXPECT_EQ(first, second);
+}
@@ -0,0 +1,85 @@
+#include "scan.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string>
+
+namespace
+{
+  const char* referenceFind(const char* p, const char* end, const char* chars)
+  {
+    for (; p != end; ++p)
+    {
+      for (const char* c = chars; *c; ++c)
+      {
+        if (*c == *p)
+          return p;
+      }
+    }
+    return end;
+  }
+
+  // Every start alignment and length across the vector widths, with hits at
+  // random positions and none at all.
+  void checkAgainstReference()
+  {
+    srand(1234);
+
+    std::string buffer(200, 'x');
+    const char* base = buffer.data();
+
+    for (int trial = 0; trial < 50; ++trial)
+    {
+      for (char& ch : buffer)
+      {
+        int r = rand() % 64;
+        ch = r == 0 ? '\n' : r == 1 ? '@' : r == 2 ? ';' : char('a' + r % 26);
+      }
+
+      for (size_t start = 0; start < 40; ++start)
+      {
+        for (size_t len = 0; start + len <= buffer.size(); ++len)
+        {
+          const char* p = base + start;
+          const char* end = p + len;
+
+          ASSERT_EQ(referenceFind(p, end, "\n"), findNewline(p, end));
+          ASSERT_EQ(referenceFind(p, end, "@;"), findAtOrSemicolon(p, end));
+        }
+      }
+    }
+
+    std::string plain(100, 'q');
+    const char* end = plain.data() + plain.size();
+    EXPECT_EQ(end, findNewline(plain.data(), end));
+    EXPECT_EQ(end, findAtOrSemicolon(plain.data(), end));
+  }
+}
+
+TEST(ScanTest, MatchesReference)
+{
+  const ScanLevel saved = scanLevel();
+
+  for (int level = 0; level <= int(detectScanLevel()); ++level)
+  {
+    SCOPED_TRACE(scanLevelName(ScanLevel(level)));
+    ASSERT_TRUE(setScanLevel(ScanLevel(level)));
+    checkAgainstReference();
+  }
+
+  setScanLevel(saved);
+}
+
+TEST(ScanTest, RejectsUnsupportedLevel)
+{
+  const ScanLevel saved = scanLevel();
+
+  if (detectScanLevel() != ScanLevel::kAVX2)
+  {
+    EXPECT_FALSE(setScanLevel(ScanLevel::kAVX2));
+    EXPECT_EQ(saved, scanLevel());
+  }
+
+  EXPECT_TRUE(setScanLevel(ScanLevel::kScalar));
+  setScanLevel(saved);
+}
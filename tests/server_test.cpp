@@ -0,0 +1,174 @@
+#include "server.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace
+{
+  class ServerTest : public ::testing::Test
+  {
+  protected:
+    std::string       m_SocketPath;
+    TranslationServer m_Server;
+    std::thread       m_Thread;
+
+    void SetUp() override
+    {
+      m_SocketPath = ::testing::TempDir() + "d68_server_test.sock";
+      ASSERT_TRUE(m_Server.listen(m_SocketPath.c_str()));
+      m_Thread = std::thread([this]() { m_Server.run(2); });
+    }
+
+    void TearDown() override
+    {
+      m_Server.stop();
+      if (m_Thread.joinable())
+        m_Thread.join();
+    }
+  };
+
+  // A client that speaks the wire format by hand.
+  int connectRaw(const std::string& socketPath)
+  {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof addr.sun_path - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && 0 != connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr))
+    {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  const char kSource[] =
+    "\t\t@proc foo\n"
+    "\t\t@dreg a\n"
+    "\t\tmoveq #0,@a\n"
+    "\t\t@endproc\n";
+}
+
+TEST_F(ServerTest, InlineMatchesLocal)
+{
+  ServerRequest request;
+  request.m_Inline = true;
+  request.m_EmitLineDirectives = true;
+  request.m_DisplayName = "foo.s";
+  request.m_Text = kSource;
+
+  ServerResponse local;
+  translateRequest(request, &local);
+  ASSERT_EQ(0, local.m_ErrorCount);
+
+  // Several requests, so warm workers get reused.
+  for (int i = 0; i < 4; ++i)
+  {
+    ServerResponse remote;
+    ASSERT_TRUE(sendServerRequest(m_SocketPath.c_str(), request, &remote));
+    EXPECT_EQ(0, remote.m_ErrorCount);
+    EXPECT_EQ("", remote.m_Diagnostics);
+    EXPECT_EQ(local.m_Output, remote.m_Output);
+    EXPECT_NE(std::string::npos, remote.m_Output.find("tbl_line 1 foo.s"));
+  }
+}
+
+TEST_F(ServerTest, DiagnosticsAreReturned)
+{
+  ServerRequest request;
+  request.m_Inline = true;
+  request.m_DisplayName = "bad.s";
+  request.m_Text = "\t\tmove.l @nope,d0\n";
+
+  ServerResponse response;
+  ASSERT_TRUE(sendServerRequest(m_SocketPath.c_str(), request, &response));
+  EXPECT_EQ(1, response.m_ErrorCount);
+  EXPECT_EQ("bad.s(1): unknown register 'nope' referenced\n", response.m_Diagnostics);
+  EXPECT_EQ("", response.m_Output);
+}
+
+TEST_F(ServerTest, TranslatesFiles)
+{
+  std::string input = ::testing::TempDir() + "d68_server_in.s";
+  std::string output = ::testing::TempDir() + "d68_server_out.s";
+
+  FILE* f = fopen(input.c_str(), "wb");
+  fputs(kSource, f);
+  fclose(f);
+
+  int exitCode = -1;
+  ASSERT_TRUE(translateFileViaServer(m_SocketPath.c_str(), input.c_str(), output.c_str(), DriverOptions(), &exitCode));
+  EXPECT_EQ(0, exitCode);
+
+  f = fopen(output.c_str(), "rb");
+  ASSERT_NE(nullptr, f);
+  char buf[256] = { 0 };
+  fread(buf, 1, sizeof buf - 1, f);
+  fclose(f);
+  EXPECT_NE(nullptr, strstr(buf, "moveq #0,d7"));
+
+  remove(input.c_str());
+  remove(output.c_str());
+}
+
+// A length the server has no business allocating for closes the connection,
+// and the server carries on.
+TEST_F(ServerTest, DropsOversizedMessages)
+{
+  int fd = connectRaw(m_SocketPath);
+  ASSERT_GE(fd, 0);
+
+  char header[12];
+  const uint32_t magic = 0x52383644;
+  const uint64_t len = uint64_t(1) << 40;
+  memcpy(header, &magic, sizeof magic);
+  memcpy(header + sizeof magic, &len, sizeof len);
+  ASSERT_EQ(ssize_t(sizeof header), write(fd, header, sizeof header));
+
+  char reply;
+  EXPECT_EQ(0, read(fd, &reply, 1));
+  close(fd);
+
+  ServerRequest request;
+  request.m_Inline = true;
+  request.m_DisplayName = "foo.s";
+  request.m_Text = kSource;
+  ServerResponse response;
+  EXPECT_TRUE(sendServerRequest(m_SocketPath.c_str(), request, &response));
+  EXPECT_EQ(0, response.m_ErrorCount);
+}
+
+// A client that connects and says nothing doesn't keep stop() waiting.
+TEST_F(ServerTest, StopsWithIdleClient)
+{
+  int fd = connectRaw(m_SocketPath);
+  ASSERT_GE(fd, 0);
+
+  // Let a worker pick the connection up.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  auto start = std::chrono::steady_clock::now();
+  m_Server.stop();
+  m_Thread.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+
+  close(fd);
+}
+
+TEST(Server, UnreachableFallsBack)
+{
+  int exitCode = -1;
+  EXPECT_FALSE(translateFileViaServer("/nonexistent/d68.sock", "in.s", "out.s", DriverOptions(), &exitCode));
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "deluxe.h"
+#include "proccache.h"
+#include "signatures.h"
+#include "d68test.h"
+
+#include <string.h>
+
+#include <string>
+
+namespace
+{
+  const char kLibrary[] =
+    "\t\t@cproc Helper(a0:ptr) modifies d0\n"
+    "\t\t@dreg t\n"
+    "\t\tmove.l (@ptr),@t\n"
+    "\t\tmove.l @t,d0\n"
+    "\t\t@endproc\n"
+    "\t\t@proc Fill(a0:dst, d0:count)\n"
+    "\t\t@areg p\n"
+    "\t\tmove.l @dst,@p\n"
+    "\t\t@endproc\n";
+
+  // x, y and p live in d7, d6 and a6.
+  const char kCaller[] =
+    "\t\t@proc Main(a1:src)\n"
+    "\t\t@dreg x, y\n"
+    "\t\t@areg p\n"
+    "\t\tmove.l @src,@x\n"
+    "\t\t@call Ext\n"
+    "\t\t@endproc\n";
+
+}
+
+TEST(Signatures, Export)
+{
+  Deluxe68 d("lib.s", kLibrary, strlen(kLibrary), false, false);
+  d.run();
+  ASSERT_EQ(0, d.errorCount());
+
+  std::string text;
+  StringSink sink(&text);
+  d.generateSignatures(sink);
+
+  // Helper puts back everything but its result; Fill doesn't save its
+  // inputs.
+  EXPECT_EQ(std::string(kSignatureFileHeader) +
+      "Helper a0 d0\n"
+      "Fill d0/a0 d0/a0\n", text);
+}
+
+TEST(Signatures, ParseAndFind)
+{
+  const char text[] =
+    "; comment\n"
+    "\n"
+    "Clear d0/a0 d0-d1/a0-a1\n"
+    "Nothing - -\r\n"
+    "Clear - d7\n";
+
+  SignatureDb db;
+  ASSERT_TRUE(db.parse("x.sig", text, strlen(text)));
+  EXPECT_EQ(2u, db.size());
+
+  // The later line wins.
+  const ProcSignature* clear = db.find("Clear");
+  ASSERT_NE(nullptr, clear);
+  EXPECT_EQ(0u, clear->m_InputRegs);
+  EXPECT_EQ(1u << kD7, clear->m_Clobbers);
+
+  const ProcSignature* nothing = db.find("Nothing");
+  ASSERT_NE(nullptr, nothing);
+  EXPECT_EQ(0u, nothing->m_Clobbers);
+
+  EXPECT_EQ(nullptr, db.find("Missing"));
+
+  SignatureDb bad;
+  EXPECT_FALSE(bad.parse("bad.sig", "Foo d0\n", 7));
+  EXPECT_FALSE(bad.parse("bad.sig", "Foo d0 d0-a1\n", 13));
+  EXPECT_FALSE(bad.parse("bad.sig", "Foo d0 d8 d0\n", 13));
+}
+
+TEST(Signatures, ManyProcedures)
+{
+  std::string text;
+  for (int i = 0; i < 50000; ++i)
+    text += "proc_" + std::to_string(i) + (i & 1 ? " d0 d0/a0\n" : " - d1\n");
+
+  SignatureDb db;
+  ASSERT_TRUE(db.parse("many.sig", text.data(), text.size()));
+  EXPECT_EQ(50000u, db.size());
+
+  for (int i = 0; i < 50000; ++i)
+  {
+    const std::string name = "proc_" + std::to_string(i);
+    const ProcSignature* signature = db.find(StringFragment(name.data(), name.size()));
+    ASSERT_NE(nullptr, signature);
+    ASSERT_EQ(i & 1 ? (1u << kD0 | 1u << kA0) : 1u << kD1, signature->m_Clobbers);
+  }
+}
+
+// Only live registers the callee clobbers are spilled around the bsr.
+TEST(Signatures, CallSpillsClobberedRegisters)
+{
+  const char sig[] = "Ext d1 d1/d7/a1-a2\n";
+  SignatureDb db;
+  ASSERT_TRUE(db.parse("ext.sig", sig, strlen(sig)));
+
+  TranslateOptions options;
+  options.m_Signatures = &db;
+  std::string output = translate(kCaller, options);
+  EXPECT_NE(std::string::npos, output.find(
+      "\t\tmovem.l d7/a1,-(sp)\n"
+      "\t\tbsr\tExt\n"
+      "\t\tmovem.l (sp)+,d7/a1\n"));
+
+  // Main saves what Ext doesn't.
+  EXPECT_NE(std::string::npos, output.find("Main:\n\t\tmovem.l d1/d6-d7/a2/a6,-(sp)\n"));
+
+  // Without a signature everything live is spilled.
+  output = translate(kCaller);
+  EXPECT_NE(std::string::npos, output.find(
+      "\t\tmovem.l d6-d7/a1/a6,-(sp)\n"
+      "\t\tbsr\tExt\n"
+      "\t\tmovem.l (sp)+,d6-d7/a1/a6\n"));
+}
+
+// Procedures defined further up the same file need no import.
+TEST(Signatures, CallsLocalProcedure)
+{
+  const std::string text = std::string(kLibrary) +
+    "\t\t@proc Main(d0:n, a0:q)\n"
+    "\t\t@call Helper\n"
+    "\t\t@call Fill\n"
+    "\t\t@endproc\n";
+
+  const std::string output = translate(text);
+  EXPECT_NE(std::string::npos, output.find(
+      "\t\tmovem.l d0,-(sp)\n"
+      "\t\tbsr\tHelper\n"
+      "\t\tmovem.l (sp)+,d0\n"));
+  EXPECT_NE(std::string::npos, output.find(
+      "\t\tmovem.l d0/a0,-(sp)\n"
+      "\t\tbsr\tFill\n"
+      "\t\tmovem.l (sp)+,d0/a0\n"));
+}
+
+// Procedures with @call depend on what came before them, so they are left
+// out of parallel translation and the procedure cache.
+TEST(Signatures, CallsTranslatedInPlace)
+{
+  const std::string text = std::string(kLibrary) + kCaller +
+    "\t\t@proc Other\n"
+    "\t\t@dreg d\n"
+    "\t\t@call Helper\n"
+    "\t\t@endproc\n";
+
+  const std::string serial = translate(text);
+
+  TranslateOptions parallel;
+  parallel.m_Threads = 4;
+  EXPECT_EQ(serial, translate(text, parallel));
+
+  ProcCache cache;
+  TranslateOptions cached;
+  cached.m_Cache = &cache;
+  EXPECT_EQ(serial, translate(text, cached));
+  EXPECT_EQ(serial, translate(text, cached));
+  EXPECT_EQ(2u, cache.size());
+}
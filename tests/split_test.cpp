@@ -0,0 +1,148 @@
+#include "deluxe.h"
+#include "proccache.h"
+#include "d68test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // Lines that make it into the output end in "; L<line number>".
+  const char kProgram[] =
+    "\t\tsection code,code\t; L1\n"
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\t; L4\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\t; L6\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "\t\tnop\t; L9\n"
+    "\t\t@cproc bar(d0:x) modifies d0\n"
+    "\t\t@areg p\n"
+    "\t\tlea (@p),@p\t; L12\n"
+    "\t\t@endproc\n"
+    "\t\t@proc baz\n"
+    "\t\t@endproc\n"
+    "\t\tdc.w 1\t; L16\n";
+
+  struct Parts
+  {
+    std::string              m_Prologue;
+    std::vector<std::string> m_Names;
+    std::vector<std::string> m_Procs;
+  };
+
+  Parts split(bool lineDirectives, int threads = 1, ProcCache* cache = nullptr)
+  {
+    Parts parts;
+    Deluxe68 d("test.s", kProgram, strlen(kProgram), lineDirectives, false);
+    d.setSplitOutput(true);
+    d.setProcedureThreads(threads);
+    d.setProcedureCache(cache);
+    d.run();
+    EXPECT_EQ(0, d.errorCount());
+
+    StringSink prologue(&parts.m_Prologue);
+    d.generatePrologueOutput(prologue);
+
+    for (size_t i = 0; i < d.procedureOutputCount(); ++i)
+    {
+      const StringFragment name = d.procedureOutputName(i);
+      parts.m_Names.push_back(std::string(name.ptr(), name.size()));
+      parts.m_Procs.emplace_back();
+      StringSink sink(&parts.m_Procs.back());
+      d.generateProcedureOutput(sink, i);
+    }
+    return parts;
+  }
+
+  // Follows the tbl_line directives through one part; returns the number
+  // of marked lines.
+  int checkLines(const std::string& part)
+  {
+    int line = 0;
+    int marked = 0;
+
+    EXPECT_EQ(0u, part.find("\t\ttbl_line ")) << part;
+
+    for (size_t pos = 0; pos < part.size(); )
+    {
+      size_t nl = part.find('\n', pos);
+      std::string text = part.substr(pos, nl - pos);
+      pos = nl + 1;
+
+      if (0 == text.find("\t\ttbl_line "))
+      {
+        line = atoi(text.c_str() + 11);
+        continue;
+      }
+
+      size_t mark = text.find("; L");
+      if (std::string::npos != mark)
+      {
+        EXPECT_EQ(atoi(text.c_str() + mark + 3), line) << text;
+        ++marked;
+      }
+      ++line;
+    }
+
+    return marked;
+  }
+}
+
+// Without line directives the parts are exactly the pieces of the whole.
+TEST(SplitTest, PartsCoverOutput)
+{
+  const std::string whole = translate(kProgram);
+
+  Parts parts = split(false);
+  ASSERT_EQ(3u, parts.m_Names.size());
+  EXPECT_EQ("foo", parts.m_Names[0]);
+  EXPECT_EQ("bar", parts.m_Names[1]);
+  EXPECT_EQ("baz", parts.m_Names[2]);
+
+  EXPECT_EQ("\t\tsection code,code\t; L1\n\t\tnop\t; L9\n\t\tdc.w 1\t; L16\n", parts.m_Prologue);
+  EXPECT_EQ(0u, parts.m_Procs[1].find("\t\t; \t\t@cproc bar"));
+
+  size_t total = parts.m_Prologue.size();
+  for (const std::string& proc : parts.m_Procs)
+  {
+    EXPECT_NE(std::string::npos, whole.find(proc));
+    total += proc.size();
+  }
+  EXPECT_EQ(whole.size(), total);
+}
+
+// Each part is assembled on its own, so each starts with a line directive.
+TEST(SplitTest, PartsHaveLineDirectives)
+{
+  Parts parts = split(true);
+  int marked = checkLines(parts.m_Prologue);
+  for (const std::string& proc : parts.m_Procs)
+    marked += checkLines(proc);
+  EXPECT_EQ(6, marked);
+}
+
+TEST(SplitTest, ParallelAndCachedMatchSerial)
+{
+  for (int directives = 0; directives < 2; ++directives)
+  {
+    Parts serial = split(0 != directives);
+
+    Parts parallel = split(0 != directives, 4);
+    EXPECT_EQ(serial.m_Prologue, parallel.m_Prologue);
+    EXPECT_EQ(serial.m_Names, parallel.m_Names);
+    EXPECT_EQ(serial.m_Procs, parallel.m_Procs);
+
+    ProcCache cache;
+    split(0 != directives, 1, &cache);
+    Parts cached = split(0 != directives, 1, &cache);
+    EXPECT_LT(0u, cache.hits());
+    EXPECT_EQ(serial.m_Prologue, cached.m_Prologue);
+    EXPECT_EQ(serial.m_Names, cached.m_Names);
+    EXPECT_EQ(serial.m_Procs, cached.m_Procs);
+  }
+}
@@ -0,0 +1,180 @@
+#include "deluxe.h"
+#include "proccache.h"
+#include "stats.h"
+#include "d68test.h"
+
+#include <string.h>
+#include <string>
+
+namespace
+{
+  const char kProgram[] =
+    "\t\t@proc foo(a0:ptr)\n"
+    "\t\t@dreg a,b\n"
+    "\t\tmove.l (@ptr)+,@a\n"
+    "\t\t@spill a\n"
+    "\t\tmove.l @a,@b\n"
+    "\t\t@restore a\n"
+    "\t\t@endproc\n"
+    "; comment\n"
+    "\t\t@cproc bar(d0:x) modifies d0\n"
+    "\t\t@areg p,q,r\n"
+    "\t\t@rename p s\n"
+    "\t\tlea (@s),@q\n"
+    "\t\t@endproc\n";
+
+  TranslationStats collect(TranslateOptions options, std::string* output)
+  {
+    TranslationStats stats;
+    options.m_Stats = &stats;
+    *output = translate(kProgram, options);
+    return stats;
+  }
+
+  TranslationStats collect(bool streaming, std::string* output)
+  {
+    TranslateOptions options;
+    options.m_Streaming = streaming;
+    return collect(options, output);
+  }
+
+  void expectSameCounts(const TranslationStats& a, const TranslationStats& b)
+  {
+    EXPECT_EQ(a.m_Lines, b.m_Lines);
+    EXPECT_EQ(a.m_Procedures, b.m_Procedures);
+    EXPECT_EQ(a.m_OutputElements, b.m_OutputElements);
+    EXPECT_EQ(a.m_NameReferences, b.m_NameReferences);
+    EXPECT_EQ(a.m_Spills, b.m_Spills);
+    EXPECT_EQ(a.m_Restores, b.m_Restores);
+    EXPECT_EQ(a.m_PeakLiveNames, b.m_PeakLiveNames);
+    EXPECT_EQ(a.m_LargestSaveMask, b.m_LargestSaveMask);
+    EXPECT_EQ(0, memcmp(a.m_Directives, b.m_Directives, sizeof a.m_Directives));
+  }
+}
+
+TEST(StatsTest, CountsTranslation)
+{
+  std::string output;
+  TranslationStats stats = collect(false, &output);
+
+  EXPECT_EQ(13u, stats.m_Lines);
+  EXPECT_EQ(2u, stats.m_Procedures);
+  EXPECT_EQ(1u, stats.m_Directives[size_t(TokenType::kProc)]);
+  EXPECT_EQ(1u, stats.m_Directives[size_t(TokenType::kCProc)]);
+  EXPECT_EQ(2u, stats.m_Directives[size_t(TokenType::kEndProc)]);
+  EXPECT_EQ(1u, stats.m_Directives[size_t(TokenType::kDreg)]);
+  EXPECT_EQ(1u, stats.m_Directives[size_t(TokenType::kAreg)]);
+  EXPECT_EQ(1u, stats.m_Directives[size_t(TokenType::kRename)]);
+  EXPECT_EQ(1u, stats.m_Spills);
+  EXPECT_EQ(1u, stats.m_Restores);
+  EXPECT_EQ(6u, stats.m_NameReferences);
+  EXPECT_EQ(4u, stats.m_PeakLiveNames);
+
+  // bar saves the address registers it allocates, minus the d0 it returns.
+  EXPECT_EQ("bar", stats.m_LargestSaveProc);
+  EXPECT_EQ(0x7000u, stats.m_LargestSaveMask);
+
+  EXPECT_LE(stats.m_Symbols, stats.m_SymbolSlots);
+  EXPECT_GT(stats.m_OutputElements, 0u);
+}
+
+// Streaming writes the schedule out in pieces; the counts stay the same, and
+// so does the output.
+TEST(StatsTest, StreamingCountsTheSame)
+{
+  std::string buffered, streamed;
+  TranslationStats a = collect(false, &buffered);
+  TranslationStats b = collect(true, &streamed);
+
+  EXPECT_EQ(buffered, streamed);
+  EXPECT_EQ(a.m_OutputElements, b.m_OutputElements);
+  EXPECT_EQ(a.m_NameReferences, b.m_NameReferences);
+  EXPECT_EQ(0, memcmp(a.m_Directives, b.m_Directives, sizeof a.m_Directives));
+
+  EXPECT_EQ(translate(kProgram), buffered);
+}
+
+// Procedures translated on other threads count as if translated in place.
+TEST(StatsTest, ParallelCountsTheSame)
+{
+  for (int lineDirectives = 0; lineDirectives < 2; ++lineDirectives)
+  {
+    for (CompactMode compact : { CompactMode::kNone, CompactMode::kNoComments })
+    {
+      TranslateOptions options;
+      options.m_LineDirectives = 0 != lineDirectives;
+      options.m_Compact = compact;
+
+      std::string serial, parallel;
+      TranslationStats a = collect(options, &serial);
+      options.m_Threads = 4;
+      TranslationStats b = collect(options, &parallel);
+
+      EXPECT_EQ(serial, parallel);
+      expectSameCounts(a, b);
+    }
+  }
+}
+
+// So do procedures replayed from the procedure cache, including directives
+// that compact output doesn't echo.
+TEST(StatsTest, IncrementalCountsTheSame)
+{
+  for (CompactMode compact : { CompactMode::kNone, CompactMode::kNoComments })
+  {
+    TranslateOptions options;
+    options.m_LineDirectives = true;
+    options.m_Compact = compact;
+
+    std::string plain;
+    TranslationStats a = collect(options, &plain);
+
+    ProcCache cache;
+    options.m_Cache = &cache;
+    std::string recorded, replayed;
+    TranslationStats b = collect(options, &recorded);
+    EXPECT_EQ(0u, cache.hits());
+    TranslationStats c = collect(options, &replayed);
+    EXPECT_EQ(2u, cache.hits());
+
+    EXPECT_EQ(plain, recorded);
+    EXPECT_EQ(plain, replayed);
+    expectSameCounts(a, b);
+    expectSameCounts(a, c);
+
+    // Through a sidecar file, too.
+    const std::string path = ::testing::TempDir() + "d68_stats_test.procs";
+    ASSERT_TRUE(cache.save(path.c_str()));
+    ProcCache loaded;
+    ASSERT_TRUE(loaded.load(path.c_str()));
+    options.m_Cache = &loaded;
+    std::string reloaded;
+    TranslationStats d = collect(options, &reloaded);
+    EXPECT_EQ(2u, loaded.hits());
+    EXPECT_EQ(plain, reloaded);
+    expectSameCounts(a, d);
+    remove(path.c_str());
+  }
+}
+
+TEST(StatsTest, PrintsJson)
+{
+  std::string output;
+  TranslationStats stats = collect(false, &output);
+
+  FILE* f = tmpfile();
+  printStats(f, "dir/\"quoted\".s", stats, true);
+  rewind(f);
+  char buf[4096];
+  size_t n = fread(buf, 1, sizeof buf - 1, f);
+  buf[n] = '\0';
+  fclose(f);
+
+  std::string json = buf;
+  EXPECT_EQ(0u, json.find("{\"file\":\"dir/\\\"quoted\\\".s\""));
+  EXPECT_NE(std::string::npos, json.find("\"lines\":13"));
+  EXPECT_NE(std::string::npos, json.find("\"spill\":1"));
+  EXPECT_NE(std::string::npos, json.find("\"largest_save_set\":{\"proc\":\"bar\",\"registers\":3,\"list\":\"a4-a6\"}"));
+  EXPECT_EQ('\n', json.back());
+  EXPECT_EQ(json.size() - 1, json.find('\n'));
+}
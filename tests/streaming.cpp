@@ -0,0 +1,68 @@
+#include "deluxe.h"
+#include "d68test.h"
+
+static const char kTwoProcs[] =
+  "\t\tsection code,code\n"
+  "\t\t@proc foo(a0:ptr)\n"
+  "\t\t@dreg a,b\n"
+  "\t\tmove.l (@ptr)+,@a\n"
+  "\t\t@spill a\n"
+  "\t\tmove.l @a,@b\n"
+  "\t\t@restore a\n"
+  "\t\t@endproc\n"
+  "\t\tnop\n"
+  "\t\t@cproc bar(d0:x) modifies d0\n"
+  "\t\t@areg p\n"
+  "\t\tlea (@p),@p\n"
+  "\t\t@endproc\n"
+  "\t\tdc.l 0";
+
+TEST_F(DeluxeTest, StreamingMatchesBuffered)
+{
+  std::string buffered = xform(kTwoProcs);
+  output.clear();
+  EXPECT_EQ(buffered, xformStreaming(kTwoProcs));
+}
+
+TEST_F(DeluxeTest, StreamingMatchesBufferedWithLineDirectives)
+{
+  std::string buffered = xform(kTwoProcs, true);
+  output.clear();
+  std::string streamed = xformStreaming(kTwoProcs, true);
+  EXPECT_EQ(buffered, streamed);
+}
+
+// The procedure header is scheduled before the save mask is known. Streaming
+// must not emit it until @endproc.
+TEST_F(DeluxeTest, StreamingHeaderUsesFinalMask)
+{
+  EXPECT_EQ(
+        "foo:\n"
+        "\t\tmovem.l d6-d7,-(sp)\n"
+        "\t\tmovem.l (sp)+,d6-d7\n"
+        "\t\trts\n",
+      //---------------------
+      xformStreaming(
+        "\t\t@proc foo\n"
+        "\t\t@dreg a\n"
+        "\t\t@dreg b\n"
+        "\t\t@endproc\n"));
+}
+
+TEST(OutputElement, Packing)
+{
+  OutputElement text(OutputKind::kEchoLine, TextSource::kExtra, 0xfffffff0u, OutputElement::kMaxSize);
+  EXPECT_EQ(OutputKind::kEchoLine, text.kind());
+  EXPECT_EQ(TextSource::kExtra, text.source());
+  EXPECT_EQ(0xfffffff0u, text.offset());
+  EXPECT_EQ(OutputElement::kMaxSize, text.size());
+
+  OutputElement value(OutputKind::kStackVar, -12);
+  EXPECT_EQ(OutputKind::kStackVar, value.kind());
+  EXPECT_EQ(-12, value.intValue());
+
+  OutputElement note(OutputKind::kLiveRegNote, 1234, 15);
+  EXPECT_EQ(OutputKind::kLiveRegNote, note.kind());
+  EXPECT_EQ(1234, note.intValue());
+  EXPECT_EQ(15u, note.extra());
+}
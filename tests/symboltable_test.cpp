@@ -0,0 +1,72 @@
+#include "symboltable.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+TEST(SymbolTable, InternIsStable)
+{
+  SymbolTable table;
+
+  SymbolId a = table.intern("alpha");
+  SymbolId b = table.intern("beta");
+
+  EXPECT_EQ(0u, a);
+  EXPECT_EQ(1u, b);
+  EXPECT_EQ(a, table.intern("alpha"));
+  EXPECT_EQ(b, table.find("beta"));
+  EXPECT_EQ(kNoSymbol, table.find("gamma"));
+  EXPECT_EQ(StringFragment("alpha"), table.name(a));
+}
+
+// Names are copied, so the table doesn't depend on the input buffer.
+TEST(SymbolTable, OwnsNames)
+{
+  SymbolTable table;
+
+  std::string text = "counter";
+  SymbolId id = table.intern(StringFragment(text.data(), text.size()));
+  text = "xxxxxxx";
+
+  EXPECT_EQ(StringFragment("counter"), table.name(id));
+  EXPECT_EQ(id, table.find("counter"));
+}
+
+TEST(SymbolTable, GrowsAndClears)
+{
+  SymbolTable table;
+  std::vector<std::string> names;
+
+  for (int i = 0; i < 5000; ++i)
+    names.push_back("name_" + std::to_string(i * 7919));
+
+  for (size_t i = 0; i < names.size(); ++i)
+    ASSERT_EQ(SymbolId(i), table.intern(StringFragment(names[i].data(), names[i].size())));
+
+  EXPECT_EQ(names.size(), table.size());
+  EXPECT_LE(table.size() * 2, table.capacity());
+
+  for (size_t i = 0; i < names.size(); ++i)
+    ASSERT_EQ(SymbolId(i), table.find(StringFragment(names[i].data(), names[i].size())));
+
+  const size_t capacity = table.capacity();
+  table.clear();
+
+  EXPECT_EQ(0u, table.size());
+  EXPECT_EQ(capacity, table.capacity());
+  EXPECT_EQ(kNoSymbol, table.find("name_0"));
+  EXPECT_EQ(0u, table.intern("name_7919"));
+}
+
+// Lengths around the word size hash their tails correctly.
+TEST(SymbolTable, PrefixesAreDistinct)
+{
+  SymbolTable table;
+  const std::string base = "abcdefghijklmnopqrstuvwxyz";
+
+  for (size_t len = 1; len <= base.size(); ++len)
+    ASSERT_EQ(SymbolId(len - 1), table.intern(StringFragment(base.data(), len)));
+
+  for (size_t len = 1; len <= base.size(); ++len)
+    ASSERT_EQ(SymbolId(len - 1), table.find(StringFragment(base.data(), len)));
+}
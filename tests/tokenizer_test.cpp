@@ -106,3 +106,40 @@ TEST(Tokenizer, Keywords)
   Token eol = tokenizer.next();
   EXPECT_EQ(TokenType::kEndOfLine, eol.m_Type);
 }
+
+TEST(Tokenizer, KeywordTable)
+{
+  static const struct { const char* text; TokenType type; } keywords[] =
+  {
+    { "dreg", TokenType::kDreg }, { "areg", TokenType::kAreg }, { "kill", TokenType::kKill },
+    { "reserve", TokenType::kReserve }, { "unreserve", TokenType::kUnreserve },
+    { "proc", TokenType::kProc }, { "cproc", TokenType::kCProc }, { "endproc", TokenType::kEndProc },
+    { "spill", TokenType::kSpill }, { "restore", TokenType::kRestore }, { "rename", TokenType::kRename },
+    { "call", TokenType::kCall },
+  };
+
+  for (const auto& kw : keywords)
+  {
+    Tokenizer tokenizer{StringFragment(kw.text)};
+    EXPECT_EQ(kw.type, tokenizer.next().m_Type) << kw.text;
+    EXPECT_EQ(TokenType::kEndOfLine, tokenizer.next().m_Type) << kw.text;
+  }
+
+  for (int i = 0; i < kRegisterCount; ++i)
+  {
+    Tokenizer tokenizer{StringFragment(regName(i))};
+    Token t = tokenizer.next();
+    EXPECT_EQ(TokenType::kRegister, t.m_Type) << regName(i);
+    EXPECT_EQ(i, t.m_Register);
+  }
+
+  // Near misses are plain identifiers.
+  static const char* const others[] = { "restor", "reservee", "Proc", "D0", "d", "d00", "a_", "endprod", "unreserved", "x" };
+  for (const char* text : others)
+  {
+    Tokenizer tokenizer{StringFragment(text)};
+    Token t = tokenizer.next();
+    EXPECT_EQ(TokenType::kIdentifier, t.m_Type) << text;
+    EXPECT_EQ(StringFragment(text), t.m_String);
+  }
+}
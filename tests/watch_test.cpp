@@ -0,0 +1,155 @@
+#include "watch.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string>
+
+#if defined(__linux__)
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  void writeFile(const std::string& path, const std::string& contents)
+  {
+    FILE* f = fopen(path.c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+  }
+
+  std::string readFile(const std::string& path)
+  {
+    std::string result;
+    if (FILE* f = fopen(path.c_str(), "rb"))
+    {
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+        result.append(buf, n);
+      fclose(f);
+    }
+    return result;
+  }
+
+  std::string procSource(int value)
+  {
+    return "\t\t@proc p\n\t\t@dreg a\n\t\tmoveq #" + std::to_string(value) + ",@a\n\t\t@endproc\n";
+  }
+
+  class WatchTest : public ::testing::Test
+  {
+  protected:
+    std::string m_Dir;
+    FILE*       m_Log = nullptr;
+
+    void SetUp() override
+    {
+      m_Dir = ::testing::TempDir() + "d68_watch_test";
+      mkdir(m_Dir.c_str(), 0777);
+      m_Log = tmpfile();
+    }
+
+    void TearDown() override
+    {
+      for (const char* name : { "a.s", "a.out", "b.s", "b.out", "b.tmp" })
+        remove(path(name).c_str());
+      rmdir(m_Dir.c_str());
+      fclose(m_Log);
+    }
+
+    std::string path(const char* name) const
+    {
+      return m_Dir + "/" + name;
+    }
+
+    BatchJob job(const char* input, const char* output) const
+    {
+      BatchJob j;
+      j.m_Input = path(input);
+      j.m_Output = path(output);
+      return j;
+    }
+  };
+}
+
+TEST_F(WatchTest, RebuildsChangedFiles)
+{
+  writeFile(path("a.s"), procSource(1));
+  writeFile(path("b.s"), procSource(2));
+
+  Watcher watcher(DriverOptions(), 10, m_Log);
+  ASSERT_TRUE(watcher.add(job("a.s", "a.out")));
+  ASSERT_TRUE(watcher.add(job("b.s", "b.out")));
+  EXPECT_EQ(0, watcher.buildAll());
+  EXPECT_NE(std::string::npos, readFile(path("a.out")).find("moveq #1,d7"));
+  EXPECT_NE(std::string::npos, readFile(path("b.out")).find("moveq #2,d7"));
+
+  // Writing the outputs isn't a reason to rebuild.
+  EXPECT_EQ(0, watcher.waitAndRebuild(0));
+
+  writeFile(path("a.s"), procSource(3));
+  EXPECT_EQ(1, watcher.waitAndRebuild(2000));
+  EXPECT_NE(std::string::npos, readFile(path("a.out")).find("moveq #3,d7"));
+
+  // Saving by renaming a new file into place counts too.
+  writeFile(path("b.tmp"), procSource(4));
+  ASSERT_EQ(0, rename(path("b.tmp").c_str(), path("b.s").c_str()));
+  EXPECT_EQ(1, watcher.waitAndRebuild(2000));
+  EXPECT_NE(std::string::npos, readFile(path("b.out")).find("moveq #4,d7"));
+
+  EXPECT_EQ(0, watcher.waitAndRebuild(0));
+}
+
+// A burst of saves ends up as a single rebuild of each file.
+TEST_F(WatchTest, DebouncesBursts)
+{
+  writeFile(path("a.s"), procSource(1));
+  writeFile(path("b.s"), procSource(1));
+
+  Watcher watcher(DriverOptions(), 50, m_Log);
+  ASSERT_TRUE(watcher.add(job("a.s", "a.out")));
+  ASSERT_TRUE(watcher.add(job("b.s", "b.out")));
+  EXPECT_EQ(0, watcher.buildAll());
+  watcher.waitAndRebuild(0);
+
+  for (int i = 0; i < 5; ++i)
+  {
+    writeFile(path("a.s"), procSource(10 + i));
+    writeFile(path("b.s"), procSource(20 + i));
+  }
+
+  EXPECT_EQ(2, watcher.waitAndRebuild(2000));
+  EXPECT_NE(std::string::npos, readFile(path("a.out")).find("moveq #14,d7"));
+  EXPECT_NE(std::string::npos, readFile(path("b.out")).find("moveq #24,d7"));
+}
+
+// A broken save keeps the last good output, and the next good one recovers.
+TEST_F(WatchTest, RecoversFromErrors)
+{
+  writeFile(path("a.s"), procSource(1));
+
+  Watcher watcher(DriverOptions(), 10, m_Log);
+  ASSERT_TRUE(watcher.add(job("a.s", "a.out")));
+  EXPECT_EQ(0, watcher.buildAll());
+  watcher.waitAndRebuild(0);
+
+  writeFile(path("a.s"), "\t\tmove.l @nope,d0\n");
+  EXPECT_EQ(1, watcher.waitAndRebuild(2000));
+  EXPECT_NE(std::string::npos, readFile(path("a.out")).find("moveq #1,d7"));
+
+  writeFile(path("a.s"), procSource(2));
+  EXPECT_EQ(1, watcher.waitAndRebuild(2000));
+  EXPECT_NE(std::string::npos, readFile(path("a.out")).find("moveq #2,d7"));
+
+  // Every rebuild is reported.
+  rewind(m_Log);
+  char buf[1024];
+  size_t n = fread(buf, 1, sizeof buf - 1, m_Log);
+  buf[n] = '\0';
+  std::string log = buf;
+  EXPECT_NE(std::string::npos, log.find("a.s: failed in "));
+  EXPECT_NE(std::string::npos, log.find("a.s: translated in "));
+}
+
+#endif
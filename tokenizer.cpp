@@ -1,9 +1,101 @@
 #include "tokenizer.h"
 #include "registers.h"
 
-#include <ctype.h>
 #include <string.h>
 
+constexpr CharClassTable kCharClasses = makeCharClassTable();
+
+namespace
+{
+  struct KeywordDef
+  {
+    const char* m_Text;
+    TokenType   m_Type;
+    int         m_Register;
+  };
+
+  // Register names are keywords too, so one lookup settles both.
+  constexpr KeywordDef kKeywordDefs[] =
+  {
+    { "dreg",      TokenType::kDreg,      0 },
+    { "areg",      TokenType::kAreg,      0 },
+    { "kill",      TokenType::kKill,      0 },
+    { "reserve",   TokenType::kReserve,   0 },
+    { "unreserve", TokenType::kUnreserve, 0 },
+    { "proc",      TokenType::kProc,      0 },
+    { "cproc",     TokenType::kCProc,     0 },
+    { "endproc",   TokenType::kEndProc,   0 },
+    { "spill",     TokenType::kSpill,     0 },
+    { "restore",   TokenType::kRestore,   0 },
+    { "rename",    TokenType::kRename,    0 },
+    { "call",      TokenType::kCall,      0 },
+    { "d0", TokenType::kRegister, kD0 }, { "d1", TokenType::kRegister, kD1 },
+    { "d2", TokenType::kRegister, kD2 }, { "d3", TokenType::kRegister, kD3 },
+    { "d4", TokenType::kRegister, kD4 }, { "d5", TokenType::kRegister, kD5 },
+    { "d6", TokenType::kRegister, kD6 }, { "d7", TokenType::kRegister, kD7 },
+    { "a0", TokenType::kRegister, kA0 }, { "a1", TokenType::kRegister, kA1 },
+    { "a2", TokenType::kRegister, kA2 }, { "a3", TokenType::kRegister, kA3 },
+    { "a4", TokenType::kRegister, kA4 }, { "a5", TokenType::kRegister, kA5 },
+    { "a6", TokenType::kRegister, kA6 }, { "a7", TokenType::kRegister, kA7 },
+  };
+
+  constexpr size_t kMaxKeywordLength = 9;
+  constexpr int kKeywordSlotBits = 5;
+
+  constexpr size_t constLength(const char* s)
+  {
+    size_t len = 0;
+    while (s[len])
+      ++len;
+    return len;
+  }
+
+  // Multiplicative hash of the first, middle and last characters and the
+  // length. The multiplier was found by search; the static_assert below
+  // checks that every keyword still gets a slot of its own.
+  constexpr uint32_t keywordSlot(const char* s, size_t len)
+  {
+    return (uint32_t(uint8_t(s[0]) | uint8_t(s[len >> 1]) << 8 | uint8_t(s[len - 1]) << 16 | len << 24) * 0x2ae8aac7u) >> (32 - kKeywordSlotBits);
+  }
+
+  struct KeywordSlot
+  {
+    char      m_Text[kMaxKeywordLength];
+    uint8_t   m_Length;
+    TokenType m_Type;
+    int8_t    m_Register;
+  };
+
+  struct KeywordTable
+  {
+    KeywordSlot m_Slots[1 << kKeywordSlotBits];
+    bool        m_Collision;
+  };
+
+  constexpr KeywordTable makeKeywordTable()
+  {
+    KeywordTable table {};
+    for (const KeywordDef& def : kKeywordDefs)
+    {
+      const size_t len = constLength(def.m_Text);
+      KeywordSlot& slot = table.m_Slots[keywordSlot(def.m_Text, len)];
+
+      if (slot.m_Length || len > kMaxKeywordLength)
+        table.m_Collision = true;
+
+      for (size_t i = 0; i < len; ++i)
+        slot.m_Text[i] = def.m_Text[i];
+      slot.m_Length = uint8_t(len);
+      slot.m_Type = def.m_Type;
+      slot.m_Register = int8_t(def.m_Register);
+    }
+    return table;
+  }
+
+  constexpr KeywordTable kKeywords = makeKeywordTable();
+  static_assert(!kKeywords.m_Collision, "keyword hash collision, pick another multiplier");
+}
+
 const char* tokenTypeName(TokenType tt)
 {
   static const char* names[] =
@@ -26,6 +118,7 @@ const char* tokenTypeName(TokenType tt)
     "spill",
     "restore",
     "rename",
+    "call",
     "unknown",
     "invalid"
   };
@@ -78,11 +171,8 @@ Token Tokenizer::decodeNext()
 
   const char* beg = m_Remain.ptr();
   const char* end = beg;
-  for (int i = 0, max = m_Remain.length(); i < max; ++i)
+  for (int i = 0, max = m_Remain.length(); i < max && isIdentChar(*end); ++i)
   {
-    char ch = *end;
-    if (!isalnum(ch) && '_' != ch)
-      break;
     ++end;
   }
 
@@ -93,45 +183,19 @@ Token Tokenizer::decodeNext()
 
   size_t len = end - beg;
 
-  static struct Keyword {
-    size_t len;
-    const char text[10];
-    TokenType type;
-  } keywords[] = {
-    { 4, "dreg",      TokenType::kDreg },
-    { 4, "areg",      TokenType::kAreg },
-    { 4, "kill",      TokenType::kKill },
-    { 7, "reserve",   TokenType::kReserve },
-    { 9, "unreserve", TokenType::kUnreserve },
-    { 4, "proc",      TokenType::kProc },
-    { 5, "cproc",     TokenType::kCProc },
-    { 7, "endproc",   TokenType::kEndProc },
-    { 5, "spill",     TokenType::kSpill },
-    { 7, "restore",   TokenType::kRestore },
-    { 6, "rename",    TokenType::kRename },
-  };
-
-  for (size_t i = 0; i < sizeof(keywords)/sizeof(keywords[0]); ++i)
+  if (len <= kMaxKeywordLength)
   {
-    if (keywords[i].len != len)
-      continue;
-    if (0 != memcmp(keywords[i].text, beg, len))
-      continue;
+    const KeywordSlot& slot = kKeywords.m_Slots[keywordSlot(beg, len)];
 
-    return Token(keywords[i].type, m_Remain.slice(len));
-  }
-
-  if (len == 2)
-  {
-    if (beg[0] == 'a' || beg[0] == 'd')
+    if (slot.m_Length == len && 0 == memcmp(slot.m_Text, beg, len))
     {
-      if (beg[1] >= '0' && beg[1] <= '7')
+      if (TokenType::kRegister == slot.m_Type)
       {
-        int index = beg[0] == 'a' ? kAddressBase : kDataBase;
-        index += beg[1] - '0';
-        m_Remain.slice(2);
-        return Token(TokenType::kRegister, index);
+        m_Remain.slice(len);
+        return Token(TokenType::kRegister, int(slot.m_Register));
       }
+
+      return Token(slot.m_Type, m_Remain.slice(len));
     }
   }
 
@@ -142,7 +206,7 @@ StringFragment skipWhitespace(StringFragment input)
 {
   for (int i = 0, count = input.length(); i < count; ++i)
   {
-    if (!isspace(input[i]))
+    if (!isSpaceChar(input[i]))
     {
       return input.skip(i);
     }
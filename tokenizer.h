@@ -1,7 +1,49 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "stringfragment.h"
 
+// Character classes as the "C" locale sees them, looked up in a table rather
+// than through the locale-aware <ctype.h> functions.
+enum : uint8_t
+{
+  kCharSpace = 1 << 0,      // ' ', \t, \n, \v, \f, \r
+  kCharIdent = 1 << 1,      // [A-Za-z0-9_]
+};
+
+struct CharClassTable
+{
+  uint8_t m_Flags[256];
+};
+
+constexpr CharClassTable makeCharClassTable()
+{
+  CharClassTable table {};
+  for (int ch = 0; ch < 256; ++ch)
+  {
+    uint8_t flags = 0;
+    if (' ' == ch || ('\t' <= ch && ch <= '\r'))
+      flags |= kCharSpace;
+    if (('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9') || '_' == ch)
+      flags |= kCharIdent;
+    table.m_Flags[ch] = flags;
+  }
+  return table;
+}
+
+extern const CharClassTable kCharClasses;
+
+inline bool isSpaceChar(char ch)
+{
+  return 0 != (kCharClasses.m_Flags[uint8_t(ch)] & kCharSpace);
+}
+
+inline bool isIdentChar(char ch)
+{
+  return 0 != (kCharClasses.m_Flags[uint8_t(ch)] & kCharIdent);
+}
+
 enum class TokenType
 {
   kAreg,
@@ -22,6 +64,7 @@ enum class TokenType
   kSpill,
   kRestore,
   kRename,
+  kCall,
   kUnknown,
   kInvalid,
   kCount
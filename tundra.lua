@@ -39,6 +39,19 @@ Build {
       Sources = {
         "deluxe.cpp",
         "main.cpp",
+        "driver.cpp",
+        "server.cpp",
+        "watch.cpp",
+        "cache.cpp",
+        "proccache.cpp",
+        "atomicfile.cpp",
+        "inputfile.cpp",
+        "linereader.cpp",
+        "scan.cpp",
+        "stats.cpp",
+        "symboltable.cpp",
+        "signatures.cpp",
+        "outputsink.cpp",
         "tokenizer.cpp",
         "registers.cpp"
       },
@@ -56,14 +69,107 @@ Build {
         "tokenizer.cpp",
         "deluxe.cpp",
         "registers.cpp",
+        "inputfile.cpp",
+        "linereader.cpp",
+        "scan.cpp",
+        "stats.cpp",
+        "symboltable.cpp",
+        "signatures.cpp",
+        "outputsink.cpp",
+        "driver.cpp",
+        "server.cpp",
+        "watch.cpp",
+        "cache.cpp",
+        "proccache.cpp",
+        "atomicfile.cpp",
         "tests/deluxetest.cpp",
         "tests/d68test.cpp",
         "tests/tokenizer_test.cpp",
         "tests/regsave.cpp",
+        "tests/inputfile_test.cpp",
+        "tests/streaming.cpp",
+        "tests/linereader_test.cpp",
+        "tests/driver_test.cpp",
+        "tests/server_test.cpp",
+        "tests/cache_test.cpp",
+        "tests/proccache_test.cpp",
+        "tests/scan_test.cpp",
+        "tests/symboltable_test.cpp",
+        "tests/outputsink_test.cpp",
+        "tests/parallel_test.cpp",
+        "tests/reuse_test.cpp",
+        "tests/watch_test.cpp",
+        "tests/stats_test.cpp",
+        "tests/diagnostic_test.cpp",
+        "tests/compact_test.cpp",
+        "tests/split_test.cpp",
+        "tests/arena_test.cpp",
+        "tests/signature_test.cpp",
         "external/gtest/googletest/src/gtest-all.cc" },
       Libs = { "pthread"; Config = "linux-*-*" },
     }
     Default(deluxeTest)
+
+    local scanBench = Program {
+      Name = "deluxe68scanbench",
+      Sources = {
+        "bench/scan_bench.cpp",
+        "scan.cpp",
+        "symboltable.cpp",
+        "signatures.cpp",
+        "outputsink.cpp",
+        "deluxe.cpp",
+        "proccache.cpp",
+        "atomicfile.cpp",
+        "inputfile.cpp",
+        "linereader.cpp",
+        "tokenizer.cpp",
+        "registers.cpp"
+      },
+      Libs = { "pthread"; Config = "linux-*-*" },
+    }
+    Default(scanBench)
+
+    local symbolBench = Program {
+      Name = "deluxe68symbolbench",
+      Sources = {
+        "bench/symbol_bench.cpp",
+        "scan.cpp",
+        "symboltable.cpp",
+        "signatures.cpp",
+        "outputsink.cpp",
+        "deluxe.cpp",
+        "proccache.cpp",
+        "atomicfile.cpp",
+        "inputfile.cpp",
+        "linereader.cpp",
+        "tokenizer.cpp",
+        "registers.cpp"
+      },
+      Libs = { "pthread"; Config = "linux-*-*" },
+    }
+    Default(symbolBench)
+
+    local bench = Program {
+      Name = "deluxe68bench",
+      Sources = {
+        "bench/deluxe68_bench.cpp",
+        "bench/corpus.cpp",
+        "scan.cpp",
+        "symboltable.cpp",
+        "signatures.cpp",
+        "outputsink.cpp",
+        "deluxe.cpp",
+        "proccache.cpp",
+        "atomicfile.cpp",
+        "inputfile.cpp",
+        "linereader.cpp",
+        "tokenizer.cpp",
+        "registers.cpp"
+      },
+      Libs = { "pthread"; Config = "linux-*-*" },
+    }
+    Default(bench)
   end,
 
   Configs = {
@@ -0,0 +1,214 @@
+#include "watch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "deluxe.h"
+#include "proccache.h"
+
+#if defined(__linux__)
+#define D68_HAVE_INOTIFY 1
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#else
+#define D68_HAVE_INOTIFY 0
+#endif
+
+struct Watcher::Job
+{
+  BatchJob    m_Files;
+  int         m_Watch = -1;       // Watch descriptor of the input's directory
+  std::string m_Name;             // Input file name within that directory
+  bool        m_Changed = false;
+  Deluxe68    m_Translator;
+  ProcCache   m_Procedures;
+};
+
+Watcher::Watcher(const DriverOptions& options, int debounceMs, FILE* log)
+  : m_Options(options)
+  , m_DebounceMs(debounceMs)
+  , m_Log(log)
+  , m_Stop(0)
+{
+#if D68_HAVE_INOTIFY
+  m_NotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+Watcher::~Watcher()
+{
+#if D68_HAVE_INOTIFY
+  if (m_NotifyFd >= 0)
+    close(m_NotifyFd);
+#endif
+}
+
+bool Watcher::rebuild(Job& job)
+{
+  WarmState warm;
+  warm.m_Translator = &job.m_Translator;
+  warm.m_Procedures = &job.m_Procedures;
+
+  auto start = std::chrono::steady_clock::now();
+  bool ok = 0 == translateFile(job.m_Files.m_Input.c_str(), job.m_Files.m_Output.c_str(), m_Options, &warm);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+  fprintf(m_Log, "%s: %s in %.2f ms\n", job.m_Files.m_Input.c_str(), ok ? "translated" : "failed", elapsed.count());
+  fflush(m_Log);
+  return ok;
+}
+
+int Watcher::buildAll()
+{
+  int failed = 0;
+
+  for (auto& job : m_Jobs)
+  {
+    job->m_Changed = false;
+    if (!rebuild(*job))
+      ++failed;
+  }
+
+  return failed;
+}
+
+int Watcher::waitAndRebuild(int timeoutMs)
+{
+  if (readEvents(timeoutMs) <= 0)
+    return 0;
+
+  // Editors save in several steps (write, rename, chmod); wait until things
+  // are quiet, but don't let a busy directory hold off the rebuild forever.
+  for (int round = 0; round < 10 && readEvents(m_DebounceMs) > 0; ++round)
+  {
+  }
+
+  int count = 0;
+  int failed = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto& job : m_Jobs)
+  {
+    if (!job->m_Changed)
+      continue;
+
+    job->m_Changed = false;
+    ++count;
+    if (!rebuild(*job))
+      ++failed;
+  }
+
+  if (count > 1)
+  {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    fprintf(m_Log, "rebuilt %d files in %.2f ms, %d failed\n", count, elapsed.count(), failed);
+    fflush(m_Log);
+  }
+
+  return count;
+}
+
+void Watcher::run()
+{
+  while (!m_Stop)
+  {
+    // Wake up regularly to notice stop().
+    waitAndRebuild(100);
+  }
+}
+
+void Watcher::stop()
+{
+  m_Stop = 1;
+}
+
+#if D68_HAVE_INOTIFY
+
+bool Watcher::add(const BatchJob& files)
+{
+  if (m_NotifyFd < 0)
+  {
+    fprintf(stderr, "can't watch files: %s\n", strerror(errno));
+    return false;
+  }
+
+  std::unique_ptr<Job> job(new Job);
+  job->m_Files = files;
+
+  // Watch the directory rather than the file, so saves that replace the file
+  // with a rename are seen too.
+  const std::string& path = files.m_Input;
+  size_t slash = path.rfind('/');
+  std::string dir = std::string::npos == slash ? "." : 0 == slash ? "/" : path.substr(0, slash);
+  job->m_Name = std::string::npos == slash ? path : path.substr(slash + 1);
+
+  // Adding the same directory again returns the existing descriptor.
+  job->m_Watch = inotify_add_watch(m_NotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (job->m_Watch < 0)
+  {
+    fprintf(stderr, "can't watch %s: %s\n", dir.c_str(), strerror(errno));
+    return false;
+  }
+
+  m_Jobs.push_back(std::move(job));
+  return true;
+}
+
+int Watcher::readEvents(int timeoutMs)
+{
+  pollfd pfd;
+  pfd.fd = m_NotifyFd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  if (m_NotifyFd < 0 || poll(&pfd, 1, timeoutMs) <= 0)
+    return 0;
+
+  alignas(inotify_event) char buf[4096];
+  int count = 0;
+
+  for (;;)
+  {
+    ssize_t n = read(m_NotifyFd, buf, sizeof buf);
+    if (n <= 0)
+      break;
+
+    for (ssize_t pos = 0; pos < n; )
+    {
+      const inotify_event* ev = reinterpret_cast<const inotify_event*>(buf + pos);
+      pos += sizeof(inotify_event) + ev->len;
+      ++count;
+
+      if (0 == ev->len)
+        continue;
+
+      for (auto& job : m_Jobs)
+      {
+        if (job->m_Watch == ev->wd && job->m_Name == ev->name)
+          job->m_Changed = true;
+      }
+    }
+  }
+
+  return count;
+}
+
+#else
+
+bool Watcher::add(const BatchJob& files)
+{
+  fprintf(stderr, "--watch isn't supported on this platform\n");
+  return false;
+}
+
+int Watcher::readEvents(int timeoutMs)
+{
+  return 0;
+}
+
+#endif
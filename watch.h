@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "driver.h"
+
+// Keeps a set of input:output translations resident and translates inputs
+// again whenever they change on disk (--watch).
+//
+// Each file keeps its own translator and procedure cache between rebuilds, so
+// after an edit only the procedures that changed go through register
+// allocation. Changes are picked up with inotify, which makes this Linux only.
+class Watcher
+{
+  struct Job;
+
+  DriverOptions                     m_Options;
+  std::vector<std::unique_ptr<Job>> m_Jobs;
+  int                               m_NotifyFd = -1;
+  int                               m_DebounceMs;
+  FILE*                             m_Log;
+  std::atomic<int>                  m_Stop;
+
+public:
+  static constexpr int kDefaultDebounceMs = 50;
+
+  // Rebuilds are reported to 'log'; diagnostics go to stderr as usual.
+  explicit Watcher(const DriverOptions& options, int debounceMs = kDefaultDebounceMs, FILE* log = stderr);
+  ~Watcher();
+
+  Watcher(const Watcher&) = delete;
+  Watcher& operator=(const Watcher&) = delete;
+
+  // Start watching job.m_Input. Returns false if it can't be watched.
+  bool add(const BatchJob& job);
+
+  // Translate every file. Returns the number of files that failed.
+  int buildAll();
+
+  // Wait up to 'timeoutMs' for inputs to change, let a burst of changes
+  // settle for the debounce interval and translate the changed files.
+  // Returns the number of files translated, 0 if nothing changed.
+  int waitAndRebuild(int timeoutMs);
+
+  // Rebuild changes until stop() is called.
+  void run();
+
+  // Ask run() to return. Safe to call from any thread or a signal handler.
+  void stop();
+
+private:
+  int readEvents(int timeoutMs);
+  bool rebuild(Job& job);
+};